@@ -0,0 +1,331 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// Measures per phase throughput of decoding, mixing and encoding
+// the given media files, and writes the results as JSON.
+
+// For clock_gettime and getrusage
+#define _XOPEN_SOURCE 600
+
+#include "rawmedia.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define DEFAULT_FRAME_RATE 30
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define MIX_MAX_LAYERS 64
+#define MIX_ITERATIONS 2000
+#define MIX_LAYER_COUNTS 7  // 1, 2, 4 .. MIX_MAX_LAYERS
+
+typedef struct FileResult {
+    const char* filename;
+    RawMediaSession session;    // Session for the -r rate given before filename
+    int duration;
+    int width;
+    int height;
+    double open_ms;
+    double seek_ms;
+    double video_fps;
+    double audio_fps;
+    double encode_fps;
+} FileResult;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static double rate(int count, double ms) {
+    return ms > 0 ? count * 1000.0 / ms : 0;
+}
+
+// Writes s as a JSON string
+static void write_string(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static RawMediaDecoder* open_decoder(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config, double* ms) {
+    double start = now_ms();
+    RawMediaDecoder* rmd = rawmedia_create_decoder(filename, session, config);
+    *ms = now_ms() - start;
+    if (!rmd)
+        fprintf(stderr, "%s: failed to open\n", filename);
+    return rmd;
+}
+
+// Decode all video, keeping a copy of the last frame for encoding
+static int bench_video(FileResult* result, const RawMediaSession* session, const RawMediaDecoderConfig* base, uint8_t** frame, int* frame_size) {
+    RawMediaDecoderConfig config = *base;
+    config.discard_audio = true;
+    double ms;
+    RawMediaDecoder* rmd = open_decoder(result->filename, session, &config, &ms);
+    if (!rmd)
+        return -1;
+    const RawMediaDecoderInfo* info = rawmedia_get_decoder_info(rmd);
+    if (!info->has_video) {
+        rawmedia_destroy_decoder(rmd);
+        return 0;
+    }
+
+    uint8_t* buffer = NULL;
+    int size = 0;
+    double start = now_ms();
+    for (int i = 0; i < info->duration; i++) {
+        if (rawmedia_decode_video(rmd, &buffer, &result->width, &result->height, &size) < 0) {
+            fprintf(stderr, "%s: failed to decode video\n", result->filename);
+            rawmedia_destroy_decoder(rmd);
+            return -1;
+        }
+    }
+    result->video_fps = rate(info->duration, now_ms() - start);
+
+    if (buffer && (*frame = malloc(size))) {
+        memcpy(*frame, buffer, size);
+        *frame_size = size;
+    }
+    rawmedia_destroy_decoder(rmd);
+    return 0;
+}
+
+static int bench_audio(FileResult* result, const RawMediaSession* session, const RawMediaDecoderConfig* base) {
+    RawMediaDecoderConfig config = *base;
+    config.discard_video = true;
+    double ms;
+    RawMediaDecoder* rmd = open_decoder(result->filename, session, &config, &ms);
+    if (!rmd)
+        return -1;
+    const RawMediaDecoderInfo* info = rawmedia_get_decoder_info(rmd);
+    if (!info->has_audio) {
+        rawmedia_destroy_decoder(rmd);
+        return 0;
+    }
+
+    uint8_t buffer[session->audio_framebuffer_size];
+    double start = now_ms();
+    for (int i = 0; i < info->duration; i++) {
+        if (rawmedia_decode_audio(rmd, buffer) < 0) {
+            fprintf(stderr, "%s: failed to decode audio\n", result->filename);
+            rawmedia_destroy_decoder(rmd);
+            return -1;
+        }
+    }
+    result->audio_fps = rate(info->duration, now_ms() - start);
+    rawmedia_destroy_decoder(rmd);
+    return 0;
+}
+
+static int bench_encode(FileResult* result, const RawMediaSession* session, const char* output, const uint8_t* frame, int frame_size) {
+    RawMediaEncoderConfig config = { .width = result->width,
+                                     .height = result->height,
+                                     .has_video = true,
+                                     .has_audio = true };
+    RawMediaEncoder* rme = rawmedia_create_encoder(output, session, &config);
+    if (!rme) {
+        fprintf(stderr, "%s: failed to create encoder\n", output);
+        return -1;
+    }
+    uint8_t audio[session->audio_framebuffer_size];
+    memset(audio, 0, sizeof(audio));
+
+    double start = now_ms();
+    for (int i = 0; i < result->duration; i++) {
+        if (rawmedia_encode_video(rme, frame, frame_size) < 0
+            || rawmedia_encode_audio(rme, audio) < 0) {
+            fprintf(stderr, "%s: failed to encode\n", output);
+            rawmedia_destroy_encoder(rme);
+            return -1;
+        }
+    }
+    int r = rawmedia_destroy_encoder(rme);
+    result->encode_fps = rate(result->duration, now_ms() - start);
+    return r;
+}
+
+static int bench_file(FileResult* result, const RawMediaSession* session, const RawMediaDecoderConfig* config, const char* encode_output) {
+    double seek_open_ms;
+    RawMediaDecoder* rmd = open_decoder(result->filename, session, config, &result->open_ms);
+    if (!rmd)
+        return -1;
+    result->duration = rawmedia_get_decoder_info(rmd)->duration;
+    rawmedia_destroy_decoder(rmd);
+
+    // The extra cost of opening at the midpoint is the initial seek
+    RawMediaDecoderConfig seek_config = *config;
+    seek_config.start_frame = result->duration / 2;
+    if (!(rmd = open_decoder(result->filename, session, &seek_config, &seek_open_ms)))
+        return -1;
+    rawmedia_destroy_decoder(rmd);
+    result->seek_ms = seek_open_ms - result->open_ms;
+
+    uint8_t* frame = NULL;
+    int frame_size = 0;
+    int r = bench_video(result, session, config, &frame, &frame_size);
+    if (r >= 0)
+        r = bench_audio(result, session, config);
+    if (r >= 0 && frame)
+        r = bench_encode(result, session, encode_output, frame, frame_size);
+    free(frame);
+    return r;
+}
+
+// Mixes per second of layers audio buffers
+static double bench_mix(const RawMediaSession* session, uint8_t* const* buffers, int layers) {
+    uint8_t output[session->audio_framebuffer_size];
+    double start = now_ms();
+    for (int i = 0; i < MIX_ITERATIONS; i++)
+        rawmedia_mix_audio(session, (const uint8_t* const*)buffers, layers, output);
+    return rate(MIX_ITERATIONS, now_ms() - start);
+}
+
+static void write_results(FILE* fp, const RawMediaSession* session, const FileResult* results, int count, const double* mix_rates) {
+    fprintf(fp, "{\n  \"framerate\": \"%d/%d\",\n  \"files\": [",
+            session->framerate_num, session->framerate_den);
+    for (int i = 0; i < count; i++) {
+        const FileResult* r = &results[i];
+        fprintf(fp, "%s\n    {\"file\": ", i ? "," : "");
+        write_string(fp, r->filename);
+        fprintf(fp, ", \"framerate\": \"%d/%d\"",
+                r->session.framerate_num, r->session.framerate_den);
+        fprintf(fp, ", \"frames\": %d, \"width\": %d, \"height\": %d,"
+                " \"open_ms\": %.3f, \"seek_ms\": %.3f,"
+                " \"video_fps\": %.2f, \"audio_fps\": %.2f, \"encode_fps\": %.2f}",
+                r->duration, r->width, r->height, r->open_ms, r->seek_ms,
+                r->video_fps, r->audio_fps, r->encode_fps);
+    }
+    fprintf(fp, "\n  ],\n  \"mix\": [");
+    for (int i = 0; i < MIX_LAYER_COUNTS; i++) {
+        fprintf(fp, "%s\n    {\"layers\": %d, \"mixes_per_sec\": %.1f}",
+                i ? "," : "", 1 << i, mix_rates[i]);
+    }
+    fprintf(fp, "\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-s WxH] [-o results.json] [-e encode-output.mov] [[-r framerate] <input-file>...]...\n"
+            "  -r sets the session framerate (e.g. 24 or 30000/1001) of the input files after it,\n"
+            "  and of the mix benchmark if given before the first input file\n", name);
+}
+
+// Init session for framerate "num" or "num/den", returns <0 if invalid
+static int init_session(RawMediaSession* session, const char* framerate) {
+    int num, den = 1;
+    if (sscanf(framerate, "%d/%d", &num, &den) < 1 || num <= 0 || den <= 0)
+        return -1;
+    *session = (RawMediaSession){ .framerate_num = num, .framerate_den = den };
+    return rawmedia_init_session(session);
+}
+
+int main(int argc, const char* argv[]) {
+    int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+    const char* output_filename = NULL;
+    const char* encode_filename = "rawmedia_bench.mov";
+
+    rawmedia_init();
+    RawMediaSession session = { .framerate_num = DEFAULT_FRAME_RATE,
+                                .framerate_den = 1 };
+    if (rawmedia_init_session(&session) < 0)
+        return -1;
+    // The mix benchmark uses the framerate in effect at the first input file
+    RawMediaSession mix_session = session;
+
+    FileResult* results = calloc(argc, sizeof(FileResult));
+    if (!results)
+        return -1;
+    int count = 0;
+    for (int arg = 1; arg < argc; arg++) {
+        if (argv[arg][0] != '-') {
+            if (!count)
+                mix_session = session;
+            results[count].filename = argv[arg];
+            results[count].session = session;
+            count++;
+            continue;
+        }
+        if (arg + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        const char* value = argv[++arg];
+        if (!strcmp(argv[arg - 1], "-r")) {
+            if (init_session(&session, value) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[arg - 1], "-s")) {
+            if (sscanf(value, "%dx%d", &width, &height) != 2) {
+                usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[arg - 1], "-o"))
+            output_filename = value;
+        else if (!strcmp(argv[arg - 1], "-e"))
+            encode_filename = value;
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (!count) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    RawMediaDecoderConfig config = { .max_width = width,
+                                     .max_height = height,
+                                     .volume = 1 };
+    uint8_t* mix_buffers[MIX_MAX_LAYERS];
+    double mix_rates[MIX_LAYER_COUNTS];
+    for (int i = 0; i < count; i++) {
+        if (bench_file(&results[i], &results[i].session, &config, encode_filename) < 0)
+            return -1;
+    }
+    for (int i = 0; i < MIX_MAX_LAYERS; i++) {
+        if (!(mix_buffers[i] = malloc(mix_session.audio_framebuffer_size)))
+            return -1;
+        for (int b = 0; b < mix_session.audio_framebuffer_size; b++)
+            mix_buffers[i][b] = rand();
+    }
+    for (int i = 0; i < MIX_LAYER_COUNTS; i++)
+        mix_rates[i] = bench_mix(&mix_session, mix_buffers, 1 << i);
+
+    FILE* fp = output_filename ? fopen(output_filename, "w") : stdout;
+    if (!fp) {
+        fprintf(stderr, "%s: failed to open\n", output_filename);
+        return -1;
+    }
+    write_results(fp, &mix_session, results, count, mix_rates);
+    if (fp != stdout)
+        fclose(fp);
+
+    for (int i = 0; i < MIX_MAX_LAYERS; i++)
+        free(mix_buffers[i]);
+    free(results);
+    return 0;
+}
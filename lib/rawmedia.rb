@@ -16,7 +16,16 @@ require 'rawmedia/errors'
 require 'rawmedia/util'
 require 'rawmedia/internal'
 require 'rawmedia/log'
+require 'rawmedia/stats'
+require 'rawmedia/frame_cache'
 require 'rawmedia/session'
+require 'rawmedia/video_frame'
 require 'rawmedia/decoder'
+require 'rawmedia/decoder_open'
 require 'rawmedia/encoder'
+require 'rawmedia/fanout_encoder'
 require 'rawmedia/audio_mixer'
+require 'rawmedia/mix_bus'
+require 'rawmedia/timeline'
+require 'rawmedia/transcode'
+require 'rawmedia/waveform'
@@ -17,6 +17,35 @@ module RawMedia
                                    @buffer_count, output_buffer)
     end
 
+    # @param [Array<#to_ptr>] input_buffers input audio buffers,
+    #  may contain nil elements
+    # @param [#to_ptr] output_buffer where to write mixed audio
+    # @param [Array<Numeric, Range>] gains linear gain per buffer,
+    #  a Range ramps gain from begin to end across the buffer, nil for unity
+    # @param [Array<Numeric>] pans -1.0 (left) to 1.0 (right) per buffer,
+    #  nil for center
+    def mix_weighted(input_buffers, output_buffer, gains=nil, pans=nil)
+      fill_buffer_array(input_buffers)
+      gains_ptr = nil
+      if gains
+        gains_ptr = FFI::MemoryPointer.new(:float, 2 * @buffer_count)
+        gains_ptr.put_array_of_float(0, gains.map do |gain|
+          if gain.nil? then [1.0, 1.0]
+          elsif gain.is_a?(Range) then [gain.begin, gain.end]
+          else [gain, gain]
+          end
+        end.flatten)
+      end
+      pans_ptr = nil
+      if pans
+        pans_ptr = FFI::MemoryPointer.new(:float, @buffer_count)
+        pans_ptr.put_array_of_float(0, pans.map {|pan| pan || 0.0 })
+      end
+      Internal::rawmedia_mix_audio_weighted(@session.session, @buffer_list_ptr,
+                                            gains_ptr, pans_ptr,
+                                            @buffer_count, output_buffer)
+    end
+
     def fill_buffer_array(input_buffers)
       if input_buffers.length != @buffer_count
         @buffer_count = input_buffers.length
@@ -1,8 +1,54 @@
 # Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
 # Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
 
+require 'thread'
+
 module RawMedia
   class Decoder
+    # A frame decoded ahead by Decoder#each_frame.
+    # Frames are reused, so are only valid within the block.
+    class Frame
+      # @return [Fixnum] frame number
+      attr_reader :index
+      # @return [VideoFrame] nil if no video
+      attr_reader :video
+      # @return [FFI::MemoryPointer] Session#audio_framebuffer_size bytes, nil if no audio
+      attr_reader :audio
+
+      # @private
+      def initialize(audio_size)
+        @audio = FFI::MemoryPointer.new(audio_size) if audio_size > 0
+        @src = Internal::RawMediaVideoFrame.new
+      end
+
+      # @return [Boolean] true if video is newly decoded,
+      #  false if it repeats the previous frame
+      def new_video?
+        @new_video
+      end
+
+      # @private
+      def decode(decoder, index)
+        @index = index
+        if decoder.has_video?
+          @new_video = decoder.decode_video > 0
+          width, height = decoder.width, decoder.height
+          if height > 0
+            @src[:data] = decoder.video_buffer
+            @src[:linesize] = decoder.video_buffer_size / height
+            @src[:width] = width
+            @src[:height] = height
+            # Copy, as the decoder reuses its buffer for the next frame
+            @video = VideoFrame.create(width, height) unless @video and
+              @video.width == width and @video.height == height
+            Internal::check Internal::rawmedia_copy_video(@src, @video.frame)
+          end
+        end
+        decoder.decode_audio(@audio) if @audio
+        self
+      end
+    end
+
     # @param [Fixnum] max_width maximum width of decoded video
     # @param [Fixnum] max_height maximum height of decoded video
     # @param [Hash] opts decoding options.
@@ -10,23 +56,81 @@ module RawMedia
     # @option opts [Fixnum] :start_frame Starting video frame in target framerate
     # @option opts [Boolean] :discard_video Ignore video if True
     # @option opts [Boolean] :discard_audio Ignore audio if True
+    # @option opts [Boolean] :keyframe_seek Seek to the keyframe before
+    #  :start_frame instead of decoding from the start of the file
+    # @option opts [Boolean] :letterbox Always output max_width x max_height
+    #  video, centered on a :background_color border
+    # @option opts [Fixnum] :background_color 0xRRGGBB border color, default black
+    # @option opts [Array<Fixnum>] :crop [x, y, width, height] region of the
+    #  source video to decode, applied before scaling
+    # @option opts [Array<Array<Fixnum>>] :outputs [max_width, max_height]
+    #  bounds of additional video outputs, see #video_output
+    # @option opts [Fixnum] :reverse_cache Recently decoded frames kept for
+    #  #decode_video_at, at least the source GOP length for reverse playback
     def initialize(filename, session, max_width, max_height, opts={})
-      volume = opts.fetch(:volume, 1.0)
-      # Use an exponential curve for volume
-      # See http://www.dr-lex.be/info-stuff/volumecontrols.html
-      if volume > 0 and volume < 1
-        volume = Math.exp(6.908 * volume) / 1000.0
-        volume *= volume * 10 if volume < 0.1
-      end
-      config = Internal::RawMediaDecoderConfig.new
-      config[:max_width] = max_width
-      config[:max_height] = max_height
-      config[:start_frame] = opts.fetch(:start_frame, 0)
-      config[:volume] = volume
-      config[:discard_video] = opts[:discard_video]
-      config[:discard_audio] = opts[:discard_audio]
+      config = Decoder.create_config(max_width, max_height, opts)
       decoder = Internal::rawmedia_create_decoder(filename, session.session, config)
       raise(RawMediaError, "Failed to create Decoder for #{filename}") if decoder.null?
+      attach(decoder, session)
+    end
+
+    # Create a Decoder that plays several files back to back without gaps.
+    # Each entry is opened and seeked in the background before it is reached.
+    # The :crop and :outputs options are not supported.
+    # @param [Array<String, Hash>] entries filenames, or hashes with
+    #  :filename, :in_frame and :out_frame (exclusive, default end of file)
+    # @param (see #initialize)
+    # @return [Decoder]
+    def self.playlist(entries, session, max_width, max_height, opts={})
+      config = Decoder.create_config(max_width, max_height, opts)
+      entries = entries.map {|e| e.is_a?(Hash) ? e : { filename: e } }
+      filenames = entries.map {|e| FFI::MemoryPointer.from_string(e[:filename]) }
+      entries_ptr = FFI::MemoryPointer.new(Internal::RawMediaPlaylistEntry, entries.length)
+      entries.each_with_index do |e, i|
+        entry = Internal::RawMediaPlaylistEntry.new(entries_ptr + i * Internal::RawMediaPlaylistEntry.size)
+        entry[:filename] = filenames[i]
+        entry[:in_frame] = e.fetch(:in_frame, 0)
+        entry[:out_frame] = e.fetch(:out_frame, 0)
+      end
+      decoder = Internal::rawmedia_create_playlist_decoder(entries_ptr, entries.length,
+                                                           session.session, config)
+      raise(RawMediaError, "Failed to create playlist Decoder") if decoder.null?
+      wrap(decoder, session)
+    end
+
+    # Create a Decoder reading a store written by #write_frame_store,
+    # without decoding. Video buffers point into the mapped store.
+    # @param [String] filename the store
+    # @param [Session] session with the framerate the store was written with
+    # @return [Decoder]
+    def self.frame_store(filename, session)
+      decoder = Internal::rawmedia_create_frame_store_decoder(filename, session.session)
+      raise(RawMediaError, "Failed to open frame store #{filename}") if decoder.null?
+      wrap(decoder, session)
+    end
+
+    # Start opening a Decoder on a library worker thread,
+    # so several files can be opened in parallel.
+    # @param (see #initialize)
+    # @return [DecoderOpen]
+    def self.open_async(filename, session, max_width, max_height, opts={})
+      config = Decoder.create_config(max_width, max_height, opts)
+      open = Internal::rawmedia_create_decoder_async(filename, session.session, config)
+      raise(RawMediaError, "Failed to open Decoder for #{filename}") if open.null?
+      DecoderOpen.new(open, filename, session)
+    end
+
+    # @private
+    # @param [FFI::Pointer] decoder native decoder to take ownership of
+    # @param [Session] session the decoder was created with
+    def self.wrap(decoder, session)
+      instance = allocate
+      instance.send(:attach, decoder, session)
+      instance
+    end
+
+    def attach(decoder, session)
+      @session = session
       # Wrap in AutoPointer to manage lifetime
       @decoder = Internal::RawMediaDecoder.new(decoder)
       info = Internal::rawmedia_get_decoder_info(@decoder)
@@ -38,6 +142,7 @@ module RawMedia
       @height_ptr = FFI::MemoryPointer.new :int
       @video_buffer_size_ptr = FFI::MemoryPointer.new :int
     end
+    private :attach
 
     def width
       @width_ptr.get_int
@@ -55,6 +160,13 @@ module RawMedia
       @video_buffer_size_ptr.get_int
     end
 
+    # Wraps the last decoded video in a VideoFrame,
+    # valid until the next call to decode_video.
+    # @return [VideoFrame]
+    def video_frame
+      VideoFrame.new(video_buffer, width, height, video_buffer_size / height)
+    end
+
     # Wraps video_buffer in a Java ByteBuffer.
     # @return [java.nio.ByteBuffer] Java buffer wrapping buffer
     def video_byte_buffer
@@ -73,12 +185,113 @@ module RawMedia
                                                       @video_buffer_size_ptr)
     end
 
+    # Decode a frame in any order, e.g. stepping backwards. Frames behind
+    # the decoder come from the :reverse_cache, or are decoded again from
+    # the preceding keyframe. #decode_video then continues from frame + 1,
+    # and #decode_audio from frame.
+    # @param [Fixnum] frame counted from :start_frame
+    # @return [Fixnum] 0 if frame is past the end, > 0 if decoded
+    def decode_video_at(frame)
+      Internal::check Internal::rawmedia_decode_video_at(@decoder, frame,
+                                                         @video_buffer_ptr,
+                                                         @width_ptr,
+                                                         @height_ptr,
+                                                         @video_buffer_size_ptr)
+    end
+
+    # Get an output of the last frame decoded by #decode_video,
+    # valid until the next call to decode_video.
+    # @param [Fixnum] index 0 for the primary output, 1.. for :outputs
+    # @return [VideoFrame] nil if no frame decoded yet
+    def video_output(index)
+      # Pointers for decode_video_output, reused across calls
+      @output_ptrs ||= [:pointer, :int, :int, :int].map {|type| FFI::MemoryPointer.new(type) }
+      buffer_ptr, width_ptr, height_ptr, size_ptr = @output_ptrs
+      Internal::check Internal::rawmedia_decode_video_output(@decoder, index,
+                                                             buffer_ptr,
+                                                             width_ptr,
+                                                             height_ptr,
+                                                             size_ptr)
+      height = height_ptr.get_int
+      return nil if height == 0
+      VideoFrame.new(buffer_ptr.get_pointer, width_ptr.get_int, height,
+                     size_ptr.get_int / height)
+    end
+
+    # Change the crop region for subsequent frames.
+    # @param [Array<Fixnum>] rect [x, y, width, height], or nil to decode
+    #  the whole frame
+    def crop=(rect)
+      x, y, width, height = rect || [0, 0, 0, 0]
+      Internal::check Internal::rawmedia_set_decoder_crop(@decoder, x, y, width, height)
+    end
+
     # Decodes audio into the provided buffer.
     # @param [FFI::Buffer] buffer a buffer of at least size Session#audio_framebuffer_size
     def decode_audio(buffer)
       Internal::check Internal::rawmedia_decode_audio(@decoder, buffer)
     end
 
+    # Decode the frames not read yet into a store that Decoder.frame_store
+    # reads back without decoding, for rendering the same source repeatedly.
+    # Video and audio must have been read to the same frame.
+    # @param [String] filename the store to write
+    def write_frame_store(filename)
+      Internal::check Internal::rawmedia_write_frame_store(@decoder, @session.session, filename)
+    end
+
+    # Decode #duration frames on a background thread, up to :lookahead
+    # frames ahead of the block. Native decoding releases the Ruby VM lock,
+    # so it runs in parallel with the block. The decoder must not be used
+    # by the caller until this returns.
+    # @param [Hash] opts
+    # @option opts [Fixnum] :lookahead Frames decoded ahead, default 2
+    # @yield [Frame] each frame in order, reused once the block returns
+    # @return [Enumerator] if no block given
+    def each_frame(opts={})
+      return enum_for(:each_frame, opts) unless block_given?
+      lookahead = [opts.fetch(:lookahead, 2), 1].max
+      audio_size = has_audio? ? @session.audio_framebuffer_size : 0
+      free = Queue.new
+      ready = Queue.new
+      (lookahead + 1).times { free << Frame.new(audio_size) }
+      stopped = false
+      producer = Thread.new do
+        begin
+          duration.times do |index|
+            frame = free.pop
+            break if stopped
+            ready << frame.decode(self, index)
+          end
+          ready << nil
+        rescue Exception => e
+          ready << e
+        end
+      end
+      begin
+        while frame = ready.pop
+          raise frame if frame.is_a?(Exception)
+          yield frame
+          free << frame
+        end
+      ensure
+        # Stop early if the block broke out
+        stopped = true
+        free << nil
+        producer.join
+      end
+      self
+    end
+
+    # Cumulative performance counters. Stage times (*_ns) are only
+    # collected while RawMedia.stats_enabled is set.
+    # @return [Hash] counters from RawMediaDecoderStats keyed by Symbol
+    def stats
+      stats = Internal::RawMediaDecoderStats.new
+      Internal::check Internal::rawmedia_get_decoder_stats(@decoder, stats)
+      Internal::struct_to_hash(stats)
+    end
+
     def duration
       @duration ||= @info[:duration]
     end
@@ -91,6 +304,49 @@ module RawMedia
       @has_audio ||= @info[:has_audio]
     end
 
+    # @return [Internal::RawMediaDecoderConfig]
+    def self.create_config(max_width, max_height, opts={})
+      volume = opts.fetch(:volume, 1.0)
+      # Use an exponential curve for volume
+      # See http://www.dr-lex.be/info-stuff/volumecontrols.html
+      if volume > 0 and volume < 1
+        volume = Math.exp(6.908 * volume) / 1000.0
+        volume *= volume * 10 if volume < 0.1
+      end
+      config = Internal::RawMediaDecoderConfig.new
+      config[:max_width] = max_width
+      config[:max_height] = max_height
+      config[:start_frame] = opts.fetch(:start_frame, 0)
+      config[:volume] = volume
+      config[:discard_video] = opts[:discard_video]
+      config[:discard_audio] = opts[:discard_audio]
+      config[:keyframe_seek] = opts[:keyframe_seek]
+      config[:letterbox] = opts[:letterbox]
+      config[:background_color] = opts.fetch(:background_color, 0)
+      config[:reverse_cache_frames] = opts.fetch(:reverse_cache, 0)
+      outputs = opts.fetch(:outputs, [])
+      raise(RawMediaError, "Too many outputs") if outputs.length > Internal::MAX_VIDEO_OUTPUTS
+      config[:output_count] = outputs.length
+      outputs.each_with_index do |(width, height), i|
+        config[:outputs][i][:max_width] = width
+        config[:outputs][i][:max_height] = height
+      end
+      if opts[:crop]
+        config[:crop_x], config[:crop_y], config[:crop_width], config[:crop_height] = opts[:crop]
+      end
+      config
+    end
+
+    # @private
+    # Hand the native decoder to a native owner. The block is passed the
+    # pointer and must raise if it does not take ownership.
+    def transfer
+      result = yield @decoder
+      @decoder.autorelease = false
+      @decoder = nil
+      result
+    end
+
     def destroy
       @decoder.autorelease = false
       Internal::check Internal::rawmedia_destroy_decoder(@decoder)
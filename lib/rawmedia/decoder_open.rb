@@ -0,0 +1,46 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # A Decoder being opened in the background, see Decoder.open_async
+  class DecoderOpen
+    # @private
+    def initialize(open, filename, session)
+      # Wrap in AutoPointer to cancel if never finished
+      @open = Internal::RawMediaDecoderOpen.new(open)
+      @filename = filename
+      @session = session
+    end
+
+    # @return [Boolean] true if the open has finished
+    def ready?
+      Internal::rawmedia_poll_decoder_open(@open) != 0
+    end
+
+    # Wait for the open to finish.
+    # @param [Float] timeout seconds to wait, nil to wait forever
+    # @return [Boolean] true if the open has finished
+    def wait(timeout=nil)
+      timeout_ms = timeout ? (timeout * 1000).round : -1
+      Internal::rawmedia_wait_decoder_open(@open, timeout_ms) != 0
+    end
+
+    # Abort the open, #decoder will return nil.
+    def cancel
+      @cancelled = true
+      Internal::rawmedia_cancel_decoder_open(@open)
+    end
+
+    # Wait for the open to finish and take the Decoder.
+    # May only be called once.
+    # @return [Decoder] nil if cancelled
+    def decoder
+      @open.autorelease = false
+      decoder = Internal::rawmedia_finish_decoder_open(@open)
+      @open = nil
+      return nil if decoder.null? and @cancelled
+      raise(RawMediaError, "Failed to create Decoder for #{@filename}") if decoder.null?
+      Decoder.wrap(decoder, @session)
+    end
+  end
+end
@@ -3,16 +3,53 @@
 
 module RawMedia
   class Encoder
-    def initialize(filename, session, width, height, has_video=true, has_audio=true)
+    # @private
+    attr_reader :encoder
+
+    # @param [String, #write] output output filename, or an IO-like object
+    #  to write encoded data to. If the object does not also respond to
+    #  #seek and #pos, a fragmented MOV is written.
+    # @param [Hash] opts encoding options.
+    # @option opts [Fixnum] :fragment_frames Write a fragmented MOV with a new
+    #  fragment every this many frames, so the output can be read while
+    #  it is still being written.
+    # @option opts [Fixnum] :segment_frames Start a new output file every
+    #  this many frames. output must then be a filename template
+    #  containing a single %d, replaced by the segment index.
+    # @option opts [Fixnum] :segment_bytes Start a new output file once
+    #  the current one reaches this many bytes.
+    # @yield [filename, index, start_frame, frame_count] called as each
+    #  segment file is closed, if segmenting.
+    def initialize(output, session, width, height, has_video=true, has_audio=true, opts={}, &segment_closed)
       config = Internal::RawMediaEncoderConfig.new
       config[:width] = width
       config[:height] = height
       config[:has_video] = has_video
       config[:has_audio] = has_audio
-      encoder = Internal::rawmedia_create_encoder(filename, session.session, config)
-      raise(RawMediaError, "Failed to create Encoder for #{filename}") if encoder.null?
+      config[:fragment_frames] = opts.fetch(:fragment_frames, 0)
+      @callbacks = []
+      if opts[:segment_frames] or opts[:segment_bytes]
+        segment = Encoder.create_segment_config(opts, segment_closed, @callbacks)
+        encoder = Internal::rawmedia_create_segmented_encoder(output, session.session, config, segment)
+      elsif output.respond_to?(:write)
+        encoder = Internal::rawmedia_create_encoder_io(Encoder.create_io(output, @callbacks),
+                                                       session.session, config)
+      else
+        encoder = Internal::rawmedia_create_encoder(output, session.session, config)
+      end
+      raise(RawMediaError, "Failed to create Encoder for #{output}") if encoder.null?
       # Wrap in AutoPointer to manage lifetime
-      @encoder = Internal::RawMediaEncoder.new(encoder)
+      @encoder = Internal::RawMediaEncoder.new(encoder, Encoder.releaser(@callbacks))
+    end
+
+    # Destroying the encoder calls the IO and segment callbacks to flush
+    # and close the output, so the releaser keeps them referenced until then.
+    # @private
+    def self.releaser(callbacks)
+      lambda do |ptr|
+        Internal::rawmedia_destroy_encoder(ptr)
+        callbacks.clear
+      end
     end
 
     def encode_video(buffer, buffersize)
@@ -23,10 +60,66 @@ module RawMedia
       Internal::check Internal::rawmedia_encode_audio(@encoder, buffer)
     end
 
+    # Cumulative performance counters, see Decoder#stats
+    # @return [Hash] counters from RawMediaEncoderStats keyed by Symbol
+    def stats
+      stats = Internal::RawMediaEncoderStats.new
+      Internal::check Internal::rawmedia_get_encoder_stats(@encoder, stats)
+      Internal::struct_to_hash(stats)
+    end
+
     def destroy
       @encoder.autorelease = false
       Internal::check Internal::rawmedia_destroy_encoder(@encoder)
       @encoder = nil
+      @callbacks.clear
+    end
+
+    # Callbacks are added to callbacks so they don't get GC'd while the
+    # encoder is alive. These are class methods so the callbacks don't
+    # reference the Encoder, which the releaser would then keep alive.
+    # @private
+    def self.create_io(output, callbacks)
+      io = Internal::RawMediaEncoderIO.new
+      write = Proc.new do |opaque, buffer, size|
+        begin
+          output.write(buffer.read_string(size))
+          size
+        rescue StandardError
+          -1
+        end
+      end
+      io[:write] = write
+      callbacks.push(io, write)
+      if output.respond_to?(:seek) and output.respond_to?(:pos)
+        seek = Proc.new do |opaque, offset, whence|
+          begin
+            output.seek(offset, whence)
+            output.pos
+          rescue StandardError
+            -1
+          end
+        end
+        io[:seek] = seek
+        callbacks << seek
+      end
+      io
+    end
+
+    # @private
+    def self.create_segment_config(opts, segment_closed, callbacks)
+      segment = Internal::RawMediaSegmentConfig.new
+      segment[:segment_frames] = opts.fetch(:segment_frames, 0)
+      segment[:segment_bytes] = opts.fetch(:segment_bytes, 0)
+      callbacks << segment
+      if segment_closed
+        closed = Proc.new do |opaque, filename, index, start_frame, frame_count|
+          segment_closed.call(filename, index, start_frame, frame_count)
+        end
+        segment[:closed] = closed
+        callbacks << closed
+      end
+      segment
     end
   end
 end
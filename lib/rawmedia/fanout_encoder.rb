@@ -0,0 +1,52 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Encodes the same frames to several outputs in parallel.
+  class FanoutEncoder
+    # @param [Array<Hash>] outputs output descriptions, each with
+    #  :filename, :width and :height keys and optional
+    #  :has_video, :has_audio and :fragment_frames keys.
+    #  Video is scaled from width x height to each output size.
+    # @param [Session] session
+    # @param [Fixnum] width width of video passed to #encode_video
+    # @param [Fixnum] height height of video passed to #encode_video
+    def initialize(outputs, session, width, height)
+      size = Internal::RawMediaFanoutOutput.size
+      outputs_ptr = FFI::MemoryPointer.new(size, outputs.length)
+      # Keep filenames referenced until the encoder is created
+      filenames = outputs.each_with_index.map do |output, i|
+        filename = FFI::MemoryPointer.from_string(output.fetch(:filename))
+        fanout_output = Internal::RawMediaFanoutOutput.new(outputs_ptr + i * size)
+        fanout_output[:filename] = filename
+        config = fanout_output[:config]
+        config[:width] = output.fetch(:width)
+        config[:height] = output.fetch(:height)
+        config[:has_video] = output.fetch(:has_video, true)
+        config[:has_audio] = output.fetch(:has_audio, true)
+        config[:fragment_frames] = output.fetch(:fragment_frames, 0)
+        filename
+      end
+      encoder = Internal::rawmedia_create_fanout_encoder(outputs_ptr, outputs.length,
+                                                         width, height,
+                                                         session.session)
+      raise(RawMediaError, "Failed to create FanoutEncoder") if encoder.null?
+      # Wrap in AutoPointer to manage lifetime
+      @encoder = Internal::RawMediaFanoutEncoder.new(encoder)
+    end
+
+    def encode_video(buffer, buffersize)
+      Internal::check Internal::rawmedia_fanout_encode_video(@encoder, buffer, buffersize)
+    end
+
+    def encode_audio(buffer)
+      Internal::check Internal::rawmedia_fanout_encode_audio(@encoder, buffer)
+    end
+
+    def destroy
+      @encoder.autorelease = false
+      Internal::check Internal::rawmedia_destroy_fanout_encoder(@encoder)
+      @encoder = nil
+    end
+  end
+end
@@ -0,0 +1,17 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Limit in bytes of the decoded frame cache shared by all decoders,
+  # 0 (the default) disables it.
+  def self.frame_cache_size=(bytes)
+    Internal::rawmedia_set_frame_cache_size(bytes)
+  end
+
+  # @return [Hash] counters from RawMediaFrameCacheStats keyed by Symbol
+  def self.frame_cache_stats
+    stats = Internal::RawMediaFrameCacheStats.new
+    Internal::rawmedia_get_frame_cache_stats(stats)
+    Internal::struct_to_hash(stats)
+  end
+end
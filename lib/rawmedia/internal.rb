@@ -6,20 +6,75 @@ module RawMedia
     extend FFI::Library
     ffi_lib File.expand_path("../../#{FFI::Platform::LIBPREFIX}rawmedia.#{FFI::Platform::LIBSUFFIX}", __FILE__)
 
+    # Functions that decode, encode or process whole frames are :blocking,
+    # so the Ruby VM lock is released while they run and other Ruby threads
+    # can run in parallel. Callbacks reacquire the lock.
     attach_function :rawmedia_init, [], :void
     callback :log_callback, [:string], :void
-    attach_function :rawmedia_set_log, [:int, :log_callback], :void
+    # These wait for the log drain thread, which may be calling back into Ruby
+    attach_function :rawmedia_set_log, [:int, :log_callback], :void, :blocking => true
+    attach_function :rawmedia_set_log_async, [:bool], :int, :blocking => true
+    attach_function :rawmedia_flush_log, [], :void, :blocking => true
+    attach_function :rawmedia_set_stats_enabled, [:bool], :void
     attach_function :rawmedia_init_session, [:pointer], :int
     attach_function :rawmedia_mix_audio, [:pointer, :pointer, :int, :pointer], :void
-    attach_function :rawmedia_create_decoder, [:string, :pointer, :pointer], :pointer
+    attach_function :rawmedia_mix_audio_weighted, [:pointer, :pointer, :pointer, :pointer, :int, :pointer], :void
+    attach_function :rawmedia_set_video_threads, [:int], :int
+    attach_function :rawmedia_blend_video, [:pointer, :pointer, :float, :pointer], :int, :blocking => true
+    attach_function :rawmedia_copy_video, [:pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_overlay_video, [:pointer, :pointer, :int, :int, :float], :int, :blocking => true
+    attach_function :rawmedia_convert_uyvy_to_bgra, [:pointer, :pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_convert_bgra_to_uyvy, [:pointer, :pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_create_mix_bus, [:pointer], :pointer
+    attach_function :rawmedia_mix_bus_begin, [:pointer], :void
+    attach_function :rawmedia_mix_bus_add, [:pointer, :pointer, :pointer, :float], :void
+    attach_function :rawmedia_mix_bus_add_bus, [:pointer, :pointer, :float], :void
+    attach_function :rawmedia_mix_bus_finish, [:pointer, :pointer], :void
+    attach_function :rawmedia_destroy_mix_bus, [:pointer], :void
+    attach_function :rawmedia_create_decoder, [:string, :pointer, :pointer], :pointer, :blocking => true
+    attach_function :rawmedia_create_decoder_async, [:string, :pointer, :pointer], :pointer
+    attach_function :rawmedia_poll_decoder_open, [:pointer], :int
+    attach_function :rawmedia_wait_decoder_open, [:pointer, :int], :int, :blocking => true
+    attach_function :rawmedia_cancel_decoder_open, [:pointer], :void
+    attach_function :rawmedia_finish_decoder_open, [:pointer], :pointer, :blocking => true
+    attach_function :rawmedia_create_playlist_decoder, [:pointer, :int, :pointer, :pointer], :pointer, :blocking => true
     attach_function :rawmedia_get_decoder_info, [:pointer], :pointer
-    attach_function :rawmedia_decode_video, [:pointer, :pointer, :pointer, :pointer, :pointer], :int
-    attach_function :rawmedia_decode_audio, [:pointer, :pointer], :int
-    attach_function :rawmedia_destroy_decoder, [:pointer], :int
-    attach_function :rawmedia_create_encoder, [:string, :pointer, :pointer], :pointer
-    attach_function :rawmedia_encode_video, [:pointer, :pointer, :int], :int
-    attach_function :rawmedia_encode_audio, [:pointer, :pointer], :int
-    attach_function :rawmedia_destroy_encoder, [:pointer], :int
+    attach_function :rawmedia_decode_video, [:pointer, :pointer, :pointer, :pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_decode_video_at, [:pointer, :int, :pointer, :pointer, :pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_decode_video_output, [:pointer, :int, :pointer, :pointer, :pointer, :pointer], :int
+    attach_function :rawmedia_set_decoder_crop, [:pointer, :int, :int, :int, :int], :int
+    attach_function :rawmedia_decode_audio, [:pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_get_decoder_stats, [:pointer, :pointer], :int
+    attach_function :rawmedia_destroy_decoder, [:pointer], :int, :blocking => true
+    attach_function :rawmedia_set_frame_cache_size, [:int64], :void
+    attach_function :rawmedia_get_frame_cache_stats, [:pointer], :void
+    attach_function :rawmedia_write_frame_store, [:pointer, :pointer, :string], :int, :blocking => true
+    attach_function :rawmedia_create_frame_store_decoder, [:string, :pointer], :pointer, :blocking => true
+    attach_function :rawmedia_compute_waveform, [:string, :int, :pointer, :pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_write_waveform_peaks, [:string, :string], :int, :blocking => true
+    attach_function :rawmedia_read_waveform_peaks, [:string, :double, :double, :int, :pointer, :pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_create_encoder, [:string, :pointer, :pointer], :pointer, :blocking => true
+    callback :encoder_io_write, [:pointer, :pointer, :int], :int
+    callback :encoder_io_seek, [:pointer, :int64, :int], :int64
+    attach_function :rawmedia_create_encoder_io, [:pointer, :pointer, :pointer], :pointer
+    callback :segment_closed, [:pointer, :string, :int, :int, :int], :void
+    attach_function :rawmedia_create_segmented_encoder, [:string, :pointer, :pointer, :pointer], :pointer
+    attach_function :rawmedia_encode_video, [:pointer, :pointer, :int], :int, :blocking => true
+    attach_function :rawmedia_encode_audio, [:pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_get_encoder_stats, [:pointer, :pointer], :int
+    attach_function :rawmedia_destroy_encoder, [:pointer], :int, :blocking => true
+    attach_function :rawmedia_create_fanout_encoder, [:pointer, :int, :int, :int, :pointer], :pointer
+    attach_function :rawmedia_fanout_encode_video, [:pointer, :pointer, :int], :int, :blocking => true
+    attach_function :rawmedia_fanout_encode_audio, [:pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_destroy_fanout_encoder, [:pointer], :int, :blocking => true
+    attach_function :rawmedia_create_timeline, [:pointer, :pointer], :pointer
+    attach_function :rawmedia_timeline_add_source, [:pointer, :pointer, :int, :int, :int], :int
+    attach_function :rawmedia_timeline_get_frame_count, [:pointer], :int
+    attach_function :rawmedia_timeline_render_frame, [:pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_timeline_get_source_video, [:pointer, :int, :pointer], :int
+    attach_function :rawmedia_timeline_encode, [:pointer, :pointer], :int, :blocking => true
+    attach_function :rawmedia_destroy_timeline, [:pointer], :int, :blocking => true
+    attach_function :rawmedia_transcode_parallel, [:string, :string, :pointer, :pointer, :pointer, :int], :int, :blocking => true
     
 
     class RawMediaSession < FFI::Struct
@@ -27,24 +82,95 @@ module RawMedia
              :framerate_den, :int,
              :audio_framebuffer_size, :int
     end
+    class RawMediaMixGain < FFI::Struct
+      layout :start, :float,
+             :end, :float
+    end
+    class RawMediaVideoFrame < FFI::Struct
+      layout :data, :pointer,
+             :linesize, :int,
+             :width, :int,
+             :height, :int
+    end
+    COLOR_BT601 = 0
+    COLOR_BT709 = 1
+    class RawMediaColorSpace < FFI::Struct
+      layout :matrix, :int,
+             :full_range, :bool,
+             :rgba, :bool
+    end
+    class RawMediaMixBus < FFI::AutoPointer
+      def self.release(ptr)
+        Internal::rawmedia_destroy_mix_bus(ptr)
+      end
+    end
+    class RawMediaDecoderOpen < FFI::AutoPointer
+      def self.release(ptr)
+        Internal::rawmedia_cancel_decoder_open(ptr)
+        decoder = Internal::rawmedia_finish_decoder_open(ptr)
+        Internal::rawmedia_destroy_decoder(decoder) unless decoder.null?
+      end
+    end
     class RawMediaDecoder < FFI::AutoPointer
       def self.release(ptr)
         Internal::rawmedia_destroy_decoder(ptr)
       end
     end
+    MAX_VIDEO_OUTPUTS = 4
+    class RawMediaVideoBounds < FFI::Struct
+      layout :max_width, :int,
+             :max_height, :int
+    end
     class RawMediaDecoderConfig < FFI::Struct
       layout :max_width, :int,
              :max_height, :int,
              :start_frame, :int,
              :volume, :float,
              :discard_video, :bool,
-             :discard_audio, :bool
+             :discard_audio, :bool,
+             :keyframe_seek, :bool,
+             :letterbox, :bool,
+             :background_color, :uint32,
+             :crop_x, :int,
+             :crop_y, :int,
+             :crop_width, :int,
+             :crop_height, :int,
+             :output_count, :int,
+             :outputs, [RawMediaVideoBounds, MAX_VIDEO_OUTPUTS],
+             :reverse_cache_frames, :int
+    end
+    class RawMediaPlaylistEntry < FFI::Struct
+      layout(:filename, :pointer,
+             :in_frame, :int,
+             :out_frame, :int)
     end
     class RawMediaDecoderInfo < FFI::Struct
       layout :duration, :int,
              :has_video, :bool,
              :has_audio, :bool
     end
+    class RawMediaDecoderStats < FFI::Struct
+      layout :read_ns, :int64,
+             :video_decode_ns, :int64,
+             :video_filter_ns, :int64,
+             :audio_decode_ns, :int64,
+             :audio_filter_ns, :int64,
+             :audio_copy_ns, :int64,
+             :frames_decoded, :int64,
+             :frames_dropped, :int64,
+             :packets_read, :int64,
+             :bytes_read, :int64,
+             :queue_peak_packets, :int64,
+             :queue_peak_bytes, :int64,
+             :queue_nodes_allocated, :int64
+    end
+    class RawMediaFrameCacheStats < FFI::Struct
+      layout :hits, :int64,
+             :misses, :int64,
+             :evictions, :int64,
+             :entries, :int64,
+             :bytes, :int64
+    end
     class RawMediaEncoder < FFI::AutoPointer
       def self.release(ptr)
         Internal::rawmedia_destroy_encoder(ptr)
@@ -54,7 +180,56 @@ module RawMedia
       layout :width, :int,
              :height, :int,
              :has_video, :bool,
-             :has_audio, :bool
+             :has_audio, :bool,
+             :fragment_frames, :int
+    end
+    class RawMediaEncoderStats < FFI::Struct
+      layout :video_encode_ns, :int64,
+             :audio_encode_ns, :int64,
+             :mux_ns, :int64,
+             :video_frames, :int64,
+             :audio_frames, :int64,
+             :packets_written, :int64,
+             :bytes_written, :int64
+    end
+
+    class RawMediaFanoutEncoder < FFI::AutoPointer
+      def self.release(ptr)
+        Internal::rawmedia_destroy_fanout_encoder(ptr)
+      end
+    end
+    class RawMediaFanoutOutput < FFI::Struct
+      layout :filename, :pointer,
+             :config, RawMediaEncoderConfig
+    end
+    class RawMediaTimeline < FFI::AutoPointer
+      def self.release(ptr)
+        Internal::rawmedia_destroy_timeline(ptr)
+      end
+    end
+    class RawMediaTimelineConfig < FFI::Struct
+      layout :width, :int,
+             :height, :int,
+             :lookahead, :int,
+             :nthreads, :int
+    end
+    class RawMediaTimelineFrame < FFI::Struct
+      layout :frame, :int,
+             :video, RawMediaVideoFrame,
+             :audio, :pointer
+    end
+
+    class RawMediaEncoderIO < FFI::Struct
+      layout :opaque, :pointer,
+             :write, :encoder_io_write,
+             :seek, :encoder_io_seek
+    end
+
+    class RawMediaSegmentConfig < FFI::Struct
+      layout :segment_frames, :int,
+             :segment_bytes, :int64,
+             :closed, :segment_closed,
+             :opaque, :pointer
     end
 
     def self.check(result)
@@ -62,6 +237,11 @@ module RawMedia
       result
     end
 
+    # @return [Hash] struct members as a Hash with Symbol keys
+    def self.struct_to_hash(struct)
+      Hash[struct.members.map {|m| [m, struct[m]] }]
+    end
+
     rawmedia_init()
   end
 end
@@ -15,9 +15,23 @@ module RawMedia
     # @param [Fixnum] level the log level
     # @param [Proc] callback the callback to call with log message
     def self.set_callback(level, callback)
-      # Save callback so it doesn't get GC'd
-      @callback = callback
       Internal::rawmedia_set_log(level, callback)
+      # Save callback so it doesn't get GC'd, only dropping the old one
+      # once the library has stopped calling it
+      @callback = callback
+    end
+
+    # Deliver log lines to the callback on a separate thread,
+    # so logging never blocks decoding. Lines may be dropped if
+    # they are logged faster than the callback handles them.
+    # @param [Boolean] async
+    def self.async=(async)
+      Internal::check Internal::rawmedia_set_log_async(async)
+    end
+
+    # Deliver queued async log lines to the callback now
+    def self.flush
+      Internal::rawmedia_flush_log
     end
   end
 end
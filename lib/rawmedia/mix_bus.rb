@@ -0,0 +1,53 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Mixes audio buffers one at a time into an internal accumulator,
+  # so each buffer can be released as soon as it has been added.
+  class MixBus
+    attr_reader :bus
+
+    # @param [Session] session
+    def initialize(session)
+      bus = Internal::rawmedia_create_mix_bus(session.session)
+      raise(RawMediaError, "Failed to create MixBus") if bus.null?
+      # Wrap in AutoPointer to manage lifetime
+      @bus = Internal::RawMediaMixBus.new(bus)
+      @gain = Internal::RawMediaMixGain.new
+    end
+
+    # Start mixing a new audio frame
+    def begin
+      Internal::rawmedia_mix_bus_begin(@bus)
+      self
+    end
+
+    # @param [#to_ptr] buffer audio buffer to add
+    # @param [Numeric, Range] gain linear gain,
+    #  a Range ramps gain from begin to end across the buffer
+    # @param [Numeric] pan -1.0 (left) to 1.0 (right)
+    def add(buffer, gain=1.0, pan=0.0)
+      if gain.is_a?(Range)
+        @gain[:start] = gain.begin
+        @gain[:end] = gain.end
+      else
+        @gain[:start] = @gain[:end] = gain
+      end
+      Internal::rawmedia_mix_bus_add(@bus, buffer, @gain, pan)
+      self
+    end
+
+    # Add the current contents of another bus
+    # @param [MixBus] submix
+    # @param [Numeric] gain linear gain
+    def add_bus(submix, gain=1.0)
+      Internal::rawmedia_mix_bus_add_bus(@bus, submix.bus, gain)
+      self
+    end
+
+    # @param [#to_ptr] output_buffer where to write mixed audio
+    def finish(output_buffer)
+      Internal::rawmedia_mix_bus_finish(@bus, output_buffer)
+    end
+  end
+end
@@ -22,6 +22,13 @@ module RawMedia
       # @return [String] the media file duration in seconds
       attr_accessor :duration
 
+      # @return [Symbol] the video codec, :rawvideo, :h264 or :prores
+      attr_accessor :video_codec
+
+      # @return [Float] if set, seconds of audio per packet. Large values
+      #   produce badly interleaved files, with audio far ahead of video.
+      attr_accessor :audio_chunk
+
       # The environment variable FFMPEG can be used to locate the ffmpeg executable.
       # @param [String] filename the name of the output file and rake task
       # @yield a block to allow any options to be modified on the task
@@ -32,6 +39,7 @@ module RawMedia
         @framerate = '30'
         @size = '320x240'
         @duration = '5'
+        @video_codec = :rawvideo
         yield self if block_given?
         @ffmpeg = ENV.fetch('FFMPEG', 'ffmpeg')
         define
@@ -40,10 +48,26 @@ module RawMedia
       def define
         desc "Generate a raw media MOV file fixture"
         file filename do
-          sh %{"#@ffmpeg" -f lavfi -i "aevalsrc=sin(440*2*PI*t)::s=8000,aconvert=s16:stereo" -f lavfi -i "testsrc=rate=#{framerate}:size=#{size}:decimals=3" -codec:a pcm_s16le -codec:v rawvideo -pix_fmt uyvy422 -tag:v yuvs -f mov -t #{duration} -y "#{filename}"}
+          audio = "aevalsrc=sin(440*2*PI*t)::s=8000"
+          audio << ":n=#{(audio_chunk * 8000).round}" if audio_chunk
+          sh %{"#@ffmpeg" -f lavfi -i "#{audio},aconvert=s16:stereo" -f lavfi -i "testsrc=rate=#{framerate}:size=#{size}:decimals=3" -codec:a pcm_s16le #{video_codec_options} -f mov -t #{duration} -y "#{filename}"}
         end
       end
       protected :define
+
+      def video_codec_options
+        case video_codec
+        when :rawvideo
+          '-codec:v rawvideo -pix_fmt uyvy422 -tag:v yuvs'
+        when :h264
+          '-codec:v libx264 -pix_fmt yuv420p'
+        when :prores
+          '-codec:v prores -pix_fmt yuv422p10le'
+        else
+          raise ArgumentError, "Unsupported video codec #{video_codec}"
+        end
+      end
+      protected :video_codec_options
     end
   end
 end
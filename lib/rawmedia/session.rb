@@ -27,5 +27,10 @@ module RawMedia
     def create_audio_mixer
       AudioMixer.new(self)
     end
+
+    # @return [MixBus]
+    def create_mix_bus
+      MixBus.new(self)
+    end
   end
 end
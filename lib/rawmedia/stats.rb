@@ -0,0 +1,10 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Enable timing of decoder and encoder stages for Decoder#stats
+  # and Encoder#stats. Disabled by default.
+  def self.stats_enabled=(enabled)
+    Internal::rawmedia_set_stats_enabled(enabled)
+  end
+end
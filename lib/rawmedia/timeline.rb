@@ -0,0 +1,105 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Renders several Decoders to a single stream. All sources active over
+  # the next lookahead frames are decoded in parallel on native threads,
+  # then video is composited in layer order and audio is mixed.
+  class Timeline
+    include Enumerable
+
+    # @param [Session] session
+    # @param [Hash] opts
+    # @option opts [Fixnum] :width Composited video width,
+    #  omit to only mix audio (see #source_video)
+    # @option opts [Fixnum] :height Composited video height
+    # @option opts [Fixnum] :lookahead Frames decoded ahead, default 4
+    # @option opts [Fixnum] :threads Decoding threads, default one per CPU
+    def initialize(session, opts={})
+      config = Internal::RawMediaTimelineConfig.new
+      config[:width] = opts.fetch(:width, 0)
+      config[:height] = opts.fetch(:height, 0)
+      config[:lookahead] = opts.fetch(:lookahead, 0)
+      config[:nthreads] = opts.fetch(:threads, 0)
+      timeline = Internal::rawmedia_create_timeline(session.session, config)
+      raise(RawMediaError, "Failed to create Timeline") if timeline.null?
+      # Wrap in AutoPointer to manage lifetime
+      @timeline = Internal::RawMediaTimeline.new(timeline)
+      @frame = Internal::RawMediaTimelineFrame.new
+      @source_frame = Internal::RawMediaVideoFrame.new
+    end
+
+    # Add a source. The timeline takes over decoder, which must not be
+    # used afterwards. All sources must be added before rendering.
+    # @param [Decoder] decoder
+    # @param [Fixnum] start_frame timeline frame the source starts on
+    # @param [Fixnum] end_frame timeline frame after the last, nil to play
+    #  the whole decoder
+    # @param [Fixnum] layer higher layers are composited on top
+    # @return [Fixnum] source index
+    def add(decoder, start_frame=0, end_frame=nil, layer=0)
+      decoder.transfer do |ptr|
+        Internal::check Internal::rawmedia_timeline_add_source(@timeline, ptr,
+                                                               start_frame,
+                                                               end_frame || 0,
+                                                               layer)
+      end
+    end
+
+    # @return [Fixnum] frames up to the end of the last source
+    def frame_count
+      Internal::rawmedia_timeline_get_frame_count(@timeline)
+    end
+
+    # Render the next frame. #video_frame, #audio_buffer and #source_video
+    # are valid until the next call.
+    # @return [Fixnum] frame number, nil after the last frame
+    def render
+      return nil if Internal::check(Internal::rawmedia_timeline_render_frame(@timeline, @frame)) == 0
+      @frame[:frame]
+    end
+
+    # Render each remaining frame
+    # @yield [frame] frame number
+    def each
+      while frame = render
+        yield frame
+      end
+    end
+
+    # @return [VideoFrame] composited video, nil if not compositing
+    def video_frame
+      video = @frame[:video]
+      return nil if video[:data].null?
+      VideoFrame.new(video[:data], video[:width], video[:height], video[:linesize])
+    end
+
+    # @return [FFI::Pointer] mixed audio of Session#audio_framebuffer_size bytes
+    def audio_buffer
+      @frame[:audio]
+    end
+
+    # Video of one source for the last rendered frame
+    # @param [Fixnum] index source index returned by #add
+    # @return [VideoFrame] nil if the source has no video for the frame
+    def source_video(index)
+      return nil if Internal::check(Internal::rawmedia_timeline_get_source_video(@timeline, index, @source_frame)) == 0
+      VideoFrame.new(@source_frame[:data], @source_frame[:width],
+                     @source_frame[:height], @source_frame[:linesize])
+    end
+
+    # Render the remaining frames into encoder, which must have the
+    # timeline :width and :height, or no video.
+    # @param [Encoder] encoder
+    # @return [Fixnum] frames encoded
+    def encode(encoder)
+      Internal::check Internal::rawmedia_timeline_encode(@timeline, encoder.encoder)
+    end
+
+    def destroy
+      @timeline.autorelease = false
+      Internal::check Internal::rawmedia_destroy_timeline(@timeline)
+      @timeline = nil
+    end
+  end
+end
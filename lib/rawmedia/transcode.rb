@@ -0,0 +1,22 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Transcodes input to output, splitting the input into chunks
+  # transcoded in parallel.
+  # @param [String] input input filename
+  # @param [String] output output filename
+  # @param [Session] session
+  # @param [Fixnum] max_width maximum width of output video
+  # @param [Fixnum] max_height maximum height of output video
+  # @param [Fixnum] threads number of threads to use
+  # @param [Hash] opts decoding options, see Decoder#initialize
+  def self.transcode_parallel(input, output, session, max_width, max_height, threads, opts={})
+    dconfig = Decoder.create_config(max_width, max_height, opts)
+    econfig = Internal::RawMediaEncoderConfig.new
+    Internal::check Internal::rawmedia_transcode_parallel(input, output,
+                                                          session.session,
+                                                          dconfig, econfig,
+                                                          threads)
+  end
+end
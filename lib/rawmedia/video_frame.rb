@@ -0,0 +1,102 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # A UYVY422 video frame for blending and overlaying.
+  class VideoFrame
+    attr_reader :frame
+    attr_reader :buffer
+
+    # @param [#to_ptr] buffer frame data
+    # @param [Fixnum] width
+    # @param [Fixnum] height
+    # @param [Fixnum] linesize bytes per row, 0 for width * 2
+    def initialize(buffer, width, height, linesize=0)
+      @buffer = buffer
+      @frame = Internal::RawMediaVideoFrame.new
+      @frame[:data] = buffer
+      @frame[:linesize] = linesize
+      @frame[:width] = width
+      @frame[:height] = height
+    end
+
+    # Allocate a new frame
+    # @param [Fixnum] bytes_per_pixel 2 for UYVY422, 4 for BGRA/RGBA
+    def self.create(width, height, bytes_per_pixel=2)
+      VideoFrame.new(FFI::MemoryPointer.new(width * bytes_per_pixel, height), width, height)
+    end
+
+    def width
+      @frame[:width]
+    end
+
+    def height
+      @frame[:height]
+    end
+
+    # Crossfade into self, self = a * (1 - alpha) + b * alpha
+    # @param [VideoFrame] a
+    # @param [VideoFrame] b
+    # @param [Float] alpha 0..1
+    def blend(a, b, alpha)
+      Internal::check Internal::rawmedia_blend_video(a.frame, b.frame, alpha, @frame)
+      self
+    end
+
+    # Copy src into self
+    # @param [VideoFrame] src frame of the same size
+    def copy(src)
+      Internal::check Internal::rawmedia_copy_video(src.frame, @frame)
+      self
+    end
+
+    # Composite src over self at x, y with constant opacity
+    # @param [VideoFrame] src
+    # @param [Fixnum] x rounded down to even
+    # @param [Fixnum] y
+    # @param [Float] opacity 0..1
+    def overlay(src, x=0, y=0, opacity=1.0)
+      Internal::check Internal::rawmedia_overlay_video(@frame, src.frame, x, y, opacity)
+      self
+    end
+
+    # Convert this UYVY422 frame to 32 bit RGB.
+    # @param [VideoFrame] dst BGRA/RGBA frame of the same size,
+    #  allocated if nil
+    # @param [Hash] opts see #convert_from_rgb
+    # @return [VideoFrame] dst
+    def convert_to_rgb(dst=nil, opts={})
+      dst ||= VideoFrame.create(width, height, 4)
+      Internal::check Internal::rawmedia_convert_uyvy_to_bgra(@frame, dst.frame,
+                                                             color_space(opts))
+      dst
+    end
+
+    # Convert a 32 bit RGB frame into this UYVY422 frame.
+    # @param [VideoFrame] src BGRA/RGBA frame of the same size
+    # @param [Hash] opts
+    # @option opts [Boolean] :bt709 BT.709 instead of BT.601 colorspace
+    # @option opts [Boolean] :full_range YUV is 0..255 instead of 16..235
+    # @option opts [Boolean] :rgba RGBA byte order instead of BGRA
+    def convert_from_rgb(src, opts={})
+      Internal::check Internal::rawmedia_convert_bgra_to_uyvy(src.frame, @frame,
+                                                             color_space(opts))
+      self
+    end
+
+    def color_space(opts)
+      color = Internal::RawMediaColorSpace.new
+      color[:matrix] = opts[:bt709] ? Internal::COLOR_BT709 : Internal::COLOR_BT601
+      color[:full_range] = !!opts[:full_range]
+      color[:rgba] = !!opts[:rgba]
+      color
+    end
+    private :color_space
+  end
+
+  # Set the number of threads video processing may split rows across,
+  # 0 to process on the calling thread.
+  def self.video_threads=(threads)
+    Internal::check Internal::rawmedia_set_video_threads(threads)
+  end
+end
@@ -0,0 +1,49 @@
+# Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+module RawMedia
+  # Waveform overview of the audio of filename, all channels combined.
+  # Only audio is decoded, so this is much faster than decoding
+  # through a Decoder.
+  # @param [String] filename
+  # @param [Fixnum] bins number of values of each array
+  # @return [Hash] :min, :max (-1..1) and :rms Arrays of Float per bin
+  def self.compute_waveform(filename, bins)
+    Waveform.compute(bins) do |min, max, rms|
+      Internal::check Internal::rawmedia_compute_waveform(filename, bins, min, max, rms)
+    end
+  end
+
+  # Decode the audio of filename into a peak file holding the waveform
+  # at several resolutions, for RawMedia.read_waveform_peaks.
+  # @param [String] filename
+  # @param [String] peaks_filename peak file to write
+  def self.write_waveform_peaks(filename, peaks_filename)
+    Internal::check Internal::rawmedia_write_waveform_peaks(filename, peaks_filename)
+  end
+
+  # Waveform of a range of a peak file, as RawMedia.compute_waveform.
+  # @param [String] peaks_filename written by RawMedia.write_waveform_peaks
+  # @param [Fixnum] bins
+  # @param [Hash] opts
+  # @option opts [Float] :start seconds, default 0
+  # @option opts [Float] :end seconds, default the end of the file
+  # @return (see RawMedia.compute_waveform)
+  def self.read_waveform_peaks(peaks_filename, bins, opts={})
+    Waveform.compute(bins) do |min, max, rms|
+      Internal::check Internal::rawmedia_read_waveform_peaks(peaks_filename,
+                                                             opts.fetch(:start, 0),
+                                                             opts.fetch(:end, 0),
+                                                             bins, min, max, rms)
+    end
+  end
+
+  # @private
+  module Waveform
+    def self.compute(bins)
+      arrays = [:min, :max, :rms].map {|key| [key, FFI::MemoryPointer.new(:float, bins)] }
+      yield(*arrays.map(&:last))
+      Hash[arrays.map {|key, ptr| [key, ptr.read_array_of_float(bins)] }]
+    end
+  end
+end
@@ -0,0 +1,253 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include "audio_mix.h"
+#include "cpu.h"
+#include <math.h>
+#ifdef RAWMEDIA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+typedef void (*MixS16Func)(const int16_t* const* buffers, int buffer_count, int nb_samples, int16_t* output);
+typedef void (*AccumulateFunc)(float* acc, const MixInput* input, int start, int nb_samples);
+typedef void (*StoreS16Func)(const float* acc, int nb_samples, int16_t* output);
+typedef void (*AccumulateF32Func)(float* acc, const float* input, float gain, int nb_samples);
+
+// Samples are accumulated in 32 bits, which is exact for any
+// practical number of buffers, then saturated back to 16 bits.
+static void mix_s16_c(const int16_t* const* buffers, int buffer_count, int start, int nb_samples, int16_t* output) {
+    for (int s = start; s < nb_samples; s++) {
+        int32_t sample = 0;
+        for (int b = 0; b < buffer_count; b++)
+            sample += buffers[b][s];
+        output[s] = sample > INT16_MAX ? INT16_MAX
+            : sample < INT16_MIN ? INT16_MIN : sample;
+    }
+}
+
+static void mix_s16_scalar(const int16_t* const* buffers, int buffer_count, int nb_samples, int16_t* output) {
+    mix_s16_c(buffers, buffer_count, 0, nb_samples, output);
+}
+
+// Gain ramps are evaluated per stereo frame rather than accumulated,
+// so they don't drift over long buffers.
+static void accumulate_c(float* acc, const MixInput* input, int start, int end) {
+    for (int s = start; s < end; s += 2) {
+        float gain = input->gain + input->gain_step * (s / 2);
+        acc[s - start] += input->samples[s] * gain * input->left;
+        acc[s - start + 1] += input->samples[s + 1] * gain * input->right;
+    }
+}
+
+static void accumulate_scalar(float* acc, const MixInput* input, int start, int nb_samples) {
+    accumulate_c(acc, input, start, start + nb_samples);
+}
+
+// Clamp before converting, so out of range values can't overflow the conversion
+static inline int16_t store_sample(float value) {
+    value = value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+    return lrintf(value);
+}
+
+static void store_s16_scalar(const float* acc, int nb_samples, int16_t* output) {
+    for (int s = 0; s < nb_samples; s++)
+        output[s] = store_sample(acc[s]);
+}
+
+static void accumulate_f32_c(float* acc, const float* input, float gain, int start, int end) {
+    for (int s = start; s < end; s++)
+        acc[s] += input[s] * gain;
+}
+
+static void accumulate_f32_scalar(float* acc, const float* input, float gain, int nb_samples) {
+    accumulate_f32_c(acc, input, gain, 0, nb_samples);
+}
+
+#ifdef RAWMEDIA_X86_SIMD
+RAWMEDIA_TARGET("sse2")
+static void accumulate_sse2(float* acc, const MixInput* input, int start, int nb_samples) {
+    int end = start + nb_samples;
+    int s = start;
+    // Two stereo frames per vector
+    const __m128 pan = _mm_setr_ps(input->left, input->right, input->left, input->right);
+    const __m128 step = _mm_set1_ps(input->gain_step);
+    const __m128 base = _mm_set1_ps(input->gain);
+    for (; s + 8 <= end; s += 8) {
+        float frame = s / 2;
+        __m128i v = _mm_loadu_si128((const __m128i*)&input->samples[s]);
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        __m128 frames_lo = _mm_setr_ps(frame, frame, frame + 1, frame + 1);
+        __m128 frames_hi = _mm_add_ps(frames_lo, _mm_set1_ps(2));
+        __m128 gain_lo = _mm_mul_ps(_mm_add_ps(base, _mm_mul_ps(step, frames_lo)), pan);
+        __m128 gain_hi = _mm_mul_ps(_mm_add_ps(base, _mm_mul_ps(step, frames_hi)), pan);
+        float* a = &acc[s - start];
+        _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), _mm_mul_ps(lo, gain_lo)));
+        _mm_storeu_ps(a + 4, _mm_add_ps(_mm_loadu_ps(a + 4), _mm_mul_ps(hi, gain_hi)));
+    }
+    accumulate_c(acc + (s - start), input, s, end);
+}
+
+RAWMEDIA_TARGET("sse2")
+static void store_s16_sse2(const float* acc, int nb_samples, int16_t* output) {
+    const __m128 min = _mm_set1_ps(INT16_MIN);
+    const __m128 max = _mm_set1_ps(INT16_MAX);
+    int s = 0;
+    for (; s + 8 <= nb_samples; s += 8) {
+        // cvtps rounds to nearest even like lrintf
+        __m128i lo = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(&acc[s]), min), max));
+        __m128i hi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(&acc[s + 4]), min), max));
+        _mm_storeu_si128((__m128i*)&output[s], _mm_packs_epi32(lo, hi));
+    }
+    for (; s < nb_samples; s++)
+        output[s] = store_sample(acc[s]);
+}
+
+RAWMEDIA_TARGET("sse2")
+static void accumulate_f32_sse2(float* acc, const float* input, float gain, int nb_samples) {
+    const __m128 g = _mm_set1_ps(gain);
+    int s = 0;
+    for (; s + 4 <= nb_samples; s += 4)
+        _mm_storeu_ps(&acc[s], _mm_add_ps(_mm_loadu_ps(&acc[s]), _mm_mul_ps(_mm_loadu_ps(&input[s]), g)));
+    accumulate_f32_c(acc, input, gain, s, nb_samples);
+}
+
+RAWMEDIA_TARGET("avx2,fma")
+static void accumulate_avx2(float* acc, const MixInput* input, int start, int nb_samples) {
+    int end = start + nb_samples;
+    int s = start;
+    // Four stereo frames per vector
+    const __m256 pan = _mm256_setr_ps(input->left, input->right, input->left, input->right,
+                                      input->left, input->right, input->left, input->right);
+    const __m256 step = _mm256_set1_ps(input->gain_step);
+    const __m256 base = _mm256_set1_ps(input->gain);
+    const __m256 offsets = _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+    for (; s + 16 <= end; s += 16) {
+        __m256 frames_lo = _mm256_add_ps(_mm256_set1_ps(s / 2), offsets);
+        __m256 frames_hi = _mm256_add_ps(frames_lo, _mm256_set1_ps(4));
+        const __m128i* in = (const __m128i*)&input->samples[s];
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(in)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(in + 1)));
+        __m256 gain_lo = _mm256_mul_ps(_mm256_fmadd_ps(step, frames_lo, base), pan);
+        __m256 gain_hi = _mm256_mul_ps(_mm256_fmadd_ps(step, frames_hi, base), pan);
+        float* a = &acc[s - start];
+        _mm256_storeu_ps(a, _mm256_fmadd_ps(lo, gain_lo, _mm256_loadu_ps(a)));
+        _mm256_storeu_ps(a + 8, _mm256_fmadd_ps(hi, gain_hi, _mm256_loadu_ps(a + 8)));
+    }
+    accumulate_c(acc + (s - start), input, s, end);
+}
+
+RAWMEDIA_TARGET("avx2,fma")
+static void accumulate_f32_avx2(float* acc, const float* input, float gain, int nb_samples) {
+    const __m256 g = _mm256_set1_ps(gain);
+    int s = 0;
+    for (; s + 8 <= nb_samples; s += 8)
+        _mm256_storeu_ps(&acc[s], _mm256_fmadd_ps(_mm256_loadu_ps(&input[s]), g, _mm256_loadu_ps(&acc[s])));
+    accumulate_f32_c(acc, input, gain, s, nb_samples);
+}
+
+RAWMEDIA_TARGET("avx2")
+static void store_s16_avx2(const float* acc, int nb_samples, int16_t* output) {
+    const __m256 min = _mm256_set1_ps(INT16_MIN);
+    const __m256 max = _mm256_set1_ps(INT16_MAX);
+    int s = 0;
+    for (; s + 16 <= nb_samples; s += 16) {
+        __m256i lo = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&acc[s]), min), max));
+        __m256i hi = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(&acc[s + 8]), min), max));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)&output[s], packed);
+    }
+    for (; s < nb_samples; s++)
+        output[s] = store_sample(acc[s]);
+}
+
+RAWMEDIA_TARGET("sse2")
+static void mix_s16_sse2(const int16_t* const* buffers, int buffer_count, int nb_samples, int16_t* output) {
+    int s = 0;
+    for (; s + 8 <= nb_samples; s += 8) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        for (int b = 0; b < buffer_count; b++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&buffers[b][s]);
+            // Sign extend to 32 bits
+            lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+            hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        }
+        _mm_storeu_si128((__m128i*)&output[s], _mm_packs_epi32(lo, hi));
+    }
+    mix_s16_c(buffers, buffer_count, s, nb_samples, output);
+}
+
+RAWMEDIA_TARGET("avx2")
+static void mix_s16_avx2(const int16_t* const* buffers, int buffer_count, int nb_samples, int16_t* output) {
+    int s = 0;
+    for (; s + 16 <= nb_samples; s += 16) {
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (int b = 0; b < buffer_count; b++) {
+            const __m128i* in = (const __m128i*)&buffers[b][s];
+            lo = _mm256_add_epi32(lo, _mm256_cvtepi16_epi32(_mm_loadu_si128(in)));
+            hi = _mm256_add_epi32(hi, _mm256_cvtepi16_epi32(_mm_loadu_si128(in + 1)));
+        }
+        // packs works within 128 bit lanes, restore sample order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)&output[s], packed);
+    }
+    mix_s16_c(buffers, buffer_count, s, nb_samples, output);
+}
+#endif
+
+static MixS16Func s_mix_s16 = mix_s16_scalar;
+static AccumulateFunc s_accumulate = accumulate_scalar;
+static StoreS16Func s_store_s16 = store_s16_scalar;
+static AccumulateF32Func s_accumulate_f32 = accumulate_f32_scalar;
+
+void audio_mix_init(void) {
+#ifdef RAWMEDIA_X86_SIMD
+    int flags = cpu_flags();
+    if (flags & CPU_FLAG_AVX2) {
+        s_mix_s16 = mix_s16_avx2;
+        s_store_s16 = store_s16_avx2;
+    }
+    else if (flags & CPU_FLAG_SSE2) {
+        s_mix_s16 = mix_s16_sse2;
+        s_store_s16 = store_s16_sse2;
+    }
+    if ((flags & CPU_FLAG_AVX2) && (flags & CPU_FLAG_FMA)) {
+        s_accumulate = accumulate_avx2;
+        s_accumulate_f32 = accumulate_f32_avx2;
+    }
+    else if (flags & CPU_FLAG_SSE2) {
+        s_accumulate = accumulate_sse2;
+        s_accumulate_f32 = accumulate_f32_sse2;
+    }
+#endif
+}
+
+bool audio_mix_input_init(MixInput* input, const int16_t* samples, const RawMediaMixGain* gain, float pan, int nb_frames) {
+    input->samples = samples;
+    input->gain = gain ? gain->start : 1;
+    input->gain_step = gain ? (gain->end - gain->start) / nb_frames : 0;
+    // Balance, attenuating the opposite channel
+    pan = pan > 1 ? 1 : pan < -1 ? -1 : pan;
+    input->left = pan > 0 ? 1 - pan : 1;
+    input->right = pan < 0 ? 1 + pan : 1;
+    return !(input->gain == 0 && input->gain_step == 0)
+        && !(input->left == 0 && input->right == 0);
+}
+
+void audio_mix_s16(const int16_t* const* buffers, int buffer_count, int nb_samples, int16_t* output) {
+    s_mix_s16(buffers, buffer_count, nb_samples, output);
+}
+
+void audio_mix_accumulate(float* acc, const MixInput* input, int start, int nb_samples) {
+    s_accumulate(acc, input, start, nb_samples);
+}
+
+void audio_mix_store_s16(const float* acc, int nb_samples, int16_t* output) {
+    s_store_s16(acc, nb_samples, output);
+}
+
+void audio_mix_accumulate_f32(float* acc, const float* input, float gain, int nb_samples) {
+    s_accumulate_f32(acc, input, gain, nb_samples);
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_AUDIO_MIX_H
+#define RM_AUDIO_MIX_H
+
+#include "exports.h"
+#include "rawmedia.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// A weighted input to audio_mix_accumulate.
+// samples are interleaved stereo.
+typedef struct MixInput {
+    const int16_t* samples;
+    float gain;         // Gain at the first stereo frame
+    float gain_step;    // Gain increment per stereo frame
+    float left;         // Pan factor for the left channel
+    float right;        // Pan factor for the right channel
+} MixInput;
+
+// Initialize input for nb_frames stereo frames of samples with gain
+// (NULL for unity) and pan (-1..1). Returns false if input is silent.
+RAWMEDIA_LOCAL bool audio_mix_input_init(MixInput* input, const int16_t* samples, const RawMediaMixGain* gain, float pan, int nb_frames);
+
+// Select the best kernels for the running CPU
+RAWMEDIA_LOCAL void audio_mix_init(void);
+
+// Sum nb_samples from each of buffer_count buffers (none NULL) into output,
+// saturating to the int16_t range.
+RAWMEDIA_LOCAL void audio_mix_s16(const int16_t* const* buffers, int buffer_count, int nb_samples, int16_t* output);
+
+// Add nb_samples of input, starting at sample start, into acc[0..nb_samples).
+// start and nb_samples must be even.
+RAWMEDIA_LOCAL void audio_mix_accumulate(float* acc, const MixInput* input, int start, int nb_samples);
+
+// Add nb_samples of input scaled by gain into acc.
+RAWMEDIA_LOCAL void audio_mix_accumulate_f32(float* acc, const float* input, float gain, int nb_samples);
+
+// Round and saturate nb_samples from acc into output.
+RAWMEDIA_LOCAL void audio_mix_store_s16(const float* acc, int nb_samples, int16_t* output);
+
+#endif
@@ -0,0 +1,18 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include "cpu.h"
+
+int cpu_flags(void) {
+    int flags = 0;
+#ifdef RAWMEDIA_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        flags |= CPU_FLAG_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+        flags |= CPU_FLAG_AVX2;
+    if (__builtin_cpu_supports("fma"))
+        flags |= CPU_FLAG_FMA;
+#endif
+    return flags;
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_CPU_H
+#define RM_CPU_H
+
+#include "exports.h"
+
+// x86 SIMD kernels are compiled with per-function target attributes
+// and selected at runtime, so the library runs on any x86 CPU.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAWMEDIA_X86_SIMD 1
+#define RAWMEDIA_TARGET(t) __attribute__((target(t)))
+#endif
+
+enum CpuFlags {
+    CPU_FLAG_SSE2 = 1 << 0,
+    CPU_FLAG_AVX2 = 1 << 1,
+    CPU_FLAG_FMA = 1 << 2,
+};
+
+// Returns CpuFlags supported by the running CPU
+RAWMEDIA_LOCAL int cpu_flags(void);
+
+#endif
@@ -11,6 +11,19 @@
 #include "rawmedia.h"
 #include "rawmedia_internal.h"
 #include "packet_queue.h"
+#include "frame_cache.h"
+#include "stats.h"
+#include "log.h"
+
+// Copy of a decoded primary output frame, for stepping backwards
+typedef struct VideoCacheEntry {
+    int frame;                  // Absolute frame, -1 if empty
+    uint8_t* data;
+    int capacity;
+    int width;
+    int height;
+    int size;
+} VideoCacheEntry;
 
 enum StreamStatus {
     SS_EOF_PENDING = -1,
@@ -19,8 +32,16 @@ enum StreamStatus {
 };
 
 struct RawMediaDecoder {
+    // If set, the decoder API is implemented by backend
+    const DecoderBackend* backend;
+    void* backend_opaque;
+
     AVFormatContext* format_ctx;
     AVRational time_base;
+    RawMediaDecoderConfig config;
+    // Aborts I/O while set and non-zero, only during creation
+    const volatile int* cancel;
+    LogContext log_context;
 
     struct RawMediaVideo {
         int stream_index;
@@ -28,12 +49,37 @@ struct RawMediaDecoder {
         AVFrame* avframe;
         AVPacket pkt;
         uint32_t current_frame;     // Frame number we are decoding
+        // Frame rawmedia_decode_video returns next, ahead of current_frame
+        // while frames come from the caches
+        uint32_t next_frame;
         uint32_t frame_duration;    // Frame duration in video timebase
         AVFilterContext* buffersink_ctx;
         AVFilterContext* buffersrc_ctx;
         AVFilterGraph* filter_graph;
         AVFilterBufferRef* picref;
+        // Additional outputs, scaled from the primary output
+        struct RawMediaVideoOutput {
+            AVFilterContext* buffersink_ctx;
+            AVFilterBufferRef* picref;
+        } outputs[RAWMEDIA_MAX_VIDEO_OUTPUTS];
         enum StreamStatus status;
+        bool crop_changed;          // Rebuild filters before filtering the next frame
+        // Letterboxed output. The border is filled once, and only
+        // the active region is rewritten for each frame.
+        uint8_t* canvas;
+        int canvas_size;
+        int active_x, active_y;
+        int active_width, active_height;
+        // Most recently decoded frames, entry for frame f is f % cache_size
+        VideoCacheEntry* cache;
+        int cache_size;
+        // Shared frame cache ids of the file and its output configuration
+        uint64_t file_id;
+        uint64_t source_id;
+        // Entry last output from the reverse or shared cache,
+        // NULL if the output is the last decoded frame
+        const VideoCacheEntry* cache_output;
+        const FrameCacheEntry* shared_output;
     } video;
 
     struct RawMediaAudio {
@@ -49,9 +95,21 @@ struct RawMediaDecoder {
         AVFilterBufferRef* samplesref;
         int nb_samples_consumed; // Number of samples already consumed from samplesref
         enum StreamStatus status;
+        // After seeking, output sample position we want to resume at.
+        // -1 if not seeking.
+        int64_t seek_sample;
+        int skip_samples;       // Decoded samples to discard
+        int silence_samples;    // Silent samples to output before decoded samples
+        // Frame to seek to before decoding continues, after
+        // rawmedia_decode_video_at output a cached frame. -1 if none.
+        int resume_frame;
     } audio;
 
     RawMediaDecoderInfo info;
+    RawMediaDecoderStats stats;
+    // Next frame of each stream the caller will read, counted from start_frame
+    int64_t video_position;
+    int64_t audio_position;
 };
 
 static inline AVStream* get_avstream(const RawMediaDecoder* rmd, int stream_index) {
@@ -68,15 +126,40 @@ static int open_decoder(AVCodecContext* ctx, AVCodec* codec) {
     return r;
 }
 
-static int init_video_filters(RawMediaDecoder* rmd, const RawMediaSession* session, const RawMediaDecoderConfig* config) {
+static int create_video_sink(RawMediaDecoder* rmd, const char* name, AVFilterContext** sink_ctx) {
+    static const enum AVPixelFormat pixel_fmts[] = { RAWMEDIA_VIDEO_PIXEL_FORMAT,
+                                                     AV_PIX_FMT_NONE };
+    AVBufferSinkParams *buffersink_params = av_buffersink_params_alloc();
+    if (!buffersink_params)
+        return AVERROR(ENOMEM);
+    buffersink_params->pixel_fmts = pixel_fmts;
+    int r = avfilter_graph_create_filter(sink_ctx,
+                                         avfilter_get_by_name("ffbuffersink"),
+                                         name, NULL, buffersink_params,
+                                         rmd->video.filter_graph);
+    av_freep(&buffersink_params);
+    return r;
+}
+
+// Scale to "meet" bounds, maintaining source aspect ratio, and without upscaling.
+// We specify both width and height, instead of using "-1" ("keep aspect")
+// because that just sets the aspect ratio and doesn't actually scale
+// the pixels.
+static void scale_filter(char* buf, int size, int max_width, int max_height) {
+    // %1$d is width, %2$d is height
+    snprintf(buf, size,
+             "scale=trunc(st(0\\,iw*sar)*min(1\\,min(%1$d/ld(0)\\,%2$d/ih))+0.5):ow/dar+0.5",
+             max_width, max_height);
+}
+
+static int init_video_filters(RawMediaDecoder* rmd, const RawMediaDecoderConfig* config) {
     int r = 0;
     char args[512];
+    char filters[1024];
     AVStream* stream = get_avstream(rmd, rmd->video.stream_index);
     AVCodecContext* video_ctx = stream->codec;
     AVFilterInOut* outputs = NULL;
     AVFilterInOut* inputs = NULL;
-    static const enum AVPixelFormat pixel_fmts[] = { RAWMEDIA_VIDEO_PIXEL_FORMAT,
-                                                     AV_PIX_FMT_NONE };
 
     if (!(rmd->video.filter_graph = avfilter_graph_alloc())) {
         r = -1;
@@ -99,19 +182,11 @@ static int init_video_filters(RawMediaDecoder* rmd, const RawMediaSession* sessi
                                           rmd->video.filter_graph)) < 0)
         goto error;
 
-    AVBufferSinkParams *buffersink_params = av_buffersink_params_alloc();
-    buffersink_params->pixel_fmts = pixel_fmts;
-    r = avfilter_graph_create_filter(&rmd->video.buffersink_ctx,
-                                     avfilter_get_by_name("ffbuffersink"),
-                                     "out", NULL, buffersink_params,
-                                     rmd->video.filter_graph);
-    av_freep(&buffersink_params);
-    if (r < 0)
+    if ((r = create_video_sink(rmd, "out", &rmd->video.buffersink_ctx)) < 0)
         goto error;
 
-    inputs = avfilter_inout_alloc();
     outputs = avfilter_inout_alloc();
-    if (!inputs || !outputs) {
+    if (!outputs) {
         r = -1;
         goto error;
     }
@@ -120,20 +195,57 @@ static int init_video_filters(RawMediaDecoder* rmd, const RawMediaSession* sessi
     outputs->pad_idx = 0;
     outputs->next = NULL;
 
-    inputs->name = av_strdup("out");
-    inputs->filter_ctx = rmd->video.buffersink_ctx;
-    inputs->pad_idx = 0;
-    inputs->next = NULL;
+    // One sink per output, linked to the "out", "out1", ... labels
+    AVFilterInOut** next_input = &inputs;
+    for (int i = 0; i <= config->output_count; i++) {
+        AVFilterContext* sink_ctx = rmd->video.buffersink_ctx;
+        char name[16] = "out";
+        if (i > 0) {
+            snprintf(name, sizeof(name), "out%d", i);
+            if ((r = create_video_sink(rmd, name, &rmd->video.outputs[i - 1].buffersink_ctx)) < 0)
+                goto error;
+            sink_ctx = rmd->video.outputs[i - 1].buffersink_ctx;
+        }
+        if (!(*next_input = avfilter_inout_alloc())) {
+            r = -1;
+            goto error;
+        }
+        (*next_input)->name = av_strdup(name);
+        (*next_input)->filter_ctx = sink_ctx;
+        (*next_input)->pad_idx = 0;
+        (*next_input)->next = NULL;
+        next_input = &(*next_input)->next;
+    }
 
-    // Scale to "meet" bounds, maintaining source aspect ratio, and without upscaling.
-    // We specify both width and height, instead of using "-1" ("keep aspect")
-    // because that just sets the aspect ratio and doesn't actually scale
-    // the pixels.
-    // %1$d is width, %2$d is height
-    snprintf(args, sizeof(args),
-             "scale=trunc(st(0\\,iw*sar)*min(1\\,min(%1$d/ld(0)\\,%2$d/ih))+0.5):ow/dar+0.5",
-             config->max_width, config->max_height);
-    if ((r = avfilter_graph_parse(rmd->video.filter_graph, args,
+    // Crop first, so only the region we need is converted and scaled
+    char crop[128] = "";
+    if (config->crop_width > 0 && config->crop_height > 0) {
+        int x = av_clip(config->crop_x, 0, video_ctx->width - 1);
+        int y = av_clip(config->crop_y, 0, video_ctx->height - 1);
+        snprintf(crop, sizeof(crop), "crop=%d:%d:%d:%d,",
+                 FFMIN(config->crop_width, video_ctx->width - x),
+                 FFMIN(config->crop_height, video_ctx->height - y), x, y);
+    }
+
+    char scale[256];
+    scale_filter(scale, sizeof(scale), config->max_width, config->max_height);
+    if (config->output_count == 0)
+        snprintf(filters, sizeof(filters), "%s%s", crop, scale);
+    else {
+        // Split the primary output, and scale the additional outputs
+        // down from it instead of from the source
+        int len = snprintf(filters, sizeof(filters), "[in]%s%s,split=%d[out]",
+                           crop, scale, config->output_count + 1);
+        for (int i = 1; i <= config->output_count; i++)
+            len += snprintf(filters + len, sizeof(filters) - len, "[s%d]", i);
+        for (int i = 1; i <= config->output_count; i++) {
+            const RawMediaVideoBounds* bounds = &config->outputs[i - 1];
+            scale_filter(scale, sizeof(scale), bounds->max_width, bounds->max_height);
+            len += snprintf(filters + len, sizeof(filters) - len,
+                            ";[s%d]%s[out%d]", i, scale, i);
+        }
+    }
+    if ((r = avfilter_graph_parse(rmd->video.filter_graph, filters,
                                   &inputs, &outputs, NULL)) < 0)
         goto error;
     if ((r = avfilter_graph_config(rmd->video.filter_graph, NULL)) < 0)
@@ -224,11 +336,102 @@ error:
     return r;
 }
 
+static void cache_clear(RawMediaDecoder* rmd) {
+    struct RawMediaVideo* video = &rmd->video;
+    for (int i = 0; i < video->cache_size; i++)
+        video->cache[i].frame = -1;
+    video->cache_output = NULL;
+}
+
+static const VideoCacheEntry* cache_lookup(const RawMediaDecoder* rmd, int frame) {
+    const struct RawMediaVideo* video = &rmd->video;
+    if (!video->cache_size || frame < 0)
+        return NULL;
+    const VideoCacheEntry* entry = &video->cache[frame % video->cache_size];
+    return entry->frame == frame ? entry : NULL;
+}
+
+static void get_video_output(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize);
+
+// Copy the current primary output into the cache as frame
+static int cache_insert(RawMediaDecoder* rmd, int frame) {
+    struct RawMediaVideo* video = &rmd->video;
+    VideoCacheEntry* entry = &video->cache[frame % video->cache_size];
+    uint8_t* output;
+    int width, height, size;
+    get_video_output(rmd, &output, &width, &height, &size);
+    entry->frame = -1;
+    if (!output)
+        return 0;
+    if (size > entry->capacity) {
+        av_free(entry->data);
+        entry->capacity = 0;
+        if (!(entry->data = av_malloc(size)))
+            return AVERROR(ENOMEM);
+        entry->capacity = size;
+    }
+    memcpy(entry->data, output, size);
+    entry->width = width;
+    entry->height = height;
+    entry->size = size;
+    entry->frame = frame;
+    return 0;
+}
+
+// Seek to the keyframe at or before frame, and reset decoding state so
+// the next decoded video and audio correspond to frame.
+static int seek_to_frame(RawMediaDecoder* rmd, int frame) {
+    int r = 0;
+    struct RawMediaAudio* audio = &rmd->audio;
+    struct RawMediaVideo* video = &rmd->video;
+    AVFormatContext* format_ctx = rmd->format_ctx;
+
+    int64_t timestamp = av_rescale_q(frame, rmd->time_base, AV_TIME_BASE_Q);
+    if (format_ctx->start_time != AV_NOPTS_VALUE)
+        timestamp += format_ctx->start_time;
+    if ((r = avformat_seek_file(format_ctx, -1, INT64_MIN, timestamp,
+                                timestamp, 0)) < 0)
+        return r;
+
+    if (video->stream_index != INVALID_STREAM) {
+        avcodec_flush_buffers(get_avstream(rmd, video->stream_index)->codec);
+        packet_queue_flush(&video->packetq);
+        av_free_packet(&video->pkt);
+        avcodec_get_frame_defaults(video->avframe);
+        video->status = SS_NORMAL;
+        video->current_frame = video->next_frame = frame;
+    }
+    if (audio->stream_index != INVALID_STREAM) {
+        avcodec_flush_buffers(get_avstream(rmd, audio->stream_index)->codec);
+        packet_queue_flush(&audio->packetq);
+        av_free_packet(&audio->pkt);
+        memset(&audio->pkt_partial, 0, sizeof(audio->pkt_partial));
+        avfilter_unref_bufferp(&audio->samplesref);
+        audio->nb_samples_consumed = 0;
+        audio->status = SS_NORMAL;
+        // Discard anything buffered in the resampler
+        avfilter_graph_free(&audio->filter_graph);
+        if ((r = init_audio_filters(rmd, &rmd->config)) < 0)
+            return r;
+        audio->seek_sample = (int64_t)frame * audio->output_samples_per_frame;
+        audio->skip_samples = audio->silence_samples = 0;
+    }
+    return 0;
+}
+
 static int initial_seek(RawMediaDecoder* rmd, int start_frame) {
     int r = 0;
     struct RawMediaAudio* audio = &rmd->audio;
     struct RawMediaVideo* video = &rmd->video;
 
+    if (rmd->config.keyframe_seek && start_frame > 0) {
+        if ((r = seek_to_frame(rmd, start_frame)) >= 0)
+            return r;
+        av_log(rmd->format_ctx, AV_LOG_WARNING,
+               "keyframe seek failed, decoding to start frame\n");
+        r = 0;
+    }
+
     for (int i = 0; i < start_frame; i++) {
         if (video->stream_index != INVALID_STREAM) {
             if ((r = rawmedia_decode_video(rmd, NULL, NULL, NULL, NULL)) < 0)
@@ -276,7 +479,17 @@ static int init_decoder_info(RawMediaDecoder* rmd, const RawMediaDecoderConfig*
     return 0;
 }
 
+// AVIOInterruptCB callback
+static int decoder_interrupt(void* opaque) {
+    RawMediaDecoder* rmd = opaque;
+    return rmd->cancel && *rmd->cancel;
+}
+
 RawMediaDecoder* rawmedia_create_decoder(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config) {
+    return decoder_create(filename, session, config, NULL);
+}
+
+static RawMediaDecoder* create_decoder(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config, const volatile int* cancel, const LogContext* log_context) {
     int r = 0;
     if (!config->discard_video
         && (config->max_width <= 0 || config->max_height <= 0
@@ -284,6 +497,20 @@ RawMediaDecoder* rawmedia_create_decoder(const char* filename, const RawMediaSes
         av_log(NULL, AV_LOG_FATAL, "Invalid decoder size requested\n");
         return NULL;
     }
+    if (!config->discard_video
+        && (config->output_count < 0
+            || config->output_count > RAWMEDIA_MAX_VIDEO_OUTPUTS)) {
+        av_log(NULL, AV_LOG_FATAL, "Invalid decoder output count requested\n");
+        return NULL;
+    }
+    for (int i = 0; !config->discard_video && i < config->output_count; i++) {
+        const RawMediaVideoBounds* bounds = &config->outputs[i];
+        if (bounds->max_width <= 0 || bounds->max_height <= 0
+            || bounds->max_width % 2) {
+            av_log(NULL, AV_LOG_FATAL, "Invalid decoder output %d size requested\n", i + 1);
+            return NULL;
+        }
+    }
 
     RawMediaDecoder* rmd = av_mallocz(sizeof(RawMediaDecoder));
     AVFormatContext* format_ctx = NULL;
@@ -291,7 +518,17 @@ RawMediaDecoder* rawmedia_create_decoder(const char* filename, const RawMediaSes
         return NULL;
 
     rmd->time_base = (AVRational){session->framerate_den, session->framerate_num};
+    rmd->config = *config;
+    rmd->audio.seek_sample = -1;
+    rmd->audio.resume_frame = -1;
+    rmd->cancel = cancel;
+    rmd->log_context = *log_context;
 
+    if (!(format_ctx = avformat_alloc_context()))
+        goto error;
+    format_ctx->interrupt_callback.callback = decoder_interrupt;
+    format_ctx->interrupt_callback.opaque = rmd;
+    // avformat_open_input frees format_ctx on failure
     if ((r = avformat_open_input(&format_ctx, filename, NULL, NULL)) != 0) {
         av_log(NULL, AV_LOG_FATAL,
                "%s: failed to open (%d)\n", filename, r);
@@ -321,8 +558,19 @@ RawMediaDecoder* rawmedia_create_decoder(const char* filename, const RawMediaSes
                 goto error;
             rmd->video.frame_duration = av_rescale_q(1, rmd->time_base,
                                                      stream->time_base);
-            if ((r = init_video_filters(rmd, session, config)) < 0)
+            if ((r = init_video_filters(rmd, config)) < 0)
                 goto error;
+            if (config->letterbox) {
+                rmd->video.canvas_size = config->max_width * 2 * config->max_height;
+                if (!(rmd->video.canvas = av_malloc(rmd->video.canvas_size)))
+                    goto error;
+            }
+            if (config->reverse_cache_frames > 0) {
+                rmd->video.cache_size = config->reverse_cache_frames;
+                if (!(rmd->video.cache = av_mallocz(rmd->video.cache_size * sizeof(VideoCacheEntry))))
+                    goto error;
+                cache_clear(rmd);
+            }
         }
         else if (r == AVERROR_STREAM_NOT_FOUND
                  || r == AVERROR_DECODER_NOT_FOUND)
@@ -378,15 +626,22 @@ RawMediaDecoder* rawmedia_create_decoder(const char* filename, const RawMediaSes
         goto error;
     }
 
+    if (rmd->video.stream_index != INVALID_STREAM) {
+        rmd->video.file_id = frame_cache_file_id(filename);
+        rmd->video.source_id = frame_cache_source_id(rmd->video.file_id, session, &rmd->config);
+    }
     if ((r = initial_seek(rmd, config->start_frame)) < 0) {
         av_log(NULL, AV_LOG_FATAL, "%s: initial seek to frame %d failed\n",
                filename, config->start_frame);
         goto error;
     }
+    // Frames decoded to reach start_frame aren't read by the caller
+    rmd->video_position = rmd->audio_position = 0;
 
     if ((r = init_decoder_info(rmd, config)) < 0)
         goto error;
 
+    rmd->cancel = NULL;
     return rmd;
 
 error:
@@ -394,17 +649,47 @@ error:
     return NULL;
 }
 
+RawMediaDecoder* decoder_create(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config, const volatile int* cancel) {
+    LogContext log_context;
+    log_context_init(&log_context, filename);
+    const LogContext* prev_context = log_set_context(&log_context);
+    RawMediaDecoder* rmd = create_decoder(filename, session, config, cancel, &log_context);
+    log_set_context(prev_context);
+    return rmd;
+}
+
+RawMediaDecoder* decoder_create_backend(const DecoderBackend* backend, void* opaque, const RawMediaDecoderInfo* info) {
+    RawMediaDecoder* rmd = av_mallocz(sizeof(RawMediaDecoder));
+    if (!rmd)
+        return NULL;
+    rmd->backend = backend;
+    rmd->backend_opaque = opaque;
+    rmd->video.stream_index = INVALID_STREAM;
+    rmd->audio.stream_index = INVALID_STREAM;
+    rmd->info = *info;
+    return rmd;
+}
+
 int rawmedia_destroy_decoder(RawMediaDecoder* rmd) {
     int r = 0;
     if (rmd) {
+        if (rmd->backend)
+            rmd->backend->destroy(rmd->backend_opaque);
         if (rmd->format_ctx) {
             int rc;
             if (rmd->video.stream_index != INVALID_STREAM) {
                 avfilter_unref_buffer(rmd->video.picref);
+                for (int i = 0; i < RAWMEDIA_MAX_VIDEO_OUTPUTS; i++)
+                    avfilter_unref_buffer(rmd->video.outputs[i].picref);
                 avfilter_graph_free(&rmd->video.filter_graph);
+                av_freep(&rmd->video.canvas);
+                for (int i = 0; i < rmd->video.cache_size; i++)
+                    av_free(rmd->video.cache[i].data);
+                av_freep(&rmd->video.cache);
+                frame_cache_release(rmd->video.shared_output);
                 rc = avcodec_close(get_avstream(rmd, rmd->video.stream_index)->codec);
                 r = r || rc;
-                packet_queue_flush(&rmd->video.packetq);
+                packet_queue_destroy(&rmd->video.packetq);
                 avcodec_free_frame(&rmd->video.avframe);
                 av_free_packet(&rmd->video.pkt);
             }
@@ -413,7 +698,7 @@ int rawmedia_destroy_decoder(RawMediaDecoder* rmd) {
                 avfilter_graph_free(&rmd->audio.filter_graph);
                 rc = avcodec_close(get_avstream(rmd, rmd->audio.stream_index)->codec);
                 r = r || rc;
-                packet_queue_flush(&rmd->audio.packetq);
+                packet_queue_destroy(&rmd->audio.packetq);
                 avcodec_free_frame(&rmd->audio.avframe);
                 // Don't free audio.pkt_partial, it's a copy of audio.pkt
                 av_free_packet(&rmd->audio.pkt);
@@ -430,6 +715,76 @@ const RawMediaDecoderInfo* rawmedia_get_decoder_info(const RawMediaDecoder* rmd)
     return &rmd->info;
 }
 
+int rawmedia_get_decoder_stats(const RawMediaDecoder* rmd, RawMediaDecoderStats* stats) {
+    if (rmd->backend) {
+        memset(stats, 0, sizeof(*stats));
+        if (rmd->backend->get_stats)
+            rmd->backend->get_stats(rmd->backend_opaque, stats);
+        return 0;
+    }
+    *stats = rmd->stats;
+    stats->queue_nodes_allocated = rmd->video.packetq.nodes_allocated
+        + rmd->audio.packetq.nodes_allocated;
+    return 0;
+}
+
+void decoder_stats_add(RawMediaDecoderStats* stats, const RawMediaDecoderStats* add) {
+    stats->read_ns += add->read_ns;
+    stats->video_decode_ns += add->video_decode_ns;
+    stats->video_filter_ns += add->video_filter_ns;
+    stats->audio_decode_ns += add->audio_decode_ns;
+    stats->audio_filter_ns += add->audio_filter_ns;
+    stats->audio_copy_ns += add->audio_copy_ns;
+    stats->frames_decoded += add->frames_decoded;
+    stats->frames_dropped += add->frames_dropped;
+    stats->packets_read += add->packets_read;
+    stats->bytes_read += add->bytes_read;
+    stats->queue_peak_packets = FFMAX(stats->queue_peak_packets, add->queue_peak_packets);
+    stats->queue_peak_bytes = FFMAX(stats->queue_peak_bytes, add->queue_peak_bytes);
+    stats->queue_nodes_allocated += add->queue_nodes_allocated;
+}
+
+int decoder_frames_remaining(const RawMediaDecoder* rmd) {
+    const RawMediaDecoderInfo* info = &rmd->info;
+    if (info->has_video && info->has_audio
+        && rmd->video_position != rmd->audio_position)
+        return -1;
+    int64_t position = info->has_video ? rmd->video_position : rmd->audio_position;
+    return FFMAX(info->duration - position, 0);
+}
+
+// Returns the frame of the video keyframe at or before frame,
+// or frame if the keyframe can't be determined.
+int decoder_keyframe_before(const RawMediaDecoder* rmd, int frame) {
+    if (rmd->video.stream_index == INVALID_STREAM || !rmd->video.frame_duration)
+        return frame;
+    AVStream* stream = get_avstream(rmd, rmd->video.stream_index);
+    int64_t start_time = stream->start_time != AV_NOPTS_VALUE
+        ? stream->start_time : 0;
+    int64_t timestamp = (int64_t)frame * rmd->video.frame_duration + start_time;
+    int index = av_index_search_timestamp(stream, timestamp, AVSEEK_FLAG_BACKWARD);
+    if (index < 0)
+        return frame;
+    int64_t keyframe_pts = stream->index_entries[index].timestamp - start_time;
+    if (keyframe_pts <= 0)
+        return 0;
+    // First frame at or after the keyframe
+    int64_t keyframe = (keyframe_pts + rmd->video.frame_duration - 1)
+        / rmd->video.frame_duration;
+    return FFMIN(keyframe, frame);
+}
+
+// Queue pkt for later reading, tracking queue stats
+static int queue_packet(RawMediaDecoder* rmd, PacketQueue* q, AVPacket* pkt) {
+    int r = packet_queue_put(q, pkt);
+    if (r < 0)
+        return r;
+    RawMediaDecoderStats* stats = &rmd->stats;
+    stats->queue_peak_packets = FFMAX(stats->queue_peak_packets, q->nb_packets);
+    stats->queue_peak_bytes = FFMAX(stats->queue_peak_bytes, q->size);
+    return r;
+}
+
 // Read a packet from the indicated stream.
 // Return 0 on success, <0 on error.
 static int read_packet(RawMediaDecoder* rmd, int stream_index, AVPacket* pkt) {
@@ -455,17 +810,23 @@ static int read_packet(RawMediaDecoder* rmd, int stream_index, AVPacket* pkt) {
 
     // No queued packets. Read until we get one for our stream,
     // queuing any packets for the other stream.
+    int64_t start = stats_start();
     while ((r = av_read_frame(rmd->format_ctx, pkt)) >= 0) {
+        rmd->stats.packets_read++;
+        rmd->stats.bytes_read += pkt->size;
         if (stream_index == pkt->stream_index)
-            return 0;
+            break;
         else if (rmd->video.stream_index == pkt->stream_index) {
-            if ((r = packet_queue_put(&rmd->video.packetq, pkt)) < 0)
-                return r;
+            if ((r = queue_packet(rmd, &rmd->video.packetq, pkt)) < 0)
+                break;
         }
         else if (rmd->audio.stream_index == pkt->stream_index)
-            if ((r = packet_queue_put(&rmd->audio.packetq, pkt)) < 0)
-                return r;
+            if ((r = queue_packet(rmd, &rmd->audio.packetq, pkt)) < 0)
+                break;
     }
+    stats_stop(&rmd->stats.read_ns, start);
+    if (r >= 0)
+        return 0;
 
     if (r == AVERROR_EOF) {
         if (stream_index == rmd->video.stream_index) {
@@ -516,8 +877,13 @@ static int decode_video_frame(RawMediaDecoder* rmd) {
 
     while (!got_picture && (r = read_packet(rmd, rmd->video.stream_index, pkt)) >= 0) {
         avcodec_get_frame_defaults(rmd->video.avframe);
-        if ((r = avcodec_decode_video2(video_ctx, rmd->video.avframe, &got_picture, pkt)) < 0)
+        int64_t start = stats_start();
+        r = avcodec_decode_video2(video_ctx, rmd->video.avframe, &got_picture, pkt);
+        stats_stop(&rmd->stats.video_decode_ns, start);
+        if (r < 0)
             return r;
+        if (got_picture)
+            rmd->stats.frames_decoded++;
         if (!got_picture)
             av_free_packet(pkt);
         if (rmd->video.status == SS_EOF)
@@ -530,6 +896,12 @@ static int decode_video_frame(RawMediaDecoder* rmd) {
 static int filter_video(RawMediaDecoder* rmd) {
     int r = 0;
     struct RawMediaVideo* video = &rmd->video;
+    if (video->crop_changed) {
+        avfilter_graph_free(&video->filter_graph);
+        if ((r = init_video_filters(rmd, &rmd->config)) < 0)
+            return r;
+        video->crop_changed = false;
+    }
     if ((r = av_buffersrc_add_frame(video->buffersrc_ctx, video->avframe, 0)) < 0)
         return r;
     if (av_buffersink_poll_frame(video->buffersink_ctx)) {
@@ -539,21 +911,175 @@ static int filter_video(RawMediaDecoder* rmd) {
                                               &video->picref, 0)) < 0)
             return r;
     }
+    for (int i = 0; i < rmd->config.output_count; i++) {
+        struct RawMediaVideoOutput* output = &video->outputs[i];
+        if (av_buffersink_poll_frame(output->buffersink_ctx)) {
+            avfilter_unref_bufferp(&output->picref);
+            if ((r = av_buffersink_get_buffer_ref(output->buffersink_ctx,
+                                                  &output->picref, 0)) < 0)
+                return r;
+        }
+    }
     return r;
 }
 
+int rawmedia_set_decoder_crop(RawMediaDecoder* rmd, int x, int y, int width, int height) {
+    RawMediaDecoderConfig* config = &rmd->config;
+    if (rmd->video.stream_index == INVALID_STREAM || width < 0 || height < 0)
+        return -1;
+    if (x != config->crop_x || y != config->crop_y
+        || width != config->crop_width || height != config->crop_height) {
+        config->crop_x = x;
+        config->crop_y = y;
+        config->crop_width = width;
+        config->crop_height = height;
+        rmd->video.crop_changed = true;
+        // Cached frames have the old crop
+        cache_clear(rmd);
+        RawMediaSession session = {
+            .framerate_num = rmd->time_base.den,
+            .framerate_den = rmd->time_base.num,
+        };
+        rmd->video.source_id = frame_cache_source_id(rmd->video.file_id, &session, config);
+    }
+    return 0;
+}
+
+// Fill the canvas with config background_color, converted to BT.601 UYVY
+static void fill_canvas(RawMediaDecoder* rmd) {
+    uint32_t color = rmd->config.background_color;
+    int r = (color >> 16) & 0xff, g = (color >> 8) & 0xff, b = color & 0xff;
+    uint8_t pair[4];
+    pair[0] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    pair[1] = pair[3] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    pair[2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    uint8_t* canvas = rmd->video.canvas;
+    for (int i = 0; i < rmd->video.canvas_size; i += 4)
+        memcpy(&canvas[i], pair, 4);
+}
+
+// Copy picref centered into canvas, refilling the border only if
+// the active region changed
+static void letterbox_video(RawMediaDecoder* rmd) {
+    struct RawMediaVideo* video = &rmd->video;
+    int canvas_width = rmd->config.max_width;
+    int canvas_linesize = canvas_width * 2;
+    int width = FFMIN(video->picref->video->w, canvas_width);
+    int height = FFMIN(video->picref->video->h, rmd->config.max_height);
+    // Keep x on a chroma pair
+    int x = ((canvas_width - width) / 2) & ~1;
+    int y = (rmd->config.max_height - height) / 2;
+
+    if (x != video->active_x || y != video->active_y
+        || width != video->active_width || height != video->active_height) {
+        fill_canvas(rmd);
+        video->active_x = x;
+        video->active_y = y;
+        video->active_width = width;
+        video->active_height = height;
+    }
+
+    uint8_t* dst = video->canvas + y * canvas_linesize + x * 2;
+    const uint8_t* src = video->picref->data[0];
+    for (int row = 0; row < height; row++) {
+        memcpy(dst, src, width * 2);
+        dst += canvas_linesize;
+        src += video->picref->linesize[0];
+    }
+}
+
 // Returns 0 if no new frame decoded, >0 if new frame decoded, <0 on error.
 static int next_video_frame(RawMediaDecoder* rmd, int64_t expected_pts) {
     int r = 0;
+    int decoded = 0;
     while (expected_pts > av_frame_get_best_effort_timestamp(rmd->video.avframe)) {
         if ((r = decode_video_frame(rmd)) < 0)
             return r;
+        // Each frame decoded replaces the previous one
+        if (r > 0 && decoded++)
+            rmd->stats.frames_dropped++;
         if (rmd->video.status == SS_EOF)
             return r;
     }
     return r;
 }
 
+// Set output to the current primary video frame, if any
+static void get_video_output(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize) {
+    struct RawMediaVideo* video = &rmd->video;
+    if (video->cache_output) {
+        *width = video->cache_output->width;
+        *height = video->cache_output->height;
+        *outputsize = video->cache_output->size;
+        *output = video->cache_output->data;
+    }
+    else if (video->shared_output) {
+        *width = video->shared_output->width;
+        *height = video->shared_output->height;
+        *outputsize = video->shared_output->size;
+        *output = (uint8_t*)video->shared_output->data;
+    }
+    else if (video->canvas && video->picref) {
+        *width = rmd->config.max_width;
+        *height = rmd->config.max_height;
+        *outputsize = video->canvas_size;
+        *output = video->canvas;
+    }
+    else if (video->picref) {
+        *width = video->picref->video->w;
+        *height = video->picref->video->h;
+        *outputsize = video->picref->linesize[0] * *height;
+        *output = video->picref->data[0];
+    }
+    else {
+        *width = *height = *outputsize = 0;
+        *output = NULL;
+    }
+}
+
+// Without audio or additional outputs to keep in step, rawmedia_decode_video
+// outputs frames from the caches. Decoders with them always decode.
+static bool serves_cached_video(const RawMediaDecoder* rmd) {
+    return rmd->audio.stream_index == INVALID_STREAM && !rmd->config.output_count;
+}
+
+// Add the current output to the reverse and shared caches as frame.
+// Only decoders that serve cached frames add to the shared cache, for
+// others copying each frame into it would rarely be repaid.
+static int cache_video_output(RawMediaDecoder* rmd, int frame) {
+    struct RawMediaVideo* video = &rmd->video;
+    int r = 0;
+    if (video->cache && (r = cache_insert(rmd, frame)) < 0)
+        return r;
+    if (serves_cached_video(rmd) && frame_cache_enabled()) {
+        uint8_t* output;
+        int width, height, size;
+        get_video_output(rmd, &output, &width, &height, &size);
+        if (output)
+            frame_cache_put(video->source_id, frame, output, width, height, size);
+    }
+    return r;
+}
+
+// Drop any output served from the caches
+static void clear_cached_output(RawMediaDecoder* rmd) {
+    struct RawMediaVideo* video = &rmd->video;
+    video->cache_output = NULL;
+    frame_cache_release(video->shared_output);
+    video->shared_output = NULL;
+}
+
+// Output frame from the reverse or shared cache, returns true if cached
+static bool output_cached_video(RawMediaDecoder* rmd, int frame) {
+    struct RawMediaVideo* video = &rmd->video;
+    clear_cached_output(rmd);
+    if ((video->cache_output = cache_lookup(rmd, frame)))
+        return true;
+    if (frame_cache_enabled())
+        video->shared_output = frame_cache_get(video->source_id, frame);
+    return video->shared_output != NULL;
+}
+
 // Return <0 on error.
 // Returns >0 if frame decoded.
 // Returns 0 if no new frame decoded (EOF)
@@ -563,17 +1089,15 @@ static int next_video_frame(RawMediaDecoder* rmd, int64_t expected_pts) {
 // height will be set to actual decoded video height
 // outputsize will be set to the byte length of the output buffer,
 //   line stride can be computed from this (bufsize/height)
-int rawmedia_decode_video(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize) {
+static int decode_next_video(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize) {
     int r = 0;
     struct RawMediaVideo* video = &rmd->video;
 
-    if (video->stream_index == INVALID_STREAM)
-        return -1;
-
     if (output) {
         *width = *height = *outputsize = 0;
         *output = NULL;
     }
+    clear_cached_output(rmd);
 
     if (video->status == SS_EOF) {
         r = 0;
@@ -591,8 +1115,14 @@ int rawmedia_decode_video(RawMediaDecoder* rmd, uint8_t** output, int* width, in
 
     // If we decoded a new frame, filter it
     if (video->avframe->format != AV_PIX_FMT_NONE) {
+        int64_t start = stats_start();
         if ((r = filter_video(rmd)) < 0)
             return r;
+        if (video->canvas && video->picref)
+            letterbox_video(rmd);
+        stats_stop(&rmd->stats.video_filter_ns, start);
+        if ((r = cache_video_output(rmd, video->current_frame)) < 0)
+            return r;
         video->current_frame++;
         r = 1;
     }
@@ -600,15 +1130,157 @@ int rawmedia_decode_video(RawMediaDecoder* rmd, uint8_t** output, int* width, in
         r = 0;
 
 done:
-    if (output && video->picref) {
-        *width = video->picref->video->w;
-        *height = video->picref->video->h;
-        *outputsize = video->picref->linesize[0] * *height;
-        *output = video->picref->data[0];
+    video->next_frame = video->current_frame;
+    if (output)
+        get_video_output(rmd, output, width, height, outputsize);
+    return r;
+}
+
+// Position the decoder so the next frame decoded is target. Seeks if
+// seek is set, target is behind, or a keyframe is nearer to it than the
+// current frame. Frames decoded on the way are cached.
+static int position_video(RawMediaDecoder* rmd, int target, bool seek) {
+    int r = 0;
+    struct RawMediaVideo* video = &rmd->video;
+    if (target == (int)video->current_frame && !seek)
+        return 0;
+    int keyframe = decoder_keyframe_before(rmd, target);
+    if (seek || target < (int)video->current_frame || keyframe > (int)video->current_frame) {
+        // Decode from the keyframe, or the oldest frame the reverse cache
+        // can hold if the GOP is longer, so the frames before target are cached too
+        int start = FFMAX(keyframe, target - FFMAX(video->cache_size, 1) + 1);
+        if ((r = seek_to_frame(rmd, FFMAX(start, 0))) < 0)
+            return r;
     }
+    while ((int)video->current_frame < target) {
+        if ((r = decode_next_video(rmd, NULL, NULL, NULL, NULL)) <= 0)
+            return r;
+    }
+    return 0;
+}
+
+// After rawmedia_decode_video_at output a cached frame, seek so audio
+// continues from that frame and video from the frame after it
+static int resume_decoding(RawMediaDecoder* rmd) {
+    int r = 0;
+    struct RawMediaVideo* video = &rmd->video;
+    if (rmd->audio.resume_frame < 0)
+        return 0;
+    uint32_t next_frame = video->next_frame;
+    r = seek_to_frame(rmd, rmd->audio.resume_frame);
+    rmd->audio.resume_frame = -1;
+    if (r < 0)
+        return r;
+    // Frames before next_frame are decoded and dropped
+    video->current_frame = video->next_frame = next_frame;
+    return 0;
+}
+
+static int decode_video(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize) {
+    int r = 0;
+    struct RawMediaVideo* video = &rmd->video;
+
+    if (rmd->backend)
+        return rmd->backend->decode_video(rmd->backend_opaque, output, width, height, outputsize);
+
+    if (video->stream_index == INVALID_STREAM)
+        return -1;
+    if ((r = resume_decoding(rmd)) < 0)
+        return r;
+
+    // Cached frames are output without decoding,
+    // and the decoder catches up on a miss
+    if (serves_cached_video(rmd)) {
+        if (output_cached_video(rmd, video->next_frame)) {
+            video->next_frame++;
+            if (output)
+                get_video_output(rmd, output, width, height, outputsize);
+            return 1;
+        }
+        if ((r = position_video(rmd, video->next_frame, false)) < 0)
+            return r;
+    }
+    return decode_next_video(rmd, output, width, height, outputsize);
+}
+
+int rawmedia_decode_video(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize) {
+    const LogContext* prev_context = log_set_context(&rmd->log_context);
+    int r = decode_video(rmd, output, width, height, outputsize);
+    log_set_context(prev_context);
+    if (r >= 0)
+        rmd->video_position++;
     return r;
 }
 
+static int decode_video_at(RawMediaDecoder* rmd, int frame, uint8_t** output, int* width, int* height, int* outputsize) {
+    int r = 0;
+    struct RawMediaAudio* audio = &rmd->audio;
+    struct RawMediaVideo* video = &rmd->video;
+    if (rmd->backend || video->stream_index == INVALID_STREAM || frame < 0)
+        return -1;
+
+    int target = frame + rmd->config.start_frame;
+    bool has_audio = audio->stream_index != INVALID_STREAM;
+    // Additional outputs aren't cached, so they are always decoded along
+    // with the primary output
+    if (!rmd->config.output_count && output_cached_video(rmd, target)) {
+        video->next_frame = target + 1;
+        // Audio continues from target, seeking once decoding continues
+        // so stepping through cached frames doesn't seek for each one
+        if (has_audio)
+            audio->resume_frame = target;
+        get_video_output(rmd, output, width, height, outputsize);
+        return 1;
+    }
+
+    // Audio continues from target. Unless no audio has been decoded since
+    // seeking to before target, seek so it can be trimmed to target.
+    int64_t sample = (int64_t)target * audio->output_samples_per_frame;
+    bool seek = has_audio && (audio->seek_sample < 0 || audio->seek_sample > sample);
+    audio->resume_frame = -1;
+    if ((r = position_video(rmd, target, seek)) < 0)
+        return r;
+    if (has_audio)
+        audio->seek_sample = sample;
+    return decode_next_video(rmd, output, width, height, outputsize);
+}
+
+int rawmedia_decode_video_at(RawMediaDecoder* rmd, int frame, uint8_t** output, int* width, int* height, int* outputsize) {
+    const LogContext* prev_context = log_set_context(&rmd->log_context);
+    int r = decode_video_at(rmd, frame, output, width, height, outputsize);
+    log_set_context(prev_context);
+    if (r >= 0) {
+        rmd->video_position = frame + 1;
+        rmd->audio_position = frame;
+    }
+    return r;
+}
+
+// Returns the most recent frame of output index decoded by rawmedia_decode_video.
+// Index 0 is the primary output.
+int rawmedia_decode_video_output(RawMediaDecoder* rmd, int index, uint8_t** output, int* width, int* height, int* outputsize) {
+    struct RawMediaVideo* video = &rmd->video;
+    if (video->stream_index == INVALID_STREAM
+        || index < 0 || index > rmd->config.output_count)
+        return -1;
+    if (index == 0) {
+        get_video_output(rmd, output, width, height, outputsize);
+        return 0;
+    }
+
+    AVFilterBufferRef* picref = video->outputs[index - 1].picref;
+    if (!picref) {
+        *width = *height = *outputsize = 0;
+        *output = NULL;
+        return 0;
+    }
+    *width = picref->video->w;
+    *height = picref->video->h;
+    *outputsize = picref->linesize[0] * *height;
+    *output = picref->data[0];
+    return 0;
+}
+
 // Decode partial frame.
 // Return <0 on error, 0 if no frame decoded, >0 if frame decoded
 static int decode_partial_audio_frame(RawMediaDecoder* rmd) {
@@ -618,7 +1290,10 @@ static int decode_partial_audio_frame(RawMediaDecoder* rmd) {
     int got_frame = 0;
     while (pkt_partial->size > 0) {
         avcodec_get_frame_defaults(rmd->audio.avframe);
-        if ((r = avcodec_decode_audio4(audio_ctx, rmd->audio.avframe, &got_frame, pkt_partial)) < 0)
+        int64_t start = stats_start();
+        r = avcodec_decode_audio4(audio_ctx, rmd->audio.avframe, &got_frame, pkt_partial);
+        stats_stop(&rmd->stats.audio_decode_ns, start);
+        if (r < 0)
             return r;
         pkt_partial->data += r;
         pkt_partial->size -= r;
@@ -658,16 +1333,19 @@ static int filter_audio(RawMediaDecoder* rmd) {
     int r = 0;
     struct RawMediaAudio* audio = &rmd->audio;
     AVFrame* avframe = audio->avframe;
+    int64_t start = stats_start();
     if ((r = av_buffersrc_add_frame(audio->abuffersrc_ctx, avframe, 0) < 0))
-        return r;
+        goto done;
     if (av_buffersink_poll_frame(audio->abuffersink_ctx)) {
         // Unref previous buffer
         avfilter_unref_bufferp(&audio->samplesref);
         if ((r = av_buffersink_get_buffer_ref(audio->abuffersink_ctx,
                                               &audio->samplesref, 0)) < 0)
-            return r;
+            goto done;
         audio->nb_samples_consumed = 0;
     }
+done:
+    stats_stop(&rmd->stats.audio_filter_ns, start);
     return r;
 }
 
@@ -679,12 +1357,20 @@ static void copy_audio(RawMediaDecoder* rmd, uint8_t** output, int* output_nb_sa
     struct RawMediaAudio* audio = &rmd->audio;
     if (!audio->samplesref)
         return;
+    if (audio->skip_samples > 0) {
+        int nb_skip = FFMIN(audio->skip_samples,
+                            audio->samplesref->audio->nb_samples
+                            - audio->nb_samples_consumed);
+        audio->skip_samples -= nb_skip;
+        audio->nb_samples_consumed += nb_skip;
+    }
     int nb_samples = FFMIN(*output_nb_samples,
                            audio->samplesref->audio->nb_samples
                            - audio->nb_samples_consumed);
 
     // Could use av_samples_copy
     if (*output) {
+        int64_t start = stats_start();
         int bytes_per_sample = av_get_bytes_per_sample(RAWMEDIA_AUDIO_SAMPLE_FMT)
             * av_get_channel_layout_nb_channels(RAWMEDIA_AUDIO_CHANNEL_LAYOUT);
         int nb_bytes = nb_samples * bytes_per_sample;
@@ -693,6 +1379,7 @@ static void copy_audio(RawMediaDecoder* rmd, uint8_t** output, int* output_nb_sa
 
         memcpy(*output, input, nb_bytes);
         *output += nb_bytes;
+        stats_stop(&rmd->stats.audio_copy_ns, start);
     }
 
     *output_nb_samples -= nb_samples;
@@ -705,24 +1392,70 @@ static void copy_audio(RawMediaDecoder* rmd, uint8_t** output, int* output_nb_sa
     }
 }
 
+// After seeking, compare the position of the first decoded audio with
+// the position we seeked to, and skip or pad to make up the difference.
+static void align_seek_audio(RawMediaDecoder* rmd) {
+    struct RawMediaAudio* audio = &rmd->audio;
+    AVStream* stream = get_avstream(rmd, audio->stream_index);
+    int64_t timestamp = av_frame_get_best_effort_timestamp(audio->avframe);
+    if (timestamp != AV_NOPTS_VALUE) {
+        if (stream->start_time != AV_NOPTS_VALUE)
+            timestamp -= stream->start_time;
+        int64_t sample = av_rescale_q(timestamp, stream->time_base,
+                                      RAWMEDIA_AUDIO_TIME_BASE);
+        if (sample < audio->seek_sample)
+            audio->skip_samples = audio->seek_sample - sample;
+        else
+            audio->silence_samples = sample - audio->seek_sample;
+    }
+    audio->seek_sample = -1;
+}
+
+// Output pending silence_samples
+static void copy_silence(RawMediaDecoder* rmd, uint8_t** output, int* output_nb_samples) {
+    struct RawMediaAudio* audio = &rmd->audio;
+    int nb_samples = FFMIN(*output_nb_samples, audio->silence_samples);
+    if (*output) {
+        uint8_t* data[] = { *output };
+        int nb_channels = av_get_channel_layout_nb_channels(RAWMEDIA_AUDIO_CHANNEL_LAYOUT);
+        av_samples_set_silence(data, 0, nb_samples, nb_channels,
+                               RAWMEDIA_AUDIO_SAMPLE_FMT);
+        *output += nb_samples * nb_channels
+            * av_get_bytes_per_sample(RAWMEDIA_AUDIO_SAMPLE_FMT);
+    }
+    *output_nb_samples -= nb_samples;
+    audio->silence_samples -= nb_samples;
+}
+
 // Return <0 on error.
 // Decodes silent output after EOF.
 // output may be NULL.
-int rawmedia_decode_audio(RawMediaDecoder* rmd, uint8_t* output) {
+static int decode_audio(RawMediaDecoder* rmd, uint8_t* output) {
     int r = 0;
     struct RawMediaAudio* audio = &rmd->audio;
     int output_nb_samples = audio->output_samples_per_frame;
 
+    if (rmd->backend)
+        return rmd->backend->decode_audio(rmd->backend_opaque, output);
+
     if (audio->stream_index == INVALID_STREAM)
         return -1;
+    if ((r = resume_decoding(rmd)) < 0)
+        return r;
 
     // Copy any remaining samples in samplesref
+    if (audio->silence_samples > 0)
+        copy_silence(rmd, &output, &output_nb_samples);
     if (audio->samplesref)
         copy_audio(rmd, &output, &output_nb_samples);
 
     if (rmd->audio.status != SS_EOF) {
         // Decode, filter and copy until output full, or nothing to decode (EOF)
         while (output_nb_samples > 0 && (r = decode_audio_frame(rmd)) > 0) {
+            if (audio->seek_sample >= 0) {
+                align_seek_audio(rmd);
+                copy_silence(rmd, &output, &output_nb_samples);
+            }
             if ((r = filter_audio(rmd)) < 0)
                 return r;
             copy_audio(rmd, &output, &output_nb_samples);
@@ -740,3 +1473,12 @@ int rawmedia_decode_audio(RawMediaDecoder* rmd, uint8_t* output) {
 
     return r;
 }
+
+int rawmedia_decode_audio(RawMediaDecoder* rmd, uint8_t* output) {
+    const LogContext* prev_context = log_set_context(&rmd->log_context);
+    int r = decode_audio(rmd, output);
+    log_set_context(prev_context);
+    if (r >= 0)
+        rmd->audio_position++;
+    return r;
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// For clock_gettime
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+
+// Opens mostly wait on I/O, so use more threads than cores
+#define OPEN_THREADS 8
+
+struct RawMediaDecoderOpen {
+    char* filename;
+    RawMediaSession session;
+    RawMediaDecoderConfig config;
+    volatile int cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    bool done;
+    RawMediaDecoder* rmd;
+};
+
+static ThreadPool* s_open_pool = NULL;
+static pthread_once_t s_open_pool_once = PTHREAD_ONCE_INIT;
+
+static void create_open_pool(void) {
+    // If this fails, opens run synchronously
+    s_open_pool = thread_pool_create(OPEN_THREADS);
+}
+
+static void open_job(void* arg, int index) {
+    RawMediaDecoderOpen* open = arg;
+    RawMediaDecoder* rmd = NULL;
+    if (!open->cancelled)
+        rmd = decoder_create(open->filename, &open->session, &open->config,
+                             &open->cancelled);
+    pthread_mutex_lock(&open->lock);
+    open->rmd = rmd;
+    open->done = true;
+    pthread_cond_broadcast(&open->done_cond);
+    pthread_mutex_unlock(&open->lock);
+}
+
+RawMediaDecoderOpen* rawmedia_create_decoder_async(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config) {
+    RawMediaDecoderOpen* open = av_mallocz(sizeof(RawMediaDecoderOpen));
+    if (!open)
+        return NULL;
+    if (!(open->filename = av_strdup(filename))) {
+        av_free(open);
+        return NULL;
+    }
+    open->session = *session;
+    open->config = *config;
+    pthread_mutex_init(&open->lock, NULL);
+    pthread_cond_init(&open->done_cond, NULL);
+
+    pthread_once(&s_open_pool_once, create_open_pool);
+    thread_pool_submit(s_open_pool, open_job, open);
+    return open;
+}
+
+int rawmedia_poll_decoder_open(RawMediaDecoderOpen* open) {
+    pthread_mutex_lock(&open->lock);
+    int done = open->done;
+    pthread_mutex_unlock(&open->lock);
+    return done;
+}
+
+int rawmedia_wait_decoder_open(RawMediaDecoderOpen* open, int timeout_ms) {
+    struct timespec deadline;
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&open->lock);
+    while (!open->done) {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&open->done_cond, &open->lock);
+        else if (pthread_cond_timedwait(&open->done_cond, &open->lock,
+                                        &deadline) == ETIMEDOUT)
+            break;
+    }
+    int done = open->done;
+    pthread_mutex_unlock(&open->lock);
+    return done;
+}
+
+void rawmedia_cancel_decoder_open(RawMediaDecoderOpen* open) {
+    open->cancelled = 1;
+}
+
+RawMediaDecoder* rawmedia_finish_decoder_open(RawMediaDecoderOpen* open) {
+    if (!open)
+        return NULL;
+    rawmedia_wait_decoder_open(open, -1);
+    RawMediaDecoder* rmd = open->rmd;
+    if (open->cancelled && rmd) {
+        rawmedia_destroy_decoder(rmd);
+        rmd = NULL;
+    }
+    pthread_cond_destroy(&open->done_cond);
+    pthread_mutex_destroy(&open->lock);
+    av_free(open->filename);
+    av_free(open);
+    return rmd;
+}
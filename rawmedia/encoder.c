@@ -6,21 +6,41 @@
 #include <libavutil/intreadwrite.h>
 #include "rawmedia.h"
 #include "rawmedia_internal.h"
+#include "stats.h"
+
+#define IO_BUFFER_SIZE 32768
 
 struct RawMediaEncoder {
     AVFormatContext* format_ctx;
+    RawMediaSession session;
+    RawMediaEncoderConfig config;
+
+    // User IO, if created with rawmedia_create_encoder_io
+    RawMediaEncoderIO io;
+
+    struct RawMediaSegment {
+        char* filename_template;    // NULL if not segmenting
+        char filename[1024];        // Current segment filename
+        int index;
+        int start_frame;
+        RawMediaSegmentConfig config;
+    } segment;
 
     struct RawMediaVideo {
         AVStream* avstream;
         AVFrame* avframe;
         int min_framebuffer_size;
+        int frame_count;
     } video;
 
     struct RawMediaAudio {
         AVStream* avstream;
         AVFrame* avframe;
         int framebuffer_size;
+        int frame_count;
     } audio;
+
+    RawMediaEncoderStats stats;
 };
 
 static AVStream* add_video_stream(AVFormatContext* format_ctx, const RawMediaSession* session, const RawMediaEncoderConfig* config) {
@@ -70,27 +90,93 @@ static AVStream* add_audio_stream(AVFormatContext* format_ctx) {
     return avstream;
 }
 
-RawMediaEncoder* rawmedia_create_encoder(const char* filename, const RawMediaSession* session, const RawMediaEncoderConfig* config) {
+static int io_write(void* opaque, uint8_t* buf, int buf_size) {
+    RawMediaEncoder* rme = opaque;
+    return rme->io.write(rme->io.opaque, buf, buf_size);
+}
+
+static int64_t io_seek(void* opaque, int64_t offset, int whence) {
+    RawMediaEncoder* rme = opaque;
+    // We don't support querying the size
+    if (whence & AVSEEK_SIZE)
+        return AVERROR(ENOSYS);
+    return rme->io.seek(rme->io.opaque, offset, whence & ~AVSEEK_FORCE);
+}
+
+static int open_io(RawMediaEncoder* rme) {
+    const RawMediaEncoderIO* io = &rme->io;
+    uint8_t* buffer = av_malloc(IO_BUFFER_SIZE);
+    if (!buffer)
+        return -1;
+    AVIOContext* pb = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, rme, NULL,
+                                         io_write, io->seek ? io_seek : NULL);
+    if (!pb) {
+        av_free(buffer);
+        return -1;
+    }
+    if (!io->seek)
+        pb->seekable = 0;
+    rme->format_ctx->pb = pb;
+    rme->format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return 0;
+}
+
+// Closes the codecs and output file, and frees the output format context
+static int free_output(RawMediaEncoder* rme) {
     int r = 0;
-    if ((!config->has_video && !config->has_audio)
-        || session->audio_framebuffer_size <= 0
-        || (config->has_video && (config->width <= 0 || config->height <= 0
-                                  || config->width % 2))) {
-        return NULL;
+    int rc;
+    AVFormatContext* format_ctx = rme->format_ctx;
+    if (!format_ctx)
+        return r;
+
+    // Close codecs
+    if (rme->video.avstream) {
+        rc = avcodec_close(rme->video.avstream->codec);
+        r = r || rc;
+        rme->video.avstream = NULL;
+    }
+    if (rme->audio.avstream) {
+        rc = avcodec_close(rme->audio.avstream->codec);
+        r = r || rc;
+        rme->audio.avstream = NULL;
+    }
+    // Close output file
+    if (rme->io.write) {
+        if (format_ctx->pb) {
+            avio_flush(format_ctx->pb);
+            r = r || format_ctx->pb->error;
+            av_free(format_ctx->pb->buffer);
+            av_free(format_ctx->pb);
+        }
+    }
+    else if (!(format_ctx->flags & AVFMT_NOFILE) && format_ctx->pb) {
+        rc = avio_close(format_ctx->pb);
+        r = r || rc;
     }
 
-    RawMediaEncoder* rme = av_mallocz(sizeof(RawMediaEncoder));
+    avformat_free_context(format_ctx);
+    rme->format_ctx = NULL;
+    return r;
+}
+
+// Opens the output format context and streams.
+// Opens the file if filename is set, otherwise uses rme->io.
+// On failure the output is freed, leaving rme->format_ctx NULL.
+static int open_output(RawMediaEncoder* rme, const char* filename) {
+    int r = 0;
+    const RawMediaSession* session = &rme->session;
+    const RawMediaEncoderConfig* config = &rme->config;
     AVFormatContext* format_ctx = NULL;
-    if (!rme)
-        return NULL;
 
     if ((r = avformat_alloc_output_context2(&format_ctx, NULL,
                                             RAWMEDIA_ENCODE_FORMAT,
                                             filename)) < 0) {
         av_log(NULL, AV_LOG_FATAL, "%s: failed to open output file (%d).\n", filename, r);
-        goto error;
+        return r;
     }
     rme->format_ctx = format_ctx;
+    if (!filename)
+        filename = "<io>";
 
     if (config->has_video) {
         rme->video.avstream = add_video_stream(format_ctx, session, config);
@@ -99,23 +185,165 @@ RawMediaEncoder* rawmedia_create_encoder(const char* filename, const RawMediaSes
                    filename);
             goto error;
         }
+    }
+
+    if (config->has_audio) {
+        rme->audio.avstream = add_audio_stream(format_ctx);
+        if (!rme->audio.avstream) {
+            av_log(NULL, AV_LOG_FATAL, "%s: failed to create audio stream.\n",
+                   filename);
+            goto error;
+        }
+    }
+
+    int fragment_frames = config->fragment_frames;
+    if (rme->io.write) {
+        if (open_io(rme) < 0) {
+            av_log(NULL, AV_LOG_FATAL, "%s: failed to create output IO.\n",
+                   filename);
+            goto error;
+        }
+        // MOV can only be streamed to non-seekable output if fragmented.
+        // Default to one second fragments.
+        if (!rme->io.seek && fragment_frames <= 0)
+            fragment_frames = FFMAX(1, session->framerate_num / session->framerate_den);
+    }
+    else if (!(format_ctx->flags & AVFMT_NOFILE)) {
+        if (avio_open(&format_ctx->pb, filename, AVIO_FLAG_WRITE) < 0) {
+            av_log(NULL, AV_LOG_FATAL, "%s: failed to open output file.\n",
+                   filename);
+            goto error;
+        }
+    }
+
+    AVDictionary* opts = NULL;
+    if (fragment_frames > 0) {
+        // Write an empty moov up front, then a moof/mdat pair per fragment
+        char frag_duration[32];
+        AVRational time_base = (AVRational){session->framerate_den,
+                                            session->framerate_num};
+        snprintf(frag_duration, sizeof(frag_duration), "%"PRId64,
+                 av_rescale_q(fragment_frames, time_base,
+                              AV_TIME_BASE_Q));
+        av_dict_set(&opts, "movflags", "empty_moov", 0);
+        av_dict_set(&opts, "frag_duration", frag_duration, 0);
+    }
+    r = avformat_write_header(format_ctx, &opts);
+    av_dict_free(&opts);
+    if (r < 0) {
+        av_log(NULL, AV_LOG_FATAL, "%s: failed to write header.\n",
+               filename);
+        goto error;
+    }
+
+    return r;
+
+error:
+    // No header was written, so there is no trailer to write
+    free_output(rme);
+    return r < 0 ? r : -1;
+}
+
+// Writes the trailer and closes the output opened by open_output
+static int close_output(RawMediaEncoder* rme) {
+    int r = 0;
+    int rc;
+    if (!rme->format_ctx)
+        return r;
+
+    rc = av_write_trailer(rme->format_ctx);
+    r = r || rc;
+    rc = free_output(rme);
+    r = r || rc;
+    return r;
+}
+
+static int open_segment(RawMediaEncoder* rme) {
+    struct RawMediaSegment* segment = &rme->segment;
+    if (av_get_frame_filename(segment->filename, sizeof(segment->filename),
+                              segment->filename_template, segment->index) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "%s: invalid segment filename template.\n",
+               segment->filename_template);
+        return -1;
+    }
+    segment->start_frame = rme->config.has_video
+        ? rme->video.frame_count : rme->audio.frame_count;
+    return open_output(rme, segment->filename);
+}
+
+static int close_segment(RawMediaEncoder* rme) {
+    struct RawMediaSegment* segment = &rme->segment;
+    int r = close_output(rme);
+    // Only report segments that were completely written
+    if (!r && segment->config.closed) {
+        int frame_count = rme->config.has_video
+            ? rme->video.frame_count : rme->audio.frame_count;
+        segment->config.closed(segment->config.opaque, segment->filename,
+                               segment->index, segment->start_frame,
+                               frame_count - segment->start_frame);
+    }
+    segment->index++;
+    return r;
+}
+
+// Rotate to a new segment if the current one is full.
+// We only rotate when all streams have been encoded up to the same frame,
+// so each segment covers the same frames of audio and video.
+static int check_segment(RawMediaEncoder* rme) {
+    struct RawMediaSegment* segment = &rme->segment;
+    if (!segment->filename_template || !rme->format_ctx)
+        return 0;
+    if (rme->config.has_video && rme->config.has_audio
+        && rme->video.frame_count != rme->audio.frame_count)
+        return 0;
+    int frame_count = rme->config.has_video
+        ? rme->video.frame_count : rme->audio.frame_count;
+    if (frame_count == segment->start_frame)
+        return 0;
+    if ((segment->config.segment_frames > 0
+         && frame_count - segment->start_frame >= segment->config.segment_frames)
+        || (segment->config.segment_bytes > 0
+            && avio_tell(rme->format_ctx->pb) >= segment->config.segment_bytes)) {
+        int r = 0;
+        if ((r = close_segment(rme)) < 0)
+            return r;
+        return open_segment(rme);
+    }
+    return 0;
+}
+
+// Opens the file if filename is set, otherwise uses io.
+// If segment is set, filename is a segment filename template.
+static RawMediaEncoder* create_encoder(const char* filename, const RawMediaEncoderIO* io, const RawMediaSegmentConfig* segment, const RawMediaSession* session, const RawMediaEncoderConfig* config) {
+    int r = 0;
+    if ((!config->has_video && !config->has_audio)
+        || session->audio_framebuffer_size <= 0
+        || (config->has_video && (config->width <= 0 || config->height <= 0
+                                  || config->width % 2))) {
+        return NULL;
+    }
+
+    RawMediaEncoder* rme = av_mallocz(sizeof(RawMediaEncoder));
+    if (!rme)
+        return NULL;
+    rme->session = *session;
+    rme->config = *config;
+    if (io)
+        rme->io = *io;
+
+    if (config->has_video) {
         if (!(rme->video.avframe = avcodec_alloc_frame()))
             goto error;
         rme->video.avframe->pts = 0;
         if ((rme->video.min_framebuffer_size =
              avpicture_get_size(RAWMEDIA_VIDEO_PIXEL_FORMAT, config->width, config->height)) <= 0) {
-            av_log(NULL, AV_LOG_FATAL, "%s: invalid frame size.\n", filename);
+            av_log(NULL, AV_LOG_FATAL, "%s: invalid frame size.\n",
+                   filename ? filename : "<io>");
             goto error;
         }
     }
 
     if (config->has_audio) {
-        rme->audio.avstream = add_audio_stream(format_ctx);
-        if (!rme->audio.avstream) {
-            av_log(NULL, AV_LOG_FATAL, "%s: failed to create audio stream.\n",
-                   filename);
-            goto error;
-        }
         if (!(rme->audio.avframe = avcodec_alloc_frame()))
             goto error;
         rme->audio.avframe->pts = 0;
@@ -126,19 +354,15 @@ RawMediaEncoder* rawmedia_create_encoder(const char* filename, const RawMediaSes
         rme->audio.framebuffer_size = session->audio_framebuffer_size;
     }
 
-    if (!(format_ctx->flags & AVFMT_NOFILE)) {
-        if (avio_open(&format_ctx->pb, filename, AVIO_FLAG_WRITE) < 0) {
-            av_log(NULL, AV_LOG_FATAL, "%s: failed to open output file.\n",
-                   filename);
+    if (segment) {
+        rme->segment.config = *segment;
+        if (!(rme->segment.filename_template = av_strdup(filename)))
+            goto error;
+        if ((r = open_segment(rme)) < 0)
             goto error;
-        }
     }
-
-    if (avformat_write_header(format_ctx, NULL) < 0) {
-        av_log(NULL, AV_LOG_FATAL, "%s: failed to write header.\n",
-               filename);
+    else if ((r = open_output(rme, filename)) < 0)
         goto error;
-    }
 
     return rme;
 
@@ -147,58 +371,85 @@ error:
     return NULL;
 }
 
+RawMediaEncoder* rawmedia_create_encoder(const char* filename, const RawMediaSession* session, const RawMediaEncoderConfig* config) {
+    return create_encoder(filename, NULL, NULL, session, config);
+}
+
+RawMediaEncoder* rawmedia_create_encoder_io(const RawMediaEncoderIO* io, const RawMediaSession* session, const RawMediaEncoderConfig* config) {
+    if (!io->write)
+        return NULL;
+    return create_encoder(NULL, io, NULL, session, config);
+}
+
+RawMediaEncoder* rawmedia_create_segmented_encoder(const char* filename_template, const RawMediaSession* session, const RawMediaEncoderConfig* config, const RawMediaSegmentConfig* segment) {
+    if (segment->segment_frames <= 0 && segment->segment_bytes <= 0)
+        return NULL;
+    return create_encoder(filename_template, NULL, segment, session, config);
+}
+
 int rawmedia_destroy_encoder(RawMediaEncoder* rme) {
     int r = 0;
     if (rme) {
         int rc;
-        AVFormatContext* format_ctx = rme->format_ctx;
-        if (format_ctx) {
-            rc = av_write_trailer(format_ctx);
+        if (rme->format_ctx) {
+            if (rme->segment.filename_template)
+                rc = close_segment(rme);
+            else
+                rc = close_output(rme);
             r = r || rc;
-
-            // Close codecs
-            if (rme->video.avstream) {
-                rc = avcodec_close(rme->video.avstream->codec);
-                r = r || rc;
-                avcodec_free_frame(&rme->video.avframe);
-            }
-            if (rme->audio.avstream) {
-                rc = avcodec_close(rme->audio.avstream->codec);
-                r = r || rc;
-                avcodec_free_frame(&rme->audio.avframe);
-            }
-            // Close output file
-            if (!(format_ctx->flags & AVFMT_NOFILE) && format_ctx->pb) {
-                rc = avio_close(format_ctx->pb);
-                r = r || rc;
-            }
-
-            avformat_free_context(format_ctx);
         }
+        avcodec_free_frame(&rme->video.avframe);
+        avcodec_free_frame(&rme->audio.avframe);
+        av_free(rme->segment.filename_template);
         av_free(rme);
     }
     return r;
 }
 
+int rawmedia_get_encoder_stats(const RawMediaEncoder* rme, RawMediaEncoderStats* stats) {
+    *stats = rme->stats;
+    return 0;
+}
+
+// Mux an encoded packet
+static int write_packet(RawMediaEncoder* rme, AVPacket* pkt) {
+    RawMediaEncoderStats* stats = &rme->stats;
+    stats->packets_written++;
+    stats->bytes_written += pkt->size;
+    int64_t start = stats_start();
+    int r = av_interleaved_write_frame(rme->format_ctx, pkt);
+    stats_stop(&stats->mux_ns, start);
+    return r;
+}
+
 // input must be in RAWMEDIA_VIDEO_PIXEL_FORMAT
 // inputsize is the size of input in bytes
 int rawmedia_encode_video(RawMediaEncoder* rme, const uint8_t* input, int inputsize) {
     int r = 0;
     struct RawMediaVideo* video = &rme->video;
-    AVCodecContext* codec_ctx = video->avstream->codec;
     AVPacket pkt = {0};
 
     if (inputsize < video->min_framebuffer_size)
         return -1;
 
+    if ((r = check_segment(rme)) < 0)
+        return r;
+    if (!rme->format_ctx)
+        return -1;
+    AVCodecContext* codec_ctx = video->avstream->codec;
+
     video->avframe->data[0] = (uint8_t*)input;
     video->avframe->linesize[0] = inputsize / codec_ctx->height;
 
     av_init_packet(&pkt);
 
     int got_packet = 0;
-    if ((r = avcodec_encode_video2(codec_ctx, &pkt, video->avframe, &got_packet)) < 0)
+    int64_t start = stats_start();
+    r = avcodec_encode_video2(codec_ctx, &pkt, video->avframe, &got_packet);
+    stats_stop(&rme->stats.video_encode_ns, start);
+    if (r < 0)
         return r;
+    rme->stats.video_frames++;
     if (!got_packet)
         return 0;
     if (pkt.pts != AV_NOPTS_VALUE) {
@@ -213,10 +464,11 @@ int rawmedia_encode_video(RawMediaEncoder* rme, const uint8_t* input, int inputs
     }
 
     pkt.stream_index = video->avstream->index;
-    if ((r = av_interleaved_write_frame(rme->format_ctx, &pkt)) < 0)
+    if ((r = write_packet(rme, &pkt)) < 0)
         return r;
 
-    video->avframe->pts += video->avstream->codec->time_base.num;
+    video->avframe->pts++;
+    video->frame_count++;
 
     video->avframe->data[0] = NULL;
     video->avframe->linesize[0] = 0;
@@ -231,6 +483,11 @@ int rawmedia_encode_audio(RawMediaEncoder* rme, const uint8_t* input) {
     struct RawMediaAudio* audio = &rme->audio;
     AVPacket pkt = {0};
 
+    if ((r = check_segment(rme)) < 0)
+        return r;
+    if (!rme->format_ctx)
+        return -1;
+
     int nb_channels = av_get_channel_layout_nb_channels(RAWMEDIA_AUDIO_CHANNEL_LAYOUT);
     if ((r = avcodec_fill_audio_frame(audio->avframe, nb_channels,
                                       RAWMEDIA_AUDIO_SAMPLE_FMT, input,
@@ -238,16 +495,21 @@ int rawmedia_encode_audio(RawMediaEncoder* rme, const uint8_t* input) {
         return r;
 
     int got_packet = 0;
-    if ((r = avcodec_encode_audio2(audio->avstream->codec, &pkt,
-                                   audio->avframe, &got_packet)) < 0)
+    int64_t start = stats_start();
+    r = avcodec_encode_audio2(audio->avstream->codec, &pkt,
+                              audio->avframe, &got_packet);
+    stats_stop(&rme->stats.audio_encode_ns, start);
+    if (r < 0)
         return r;
+    rme->stats.audio_frames++;
     if (!got_packet)
         return 0;
     pkt.stream_index = audio->avstream->index;
-    if ((r = av_interleaved_write_frame(rme->format_ctx, &pkt)) < 0)
+    if ((r = write_packet(rme, &pkt)) < 0)
         return r;
 
     audio->avframe->pts += audio->avframe->nb_samples;
+    audio->frame_count++;
 
     return r;
 }
@@ -0,0 +1,193 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "thread_pool.h"
+
+// Input scaled to one output size, shared by all outputs of that size
+typedef struct FanoutScale {
+    int width;
+    int height;
+    struct SwsContext* sws_ctx; // NULL if same size as input
+    uint8_t* buffer;
+    int buffersize;
+} FanoutScale;
+
+typedef struct FanoutOutput {
+    RawMediaEncoder* rme;
+    FanoutScale* scale;         // NULL if no video
+    bool has_audio;
+    int result;
+} FanoutOutput;
+
+struct RawMediaFanoutEncoder {
+    int width;
+    int height;
+    int min_framebuffer_size;
+    ThreadPool* pool;
+
+    FanoutScale* scales;
+    int scale_count;
+
+    FanoutOutput* outputs;
+    int output_count;
+
+    // Current input, valid during an encode call
+    const uint8_t* input;
+    int inputsize;
+};
+
+RawMediaFanoutEncoder* rawmedia_create_fanout_encoder(const RawMediaFanoutOutput* outputs, int output_count, int width, int height, const RawMediaSession* session) {
+    if (output_count <= 0 || width <= 0 || height <= 0 || width % 2)
+        return NULL;
+
+    RawMediaFanoutEncoder* rmfe = av_mallocz(sizeof(RawMediaFanoutEncoder));
+    if (!rmfe)
+        return NULL;
+    rmfe->width = width;
+    rmfe->height = height;
+    rmfe->min_framebuffer_size = avpicture_get_size(RAWMEDIA_VIDEO_PIXEL_FORMAT,
+                                                    width, height);
+
+    if (!(rmfe->outputs = av_mallocz(output_count * sizeof(FanoutOutput))))
+        goto error;
+    if (!(rmfe->scales = av_mallocz(output_count * sizeof(FanoutScale))))
+        goto error;
+
+    for (int i = 0; i < output_count; i++) {
+        const RawMediaEncoderConfig* config = &outputs[i].config;
+        FanoutOutput* output = &rmfe->outputs[i];
+        if (!(output->rme = rawmedia_create_encoder(outputs[i].filename,
+                                                    session, config)))
+            goto error;
+        rmfe->output_count++;
+        output->has_audio = config->has_audio;
+        if (!config->has_video)
+            continue;
+
+        // Share scaled video between outputs of the same size
+        for (int s = 0; s < rmfe->scale_count; s++) {
+            if (rmfe->scales[s].width == config->width
+                && rmfe->scales[s].height == config->height) {
+                output->scale = &rmfe->scales[s];
+                break;
+            }
+        }
+        if (output->scale)
+            continue;
+        FanoutScale* scale = &rmfe->scales[rmfe->scale_count++];
+        scale->width = config->width;
+        scale->height = config->height;
+        output->scale = scale;
+        if (scale->width == width && scale->height == height)
+            continue;
+        if (!(scale->sws_ctx = sws_getContext(width, height,
+                                              RAWMEDIA_VIDEO_PIXEL_FORMAT,
+                                              scale->width, scale->height,
+                                              RAWMEDIA_VIDEO_PIXEL_FORMAT,
+                                              SWS_BICUBIC, NULL, NULL, NULL)))
+            goto error;
+        scale->buffersize = avpicture_get_size(RAWMEDIA_VIDEO_PIXEL_FORMAT,
+                                               scale->width, scale->height);
+        if (!(scale->buffer = av_malloc(scale->buffersize)))
+            goto error;
+    }
+
+    // The calling thread also encodes, so one less thread than outputs
+    if (!(rmfe->pool = thread_pool_create(output_count - 1)))
+        goto error;
+
+    return rmfe;
+
+error:
+    av_log(NULL, AV_LOG_FATAL, "Failed to create fanout encoder\n");
+    rawmedia_destroy_fanout_encoder(rmfe);
+    return NULL;
+}
+
+int rawmedia_destroy_fanout_encoder(RawMediaFanoutEncoder* rmfe) {
+    int r = 0;
+    if (rmfe) {
+        thread_pool_destroy(rmfe->pool);
+        for (int i = 0; i < rmfe->output_count; i++) {
+            int rc = rawmedia_destroy_encoder(rmfe->outputs[i].rme);
+            r = r || rc;
+        }
+        for (int s = 0; s < rmfe->scale_count; s++) {
+            sws_freeContext(rmfe->scales[s].sws_ctx);
+            av_free(rmfe->scales[s].buffer);
+        }
+        av_free(rmfe->scales);
+        av_free(rmfe->outputs);
+        av_free(rmfe);
+    }
+    return r;
+}
+
+static void scale_job(void* arg, int index) {
+    RawMediaFanoutEncoder* rmfe = arg;
+    FanoutScale* scale = &rmfe->scales[index];
+    if (!scale->sws_ctx)
+        return;
+    const uint8_t* src[] = { rmfe->input };
+    int src_stride[] = { rmfe->inputsize / rmfe->height };
+    uint8_t* dst[] = { scale->buffer };
+    int dst_stride[] = { scale->buffersize / scale->height };
+    sws_scale(scale->sws_ctx, src, src_stride, 0, rmfe->height, dst, dst_stride);
+}
+
+static void encode_video_job(void* arg, int index) {
+    RawMediaFanoutEncoder* rmfe = arg;
+    FanoutOutput* output = &rmfe->outputs[index];
+    FanoutScale* scale = output->scale;
+    if (!scale)
+        output->result = 0;
+    else if (scale->sws_ctx)
+        output->result = rawmedia_encode_video(output->rme, scale->buffer,
+                                               scale->buffersize);
+    else
+        output->result = rawmedia_encode_video(output->rme, rmfe->input,
+                                               rmfe->inputsize);
+}
+
+static void encode_audio_job(void* arg, int index) {
+    RawMediaFanoutEncoder* rmfe = arg;
+    FanoutOutput* output = &rmfe->outputs[index];
+    if (output->has_audio)
+        output->result = rawmedia_encode_audio(output->rme, rmfe->input);
+    else
+        output->result = 0;
+}
+
+static int fanout_result(RawMediaFanoutEncoder* rmfe) {
+    for (int i = 0; i < rmfe->output_count; i++) {
+        if (rmfe->outputs[i].result < 0)
+            return rmfe->outputs[i].result;
+    }
+    return 0;
+}
+
+// input must be in RAWMEDIA_VIDEO_PIXEL_FORMAT at the fanout encoder size.
+// Outputs without video ignore it.
+int rawmedia_fanout_encode_video(RawMediaFanoutEncoder* rmfe, const uint8_t* input, int inputsize) {
+    if (inputsize < rmfe->min_framebuffer_size)
+        return -1;
+    rmfe->input = input;
+    rmfe->inputsize = inputsize;
+    // Scale once per distinct size, then encode each output
+    thread_pool_execute(rmfe->pool, scale_job, rmfe, rmfe->scale_count);
+    thread_pool_execute(rmfe->pool, encode_video_job, rmfe, rmfe->output_count);
+    rmfe->input = NULL;
+    return fanout_result(rmfe);
+}
+
+// Outputs without audio ignore input.
+int rawmedia_fanout_encode_audio(RawMediaFanoutEncoder* rmfe, const uint8_t* input) {
+    rmfe->input = input;
+    thread_pool_execute(rmfe->pool, encode_audio_job, rmfe, rmfe->output_count);
+    rmfe->input = NULL;
+    return fanout_result(rmfe);
+}
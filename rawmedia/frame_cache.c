@@ -0,0 +1,238 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// For stat
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <libavutil/mem.h>
+#include "frame_cache.h"
+
+#define INITIAL_BUCKETS 256     // Power of 2
+
+typedef struct CacheNode {
+    FrameCacheEntry entry;      // First, so entries convert back to nodes
+    uint64_t source_id;
+    int frame;
+    int refs;                   // References from frame_cache_get
+    bool cached;                // Still in the table, false once evicted
+    struct CacheNode* hash_next;
+    struct CacheNode* lru_prev; // Towards most recently used
+    struct CacheNode* lru_next;
+} CacheNode;
+
+typedef struct FrameCache {
+    pthread_mutex_t lock;
+    int64_t max_bytes;          // Atomic, 0 if disabled
+    int64_t bytes;
+    CacheNode** buckets;
+    int nb_buckets;
+    int nb_entries;
+    CacheNode* lru_head;        // Most recently used
+    CacheNode* lru_tail;
+    RawMediaFrameCacheStats stats;
+} FrameCache;
+
+static FrameCache s_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// 64 bit FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+#define HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+static inline unsigned bucket_index(const FrameCache* cache, uint64_t source_id, int frame) {
+    uint64_t hash = (source_id ^ (uint64_t)frame) * UINT64_C(0x9e3779b97f4a7c15);
+    return (unsigned)(hash >> 32) & (cache->nb_buckets - 1);
+}
+
+bool frame_cache_enabled(void) {
+    return __atomic_load_n(&s_cache.max_bytes, __ATOMIC_RELAXED) > 0;
+}
+
+uint64_t frame_cache_file_id(const char* filename) {
+    struct stat st;
+    if (stat(filename, &st) < 0)
+        return hash_bytes(HASH_INIT, filename, strlen(filename));
+    int64_t identity[] = {
+        st.st_dev, st.st_ino, st.st_size, st.st_mtime,
+    };
+    return hash_bytes(HASH_INIT, identity, sizeof(identity));
+}
+
+uint64_t frame_cache_source_id(uint64_t file_id, const RawMediaSession* session, const RawMediaDecoderConfig* config) {
+    int32_t output[] = {
+        session->framerate_num, session->framerate_den,
+        config->max_width, config->max_height,
+        config->letterbox, config->letterbox ? (int32_t)config->background_color : 0,
+        config->crop_x, config->crop_y, config->crop_width, config->crop_height,
+    };
+    return hash_bytes(file_id, output, sizeof(output));
+}
+
+static void lru_unlink(FrameCache* cache, CacheNode* node) {
+    if (node->lru_prev)
+        node->lru_prev->lru_next = node->lru_next;
+    else
+        cache->lru_head = node->lru_next;
+    if (node->lru_next)
+        node->lru_next->lru_prev = node->lru_prev;
+    else
+        cache->lru_tail = node->lru_prev;
+    node->lru_prev = node->lru_next = NULL;
+}
+
+static void lru_push_head(FrameCache* cache, CacheNode* node) {
+    node->lru_prev = NULL;
+    node->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = node;
+    cache->lru_head = node;
+    if (!cache->lru_tail)
+        cache->lru_tail = node;
+}
+
+static CacheNode* find(FrameCache* cache, uint64_t source_id, int frame) {
+    if (!cache->buckets)
+        return NULL;
+    CacheNode* node = cache->buckets[bucket_index(cache, source_id, frame)];
+    while (node && (node->source_id != source_id || node->frame != frame))
+        node = node->hash_next;
+    return node;
+}
+
+// Remove node from the table, freeing it unless referenced. Must hold lock.
+static void evict(FrameCache* cache, CacheNode* node) {
+    CacheNode** link = &cache->buckets[bucket_index(cache, node->source_id, node->frame)];
+    while (*link != node)
+        link = &(*link)->hash_next;
+    *link = node->hash_next;
+    lru_unlink(cache, node);
+    node->cached = false;
+    cache->nb_entries--;
+    cache->bytes -= node->entry.size;
+    cache->stats.evictions++;
+    if (!node->refs)
+        av_free(node);
+}
+
+// Double the buckets once they average more than one entry
+static void grow(FrameCache* cache) {
+    int nb_buckets = cache->nb_buckets ? cache->nb_buckets * 2 : INITIAL_BUCKETS;
+    CacheNode** buckets = av_mallocz(nb_buckets * sizeof(CacheNode*));
+    if (!buckets)
+        return;
+    CacheNode** old = cache->buckets;
+    int nb_old = cache->nb_buckets;
+    cache->buckets = buckets;
+    cache->nb_buckets = nb_buckets;
+    for (int i = 0; i < nb_old; i++) {
+        CacheNode* node = old[i];
+        while (node) {
+            CacheNode* next = node->hash_next;
+            CacheNode** bucket = &buckets[bucket_index(cache, node->source_id, node->frame)];
+            node->hash_next = *bucket;
+            *bucket = node;
+            node = next;
+        }
+    }
+    av_free(old);
+}
+
+const FrameCacheEntry* frame_cache_get(uint64_t source_id, int frame) {
+    FrameCache* cache = &s_cache;
+    pthread_mutex_lock(&cache->lock);
+    CacheNode* node = find(cache, source_id, frame);
+    if (node) {
+        node->refs++;
+        lru_unlink(cache, node);
+        lru_push_head(cache, node);
+        cache->stats.hits++;
+    }
+    else
+        cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return node ? &node->entry : NULL;
+}
+
+void frame_cache_release(const FrameCacheEntry* entry) {
+    if (!entry)
+        return;
+    FrameCache* cache = &s_cache;
+    CacheNode* node = (CacheNode*)entry;
+    pthread_mutex_lock(&cache->lock);
+    if (--node->refs == 0 && !node->cached)
+        av_free(node);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void frame_cache_put(uint64_t source_id, int frame, const uint8_t* data, int width, int height, int size) {
+    FrameCache* cache = &s_cache;
+    if (size > __atomic_load_n(&cache->max_bytes, __ATOMIC_RELAXED))
+        return;
+    // Copy before taking the lock, frame and node in one allocation
+    CacheNode* node = av_malloc(sizeof(CacheNode) + size);
+    if (!node)
+        return;
+    uint8_t* copy = (uint8_t*)(node + 1);
+    memcpy(copy, data, size);
+    node->entry.data = copy;
+    node->entry.width = width;
+    node->entry.height = height;
+    node->entry.size = size;
+    node->source_id = source_id;
+    node->frame = frame;
+    node->refs = 0;
+    node->cached = true;
+
+    pthread_mutex_lock(&cache->lock);
+    // Another decoder of the same source may have added it
+    if (find(cache, source_id, frame) || cache->max_bytes <= 0) {
+        pthread_mutex_unlock(&cache->lock);
+        av_free(node);
+        return;
+    }
+    if (cache->nb_entries >= cache->nb_buckets)
+        grow(cache);
+    if (!cache->buckets) {
+        pthread_mutex_unlock(&cache->lock);
+        av_free(node);
+        return;
+    }
+    CacheNode** bucket = &cache->buckets[bucket_index(cache, source_id, frame)];
+    node->hash_next = *bucket;
+    *bucket = node;
+    lru_push_head(cache, node);
+    cache->nb_entries++;
+    cache->bytes += size;
+    while (cache->bytes > cache->max_bytes && cache->lru_tail)
+        evict(cache, cache->lru_tail);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void rawmedia_set_frame_cache_size(int64_t max_bytes) {
+    FrameCache* cache = &s_cache;
+    pthread_mutex_lock(&cache->lock);
+    __atomic_store_n(&cache->max_bytes, max_bytes > 0 ? max_bytes : 0, __ATOMIC_RELAXED);
+    while (cache->bytes > cache->max_bytes && cache->lru_tail)
+        evict(cache, cache->lru_tail);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void rawmedia_get_frame_cache_stats(RawMediaFrameCacheStats* stats) {
+    FrameCache* cache = &s_cache;
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    stats->entries = cache->nb_entries;
+    stats->bytes = cache->bytes;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_FRAME_CACHE_H
+#define RM_FRAME_CACHE_H
+
+#include "exports.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include "rawmedia.h"
+
+// Process wide LRU cache of decoded primary output frames, shared by all
+// decoders and limited by rawmedia_set_frame_cache_size.
+// Frames are keyed by a source id, identifying the file and the output
+// configuration (framerate, size, letterbox, crop), and the absolute frame number.
+typedef struct FrameCacheEntry {
+    const uint8_t* data;
+    int width;
+    int height;
+    int size;
+} FrameCacheEntry;
+
+// True if frames should be looked up and added
+RAWMEDIA_LOCAL bool frame_cache_enabled(void);
+
+// Identity of a file, from its device, inode, size and modification time,
+// or its name if it can't be stat'ed
+RAWMEDIA_LOCAL uint64_t frame_cache_file_id(const char* filename);
+// Source id for frames of file_id decoded at the session framerate with config
+RAWMEDIA_LOCAL uint64_t frame_cache_source_id(uint64_t file_id, const RawMediaSession* session, const RawMediaDecoderConfig* config);
+
+// Returns a reference to the cached frame, NULL on a miss.
+// The entry must be released, it stays valid until then even if evicted.
+RAWMEDIA_LOCAL const FrameCacheEntry* frame_cache_get(uint64_t source_id, int frame);
+RAWMEDIA_LOCAL void frame_cache_release(const FrameCacheEntry* entry);
+// Copy a frame into the cache, evicting the least recently used frames
+// to stay within the size limit
+RAWMEDIA_LOCAL void frame_cache_put(uint64_t source_id, int frame, const uint8_t* data, int width, int height, int size);
+
+#endif
@@ -0,0 +1,310 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// For mmap, fstat and posix_madvise
+#define _POSIX_C_SOURCE 200112L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libavutil/mem.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+
+// Store layout, in native byte order:
+//   FrameStoreHeader, padded to FRAME_STORE_ALIGN
+//   per frame: UYVY video then PCM audio, each padded to FRAME_STORE_ALIGN
+//   FrameStoreIndexEntry for each frame, at header.index_offset
+// Frames that repeat the previous video reference its data.
+// The header is rewritten with index_offset once all frames are written,
+// so an incomplete store has index_offset 0 and is rejected.
+
+#define FRAME_STORE_MAGIC "RMFSTORE"
+#define FRAME_STORE_VERSION 1
+// Page size of common platforms, so mapped frames are page aligned
+#define FRAME_STORE_ALIGN 4096
+
+typedef struct FrameStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t alignment;
+    int32_t framerate_num;
+    int32_t framerate_den;
+    int32_t audio_framebuffer_size;
+    int32_t frame_count;
+    int32_t has_video;
+    int32_t has_audio;
+    uint64_t index_offset;
+} FrameStoreHeader;
+
+typedef struct FrameStoreIndexEntry {
+    uint64_t video_offset;
+    uint64_t audio_offset;
+    int32_t video_size;         // 0 if no video decoded yet
+    int32_t width;
+    int32_t height;
+    int32_t video_result;       // rawmedia_decode_video result when written
+    int32_t audio_result;       // rawmedia_decode_audio result when written
+    int32_t reserved;
+} FrameStoreIndexEntry;
+
+// Write size bytes at *offset, then zeros up to the next aligned offset
+static int write_aligned(FILE* fp, uint64_t* offset, const void* data, size_t size) {
+    static const uint8_t zeros[FRAME_STORE_ALIGN];
+    if (size && fwrite(data, size, 1, fp) < 1)
+        return -1;
+    *offset += size;
+    size_t padding = (FRAME_STORE_ALIGN - *offset % FRAME_STORE_ALIGN) % FRAME_STORE_ALIGN;
+    if (padding && fwrite(zeros, padding, 1, fp) < 1)
+        return -1;
+    *offset += padding;
+    return 0;
+}
+
+int rawmedia_write_frame_store(RawMediaDecoder* rmd, const RawMediaSession* session, const char* filename) {
+    int r = 0;
+    const RawMediaDecoderInfo* info = rawmedia_get_decoder_info(rmd);
+    int frame_count = decoder_frames_remaining(rmd);
+    FrameStoreIndexEntry* index = NULL;
+    uint8_t* audio = NULL;
+    uint64_t offset = 0;
+    FrameStoreHeader header = {
+        .magic = FRAME_STORE_MAGIC,
+        .version = FRAME_STORE_VERSION,
+        .alignment = FRAME_STORE_ALIGN,
+        .framerate_num = session->framerate_num,
+        .framerate_den = session->framerate_den,
+        .audio_framebuffer_size = session->audio_framebuffer_size,
+        .has_video = info->has_video,
+        .has_audio = info->has_audio,
+    };
+
+    if (frame_count < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: decoder video and audio are at different frames\n",
+               filename);
+        return -1;
+    }
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to create frame store\n", filename);
+        return -1;
+    }
+    if ((frame_count > 0 && !(index = av_mallocz(frame_count * sizeof(FrameStoreIndexEntry))))
+        || (info->has_audio && !(audio = av_malloc(session->audio_framebuffer_size)))) {
+        r = -1;
+        goto error;
+    }
+    if ((r = write_aligned(fp, &offset, &header, sizeof(header))) < 0)
+        goto write_error;
+
+    for (int i = 0; i < frame_count; i++) {
+        FrameStoreIndexEntry* entry = &index[i];
+        if (info->has_video) {
+            uint8_t* output;
+            int width, height, size;
+            if ((r = rawmedia_decode_video(rmd, &output, &width, &height, &size)) < 0)
+                goto error;
+            int result = r;
+            if (result > 0 && output) {
+                entry->video_offset = offset;
+                entry->video_size = size;
+                entry->width = width;
+                entry->height = height;
+                if ((r = write_aligned(fp, &offset, output, size)) < 0)
+                    goto write_error;
+            }
+            else if (i > 0)
+                *entry = index[i - 1];
+            entry->video_result = result;
+        }
+        if (info->has_audio) {
+            if ((r = rawmedia_decode_audio(rmd, audio)) < 0)
+                goto error;
+            entry->audio_result = r;
+            entry->audio_offset = offset;
+            if ((r = write_aligned(fp, &offset, audio, session->audio_framebuffer_size)) < 0)
+                goto write_error;
+        }
+    }
+
+    header.frame_count = frame_count;
+    header.index_offset = offset;
+    if ((r = write_aligned(fp, &offset, index, frame_count * sizeof(FrameStoreIndexEntry))) < 0
+        || fseek(fp, 0, SEEK_SET) != 0
+        || fwrite(&header, sizeof(header), 1, fp) < 1)
+        goto write_error;
+    av_free(index);
+    av_free(audio);
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        goto write_error;
+    }
+    return 0;
+
+write_error:
+    av_log(NULL, AV_LOG_ERROR, "%s: failed to write frame store\n", filename);
+    r = -1;
+error:
+    av_free(index);
+    av_free(audio);
+    if (fp)
+        fclose(fp);
+    remove(filename);
+    return r;
+}
+
+typedef struct FrameStore {
+    uint8_t* map;
+    size_t map_size;
+    const FrameStoreHeader* header;
+    const FrameStoreIndexEntry* index;
+    int video_frame;            // Next frame of each stream
+    int audio_frame;
+} FrameStore;
+
+// Video is returned as a pointer into the mapped store
+static int frame_store_decode_video(void* opaque, uint8_t** output, int* width, int* height, int* outputsize) {
+    FrameStore* store = opaque;
+    int count = store->header->frame_count;
+    if (!store->header->has_video)
+        return -1;
+    // Past the end, repeat the last frame
+    int frame = FFMIN(store->video_frame, count - 1);
+    const FrameStoreIndexEntry* entry = frame >= 0 ? &store->index[frame] : NULL;
+    if (output) {
+        *output = entry && entry->video_size ? store->map + entry->video_offset : NULL;
+        *width = entry ? entry->width : 0;
+        *height = entry ? entry->height : 0;
+        *outputsize = entry ? entry->video_size : 0;
+    }
+    if (store->video_frame >= count)
+        return 0;
+    store->video_frame++;
+    return entry->video_result;
+}
+
+static int frame_store_decode_audio(void* opaque, uint8_t* output) {
+    FrameStore* store = opaque;
+    const FrameStoreHeader* header = store->header;
+    if (!header->has_audio)
+        return -1;
+    if (store->audio_frame >= header->frame_count) {
+        if (output)
+            memset(output, RAWMEDIA_AUDIO_SILENCE, header->audio_framebuffer_size);
+        return 0;
+    }
+    const FrameStoreIndexEntry* entry = &store->index[store->audio_frame++];
+    if (output)
+        memcpy(output, store->map + entry->audio_offset, header->audio_framebuffer_size);
+    return entry->audio_result;
+}
+
+static void frame_store_destroy(void* opaque) {
+    FrameStore* store = opaque;
+    if (!store)
+        return;
+    if (store->map)
+        munmap(store->map, store->map_size);
+    av_free(store);
+}
+
+static const DecoderBackend frame_store_backend = {
+    .decode_video = frame_store_decode_video,
+    .decode_audio = frame_store_decode_audio,
+    .destroy = frame_store_destroy,
+};
+
+static bool range_valid(const FrameStore* store, uint64_t offset, uint64_t size) {
+    return offset <= store->map_size && size <= store->map_size - offset;
+}
+
+// Check the header matches session and all offsets are inside the store
+static bool frame_store_valid(const FrameStore* store, const RawMediaSession* session, const char* filename) {
+    const FrameStoreHeader* header = store->header;
+    if (store->map_size < sizeof(FrameStoreHeader)
+        || memcmp(header->magic, FRAME_STORE_MAGIC, sizeof(header->magic))
+        || header->version != FRAME_STORE_VERSION
+        || header->alignment != FRAME_STORE_ALIGN
+        || header->frame_count < 0
+        || !header->index_offset
+        || !range_valid(store, header->index_offset,
+                        (uint64_t)header->frame_count * sizeof(FrameStoreIndexEntry))) {
+        av_log(NULL, AV_LOG_ERROR, "%s: not a complete frame store\n", filename);
+        return false;
+    }
+    if (header->framerate_num != session->framerate_num
+        || header->framerate_den != session->framerate_den
+        || (header->has_audio && header->audio_framebuffer_size != session->audio_framebuffer_size)) {
+        av_log(NULL, AV_LOG_ERROR, "%s: frame store was written for %d/%d fps, not %d/%d\n",
+               filename, header->framerate_num, header->framerate_den,
+               session->framerate_num, session->framerate_den);
+        return false;
+    }
+    const FrameStoreIndexEntry* index = (const FrameStoreIndexEntry*)(store->map + header->index_offset);
+    for (int i = 0; i < header->frame_count; i++) {
+        const FrameStoreIndexEntry* entry = &index[i];
+        if ((header->has_video
+             && (entry->video_size < 0 || entry->width < 0 || entry->height < 0
+                 || (int64_t)entry->width * entry->height * 2 > entry->video_size
+                 || !range_valid(store, entry->video_offset, entry->video_size)))
+            || (header->has_audio
+                && !range_valid(store, entry->audio_offset, header->audio_framebuffer_size))) {
+            av_log(NULL, AV_LOG_ERROR, "%s: frame store index is corrupt at frame %d\n",
+                   filename, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+RawMediaDecoder* rawmedia_create_frame_store_decoder(const char* filename, const RawMediaSession* session) {
+    struct stat st;
+    int fd = -1;
+    FrameStore* store = av_mallocz(sizeof(FrameStore));
+    if (!store)
+        return NULL;
+
+    if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to open frame store\n", filename);
+        goto error;
+    }
+    if (st.st_size < (off_t)sizeof(FrameStoreHeader)) {
+        av_log(NULL, AV_LOG_ERROR, "%s: not a complete frame store\n", filename);
+        goto error;
+    }
+    store->map_size = st.st_size;
+    void* map = mmap(NULL, store->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to map frame store\n", filename);
+        goto error;
+    }
+    // The mapping keeps the file open
+    close(fd);
+    fd = -1;
+    store->map = map;
+    store->header = map;
+    if (!frame_store_valid(store, session, filename))
+        goto error;
+    store->index = (const FrameStoreIndexEntry*)(store->map + store->header->index_offset);
+    // Frames are normally read in order, so read ahead aggressively
+    posix_madvise(store->map, store->map_size, POSIX_MADV_SEQUENTIAL);
+
+    RawMediaDecoderInfo info = {
+        .duration = store->header->frame_count,
+        .has_video = store->header->has_video,
+        .has_audio = store->header->has_audio,
+    };
+    RawMediaDecoder* rmd = decoder_create_backend(&frame_store_backend, store, &info);
+    if (!rmd)
+        goto error;
+    return rmd;
+
+error:
+    if (fd >= 0)
+        close(fd);
+    frame_store_destroy(store);
+    return NULL;
+}
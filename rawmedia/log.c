@@ -0,0 +1,256 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// For clock_gettime
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <libavutil/log.h>
+#include "rawmedia.h"
+#include "log.h"
+
+#define LOG_LINE_SIZE 1024
+#define LOG_RING_SIZE 256           // Power of 2
+#define LOG_DRAIN_INTERVAL_MS 10
+
+// Per thread state, so concurrent decoders don't race
+typedef struct LogState {
+    int print_prefix;
+    int count;                      // Times prev was repeated
+    const LogContext* prev_context;
+    char prev[LOG_LINE_SIZE];
+    const LogContext* context;
+} LogState;
+
+static __thread LogState s_state = { .print_prefix = 1 };
+
+static void (*s_user_log_callback)(const char*) = NULL;
+static int s_log_level = AV_LOG_INFO;
+static unsigned s_next_decoder_id = 0;
+
+// Bounded lock free queue (Vyukov), many producers and a single consumer.
+// A slot is free for the producer claiming position pos when
+// sequence == pos, and holds a line for the consumer when sequence == pos + 1.
+typedef struct LogSlot {
+    unsigned sequence;
+    char line[LOG_LINE_SIZE];
+} LogSlot;
+
+typedef struct LogRing {
+    LogSlot slots[LOG_RING_SIZE];
+    unsigned head;                  // Next position to produce
+    unsigned tail;                  // Next position to consume, consumer only
+    unsigned dropped;               // Lines dropped because the ring was full
+    pthread_t thread;
+    pthread_mutex_t consumer_lock;  // Serializes draining
+    pthread_mutex_t wake_lock;
+    pthread_cond_t wake_cond;
+    bool running;                   // thread is running
+    bool shutdown;
+} LogRing;
+
+// The ring is never freed, as producers may still be using it
+// after async logging is disabled.
+static LogRing s_ring = {
+    .consumer_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake_cond = PTHREAD_COND_INITIALIZER,
+};
+static pthread_once_t s_ring_once = PTHREAD_ONCE_INIT;
+static bool s_async = false;
+static pthread_mutex_t s_async_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void log_context_init(LogContext* ctx, const char* filename) {
+    unsigned id = __atomic_add_fetch(&s_next_decoder_id, 1, __ATOMIC_RELAXED);
+    const char* basename = strrchr(filename, '/');
+    snprintf(ctx->tag, sizeof(ctx->tag), "[decoder %u %s] ",
+             id, basename ? basename + 1 : filename);
+}
+
+const LogContext* log_set_context(const LogContext* ctx) {
+    const LogContext* prev = s_state.context;
+    s_state.context = ctx;
+    return prev;
+}
+
+static void ring_init(void) {
+    for (unsigned i = 0; i < LOG_RING_SIZE; i++)
+        s_ring.slots[i].sequence = i;
+}
+
+static bool ring_put(LogRing* ring, const char* line) {
+    unsigned pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    LogSlot* slot;
+    while (true) {
+        slot = &ring->slots[pos & (LOG_RING_SIZE - 1)];
+        unsigned sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int diff = (int)(sequence - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0) {
+            // Full, drop rather than block the logging thread
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        else
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+    strcpy(slot->line, line);
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Deliver queued lines to the user callback. Must hold consumer_lock.
+static void ring_drain(LogRing* ring) {
+    void (*callback)(const char*) = __atomic_load_n(&s_user_log_callback, __ATOMIC_ACQUIRE);
+    unsigned dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    while (true) {
+        LogSlot* slot = &ring->slots[ring->tail & (LOG_RING_SIZE - 1)];
+        unsigned sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence != ring->tail + 1)
+            break;
+        if (callback)
+            callback(slot->line);
+        __atomic_store_n(&slot->sequence, ring->tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        ring->tail++;
+    }
+    if (dropped && callback) {
+        char line[64];
+        snprintf(line, sizeof(line), "    %u log messages dropped\n", dropped);
+        callback(line);
+    }
+}
+
+static void* drain_thread(void* arg) {
+    LogRing* ring = arg;
+    pthread_mutex_lock(&ring->wake_lock);
+    while (!ring->shutdown) {
+        pthread_mutex_unlock(&ring->wake_lock);
+        pthread_mutex_lock(&ring->consumer_lock);
+        ring_drain(ring);
+        pthread_mutex_unlock(&ring->consumer_lock);
+
+        // Producers don't take wake_lock, so wake periodically
+        // in case a signal was missed
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_DRAIN_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&ring->wake_lock);
+        if (!ring->shutdown)
+            pthread_cond_timedwait(&ring->wake_cond, &ring->wake_lock, &deadline);
+    }
+    pthread_mutex_unlock(&ring->wake_lock);
+    return NULL;
+}
+
+static void deliver(const char* line) {
+    if (__atomic_load_n(&s_async, __ATOMIC_ACQUIRE)) {
+        if (ring_put(&s_ring, line))
+            pthread_cond_signal(&s_ring.wake_cond);
+    }
+    else {
+        void (*callback)(const char*) = __atomic_load_n(&s_user_log_callback, __ATOMIC_ACQUIRE);
+        if (callback)
+            callback(line);
+    }
+}
+
+static void sanitize(uint8_t *line){
+    while (*line) {
+        if (*line < 0x08 || (*line > 0x0D && *line < 0x20))
+            *line='?';
+        line++;
+    }
+}
+
+static void redirector_log_callback(void* ptr, int level, const char* fmt, va_list vl) {
+    LogState* state = &s_state;
+    char line[LOG_LINE_SIZE];
+
+    // Drop before formatting
+    if (level > __atomic_load_n(&s_log_level, __ATOMIC_RELAXED))
+        return;
+    bool line_start = state->print_prefix;
+    const LogContext* context = line_start ? state->context : NULL;
+    av_log_format_line(ptr, level, fmt, vl, line, sizeof(line), &state->print_prefix);
+
+    // Implement AV_LOG_SKIP_REPEATED
+    if (line_start && state->prev_context == context && !strcmp(line, state->prev)) {
+        state->count++;
+        return;
+    }
+    if (state->count > 0) {
+        char repeated[64];
+        snprintf(repeated, sizeof(repeated), "    Last message repeated %d times\n", state->count);
+        deliver(repeated);
+        state->count = 0;
+    }
+    strcpy(state->prev, line);
+    state->prev_context = context;
+    sanitize((uint8_t*)line);
+    if (context) {
+        char tagged[LOG_LINE_SIZE];
+        snprintf(tagged, sizeof(tagged), "%s%s", context->tag, line);
+        deliver(tagged);
+    }
+    else
+        deliver(line);
+}
+
+void rawmedia_set_log(int level, void (*callback)(const char*)) {
+    // Deliver queued lines to the old callback, and swap under the
+    // consumer lock so the drain thread is never left calling it
+    pthread_mutex_lock(&s_ring.consumer_lock);
+    ring_drain(&s_ring);
+    __atomic_store_n(&s_log_level, level, __ATOMIC_RELAXED);
+    av_log_set_level(level);
+    __atomic_store_n(&s_user_log_callback, callback, __ATOMIC_RELEASE);
+    av_log_set_callback(callback ? redirector_log_callback : av_log_default_callback);
+    pthread_mutex_unlock(&s_ring.consumer_lock);
+}
+
+int rawmedia_set_log_async(bool async) {
+    int r = 0;
+    LogRing* ring = &s_ring;
+    pthread_mutex_lock(&s_async_lock);
+    if (async && !ring->running) {
+        pthread_once(&s_ring_once, ring_init);
+        ring->shutdown = false;
+        if (pthread_create(&ring->thread, NULL, drain_thread, ring) == 0) {
+            ring->running = true;
+            __atomic_store_n(&s_async, true, __ATOMIC_RELEASE);
+        }
+        else
+            r = -1;
+    }
+    else if (!async && ring->running) {
+        __atomic_store_n(&s_async, false, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&ring->wake_lock);
+        ring->shutdown = true;
+        pthread_cond_signal(&ring->wake_cond);
+        pthread_mutex_unlock(&ring->wake_lock);
+        pthread_join(ring->thread, NULL);
+        ring->running = false;
+        // Deliver what was queued before the switch
+        rawmedia_flush_log();
+    }
+    pthread_mutex_unlock(&s_async_lock);
+    return r;
+}
+
+void rawmedia_flush_log(void) {
+    pthread_mutex_lock(&s_ring.consumer_lock);
+    ring_drain(&s_ring);
+    pthread_mutex_unlock(&s_ring.consumer_lock);
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_LOG_H
+#define RM_LOG_H
+
+#include "exports.h"
+
+// Tag prefixed to log lines from the thread it is set on
+typedef struct LogContext {
+    char tag[128];
+} LogContext;
+
+// Tag ctx with a new decoder id and filename
+RAWMEDIA_LOCAL void log_context_init(LogContext* ctx, const char* filename);
+
+// Set the calling thread's context (NULL for none), returns the previous
+// context to restore.
+RAWMEDIA_LOCAL const LogContext* log_set_context(const LogContext* ctx);
+
+#endif
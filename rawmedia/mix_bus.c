@@ -0,0 +1,55 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <string.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "audio_mix.h"
+
+struct RawMediaMixBus {
+    int nb_samples;         // Interleaved samples per audio frame
+    int nb_frames;          // Stereo frames per audio frame
+    float* acc;
+};
+
+RawMediaMixBus* rawmedia_create_mix_bus(const RawMediaSession* session) {
+    RawMediaMixBus* bus = av_mallocz(sizeof(RawMediaMixBus));
+    if (!bus)
+        return NULL;
+    int nb_channels = av_get_channel_layout_nb_channels(RAWMEDIA_AUDIO_CHANNEL_LAYOUT);
+    bus->nb_samples = session->audio_framebuffer_size / sizeof(RAWMEDIA_AUDIO_DATATYPE);
+    bus->nb_frames = bus->nb_samples / nb_channels;
+    if (!(bus->acc = av_mallocz(bus->nb_samples * sizeof(float)))) {
+        av_free(bus);
+        return NULL;
+    }
+    return bus;
+}
+
+void rawmedia_mix_bus_begin(RawMediaMixBus* bus) {
+    memset(bus->acc, 0, bus->nb_samples * sizeof(float));
+}
+
+void rawmedia_mix_bus_add(RawMediaMixBus* bus, const uint8_t* buffer, const RawMediaMixGain* gain, float pan) {
+    MixInput input;
+    if (audio_mix_input_init(&input, (const RAWMEDIA_AUDIO_DATATYPE*)buffer,
+                             gain, pan, bus->nb_frames))
+        audio_mix_accumulate(bus->acc, &input, 0, bus->nb_samples);
+}
+
+void rawmedia_mix_bus_add_bus(RawMediaMixBus* bus, const RawMediaMixBus* submix, float gain) {
+    if (gain != 0)
+        audio_mix_accumulate_f32(bus->acc, submix->acc, gain, bus->nb_samples);
+}
+
+void rawmedia_mix_bus_finish(RawMediaMixBus* bus, uint8_t* output) {
+    audio_mix_store_s16(bus->acc, bus->nb_samples,
+                        (RAWMEDIA_AUDIO_DATATYPE*)output);
+}
+
+void rawmedia_destroy_mix_bus(RawMediaMixBus* bus) {
+    if (!bus)
+        return;
+    av_free(bus->acc);
+    av_free(bus);
+}
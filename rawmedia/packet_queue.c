@@ -12,9 +12,14 @@ int packet_queue_put(PacketQueue* q, AVPacket* pkt) {
 
     if (av_dup_packet(pkt) < 0)
         return -1;
-    pktl = av_malloc(sizeof(AVPacketList));
-    if (!pktl)
-        return -1;
+    // Reuse a node from a previous packet if possible
+    if ((pktl = q->free_pkt))
+        q->free_pkt = pktl->next;
+    else {
+        if (!(pktl = av_malloc(sizeof(AVPacketList))))
+            return -1;
+        q->nodes_allocated++;
+    }
     pktl->pkt = *pkt;
     pktl->next = NULL;
 
@@ -23,6 +28,8 @@ int packet_queue_put(PacketQueue* q, AVPacket* pkt) {
     else
         q->last_pkt->next = pktl;
     q->last_pkt = pktl;
+    q->nb_packets++;
+    q->size += pkt->size;
     return 0;
 }
 
@@ -34,7 +41,10 @@ int packet_queue_get(PacketQueue* q, AVPacket* pkt) {
         if (!q->first_pkt)
             q->last_pkt = NULL;
         *pkt = pktl->pkt;
-        av_free(pktl);
+        q->nb_packets--;
+        q->size -= pkt->size;
+        pktl->next = q->free_pkt;
+        q->free_pkt = pktl;
         return 1;
     }
     return 0;
@@ -46,9 +56,23 @@ void packet_queue_flush(PacketQueue* q) {
     for (pkt = q->first_pkt; pkt != NULL; pkt = pktl) {
         pktl = pkt->next;
         av_free_packet(&pkt->pkt);
-        av_freep(&pkt);
+        pkt->next = q->free_pkt;
+        q->free_pkt = pkt;
     }
     q->last_pkt = NULL;
     q->first_pkt = NULL;
+    q->nb_packets = 0;
+    q->size = 0;
+}
+
+void packet_queue_destroy(PacketQueue* q) {
+    AVPacketList* pkt;
+    AVPacketList* pktl;
+    packet_queue_flush(q);
+    for (pkt = q->free_pkt; pkt != NULL; pkt = pktl) {
+        pktl = pkt->next;
+        av_free(pkt);
+    }
+    q->free_pkt = NULL;
 }
 
@@ -11,11 +11,20 @@
 typedef struct PacketQueue {
     AVPacketList* first_pkt;
     AVPacketList* last_pkt;
+    int nb_packets;
+    int size;       // Bytes of packet data queued
+    // Nodes of packets already read, reused so a steady stream of
+    // packets doesn't allocate new nodes
+    AVPacketList* free_pkt;
+    int64_t nodes_allocated;
 } PacketQueue;
 
 RAWMEDIA_LOCAL void packet_queue_init(PacketQueue* q);
 RAWMEDIA_LOCAL int packet_queue_put(PacketQueue* q, AVPacket* pkt);
 RAWMEDIA_LOCAL int packet_queue_get(PacketQueue* q, AVPacket* pkt);
+// Discard queued packets, keeping their nodes for reuse
 RAWMEDIA_LOCAL void packet_queue_flush(PacketQueue* q);
+// Discard queued packets and free all nodes
+RAWMEDIA_LOCAL void packet_queue_destroy(PacketQueue* q);
 
 #endif
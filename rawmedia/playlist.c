@@ -0,0 +1,279 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+
+typedef struct PlaylistEntry {
+    char* filename;
+    int in_frame;
+    int out_frame;
+    int length;             // Frames presented from this entry, -1 until known
+    RawMediaDecoder* rmd;   // NULL if not open
+    // Background open of rmd
+    pthread_t opener;
+    bool opening;
+} PlaylistEntry;
+
+// Position of a stream within the playlist
+typedef struct PlaylistStream {
+    int entry;
+    int frame;              // Frame within entry
+    bool started;           // Decoded from, so holds its entry open
+} PlaylistStream;
+
+typedef struct Playlist {
+    RawMediaSession session;
+    RawMediaDecoderConfig config;
+    PlaylistEntry* entries;
+    int entry_count;
+    PlaylistStream video;
+    PlaylistStream audio;
+    RawMediaDecoderStats closed_stats;  // Stats of entries already closed
+} Playlist;
+
+typedef struct OpenJob {
+    Playlist* playlist;
+    PlaylistEntry* entry;
+} OpenJob;
+
+static RawMediaDecoder* open_entry(Playlist* playlist, PlaylistEntry* entry) {
+    RawMediaDecoderConfig config = playlist->config;
+    config.start_frame = entry->in_frame;
+    config.reverse_cache_frames = 0;
+    return rawmedia_create_decoder(entry->filename, &playlist->session, &config);
+}
+
+static void* opener_thread(void* arg) {
+    OpenJob* job = arg;
+    job->entry->rmd = open_entry(job->playlist, job->entry);
+    av_free(job);
+    return NULL;
+}
+
+static void set_length(PlaylistEntry* entry) {
+    int duration = rawmedia_get_decoder_info(entry->rmd)->duration;
+    entry->length = entry->out_frame > 0
+        ? entry->out_frame - entry->in_frame
+        : duration;
+}
+
+// Start opening entry index in the background, so it is
+// probed and seeked to in_frame before it is needed
+static void prefetch(Playlist* playlist, int index) {
+    if (index >= playlist->entry_count)
+        return;
+    PlaylistEntry* entry = &playlist->entries[index];
+    // The opener thread writes rmd, so only read it once joined
+    if (entry->opening || entry->rmd)
+        return;
+    OpenJob* job = av_malloc(sizeof(OpenJob));
+    if (!job)
+        return;
+    job->playlist = playlist;
+    job->entry = entry;
+    // If the thread can't be created, the entry is opened when needed
+    if (pthread_create(&entry->opener, NULL, opener_thread, job) == 0)
+        entry->opening = true;
+    else
+        av_free(job);
+}
+
+static void join_opener(PlaylistEntry* entry) {
+    if (entry->opening) {
+        pthread_join(entry->opener, NULL);
+        entry->opening = false;
+    }
+}
+
+static RawMediaDecoder* ensure_open(Playlist* playlist, int index) {
+    PlaylistEntry* entry = &playlist->entries[index];
+    join_opener(entry);
+    if (!entry->rmd) {
+        if (!(entry->rmd = open_entry(playlist, entry))) {
+            av_log(NULL, AV_LOG_ERROR, "%s: failed to open playlist entry %d\n",
+                   entry->filename, index);
+            return NULL;
+        }
+    }
+    if (entry->length < 0)
+        set_length(entry);
+    return entry->rmd;
+}
+
+static void close_entry(Playlist* playlist, PlaylistEntry* entry) {
+    RawMediaDecoderStats stats;
+    rawmedia_get_decoder_stats(entry->rmd, &stats);
+    decoder_stats_add(&playlist->closed_stats, &stats);
+    rawmedia_destroy_decoder(entry->rmd);
+    entry->rmd = NULL;
+}
+
+// Close entries every stream being decoded has finished with.
+// Streams that are discarded, or never decoded by the caller, don't keep
+// entries open. If such a stream is decoded later, its entries are reopened.
+static void release_entries(Playlist* playlist) {
+    int done = playlist->entry_count;
+    if (playlist->video.started)
+        done = FFMIN(done, playlist->video.entry);
+    if (playlist->audio.started)
+        done = FFMIN(done, playlist->audio.entry);
+    for (int i = 0; i < done && i < playlist->entry_count; i++) {
+        PlaylistEntry* entry = &playlist->entries[i];
+        join_opener(entry);
+        if (entry->rmd)
+            close_entry(playlist, entry);
+    }
+}
+
+// Set *entry to the entry containing the next frame of stream,
+// NULL at the end of the playlist. Returns <0 on error.
+static int stream_entry(Playlist* playlist, PlaylistStream* stream, PlaylistEntry** entry) {
+    *entry = NULL;
+    stream->started = true;
+    while (stream->entry < playlist->entry_count) {
+        if (!ensure_open(playlist, stream->entry))
+            return -1;
+        PlaylistEntry* current = &playlist->entries[stream->entry];
+        if (stream->frame < current->length) {
+            prefetch(playlist, stream->entry + 1);
+            *entry = current;
+            return 0;
+        }
+        stream->entry++;
+        stream->frame = 0;
+        release_entries(playlist);
+    }
+    return 0;
+}
+
+static int playlist_decode_video(void* opaque, uint8_t** output, int* width, int* height, int* outputsize) {
+    Playlist* playlist = opaque;
+    PlaylistEntry* entry;
+    if (output) {
+        *width = *height = *outputsize = 0;
+        *output = NULL;
+    }
+    int r = stream_entry(playlist, &playlist->video, &entry);
+    if (r < 0 || !entry)
+        return r;
+    playlist->video.frame++;
+    if (!rawmedia_get_decoder_info(entry->rmd)->has_video)
+        return 0;
+    // Returns 0 with the last frame if the entry is shorter than its length
+    return rawmedia_decode_video(entry->rmd, output, width, height, outputsize);
+}
+
+static int playlist_decode_audio(void* opaque, uint8_t* output) {
+    Playlist* playlist = opaque;
+    PlaylistEntry* entry;
+    int r = stream_entry(playlist, &playlist->audio, &entry);
+    if (r < 0)
+        return r;
+    if (entry) {
+        playlist->audio.frame++;
+        // Each entry outputs exactly length frames of audio,
+        // so transitions are sample accurate
+        if (rawmedia_get_decoder_info(entry->rmd)->has_audio)
+            return rawmedia_decode_audio(entry->rmd, output);
+    }
+    if (output)
+        memset(output, RAWMEDIA_AUDIO_SILENCE, playlist->session.audio_framebuffer_size);
+    return 0;
+}
+
+static void playlist_get_stats(void* opaque, RawMediaDecoderStats* stats) {
+    Playlist* playlist = opaque;
+    *stats = playlist->closed_stats;
+    // Entries still opening in the background are not included
+    for (int i = 0; i < playlist->entry_count; i++) {
+        PlaylistEntry* entry = &playlist->entries[i];
+        if (!entry->opening && entry->rmd) {
+            RawMediaDecoderStats entry_stats;
+            rawmedia_get_decoder_stats(entry->rmd, &entry_stats);
+            decoder_stats_add(stats, &entry_stats);
+        }
+    }
+}
+
+static void playlist_destroy(void* opaque) {
+    Playlist* playlist = opaque;
+    if (!playlist)
+        return;
+    for (int i = 0; playlist->entries && i < playlist->entry_count; i++) {
+        PlaylistEntry* entry = &playlist->entries[i];
+        join_opener(entry);
+        rawmedia_destroy_decoder(entry->rmd);
+        av_free(entry->filename);
+    }
+    av_free(playlist->entries);
+    av_free(playlist);
+}
+
+static const DecoderBackend playlist_backend = {
+    .decode_video = playlist_decode_video,
+    .decode_audio = playlist_decode_audio,
+    .destroy = playlist_destroy,
+    .get_stats = playlist_get_stats,
+};
+
+RawMediaDecoder* rawmedia_create_playlist_decoder(const RawMediaPlaylistEntry* entries, int entry_count, const RawMediaSession* session, const RawMediaDecoderConfig* config) {
+    RawMediaDecoderInfo info = { 0 };
+    if (entry_count <= 0)
+        return NULL;
+    if (config->output_count || config->crop_width || config->crop_height) {
+        av_log(NULL, AV_LOG_ERROR, "playlist decoders don't support crop or multiple outputs\n");
+        return NULL;
+    }
+
+    Playlist* playlist = av_mallocz(sizeof(Playlist));
+    if (!playlist)
+        return NULL;
+    playlist->session = *session;
+    playlist->config = *config;
+    if (!(playlist->entries = av_mallocz(entry_count * sizeof(PlaylistEntry))))
+        goto error;
+    playlist->entry_count = entry_count;
+
+    for (int i = 0; i < entry_count; i++) {
+        PlaylistEntry* entry = &playlist->entries[i];
+        if (!(entry->filename = av_strdup(entries[i].filename)))
+            goto error;
+        entry->in_frame = FFMAX(entries[i].in_frame, 0);
+        entry->out_frame = entries[i].out_frame;
+        entry->length = entry->out_frame > 0
+            ? FFMAX(entry->out_frame - entry->in_frame, 0)
+            : -1;
+    }
+
+    // The first entry is needed immediately. Entries without an out_frame
+    // have to be opened to find their duration.
+    for (int i = 0; i < entry_count; i++) {
+        PlaylistEntry* entry = &playlist->entries[i];
+        if (i > 0 && entry->length >= 0)
+            continue;
+        if (!ensure_open(playlist, i))
+            goto error;
+        if (i > 0)
+            close_entry(playlist, entry);
+    }
+    for (int i = 0; i < entry_count; i++)
+        info.duration += playlist->entries[i].length;
+    // Entries missing a stream output no video frames or silence
+    info.has_video = !config->discard_video;
+    info.has_audio = !config->discard_audio && config->volume > 0;
+
+    RawMediaDecoder* rmd = decoder_create_backend(&playlist_backend, playlist, &info);
+    if (!rmd)
+        goto error;
+    // Start opening the second entry now, instead of at the first frame
+    prefetch(playlist, 1);
+    return rmd;
+
+error:
+    playlist_destroy(playlist);
+    return NULL;
+}
@@ -1,17 +1,49 @@
 // Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
 // Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
 
+#include <pthread.h>
 #include "rawmedia.h"
 #include "rawmedia_internal.h"
+#include "audio_mix.h"
+#include "video_blend.h"
+#include "video_convert.h"
+#include "waveform.h"
 #include <libavformat/avformat.h>
 #include <libavfilter/avfilter.h>
 #include <libavutil/log.h>
-#include <math.h>
+
+// Lets codecs be opened and closed from several threads
+static int lock_manager(void** mutex, enum AVLockOp op) {
+    switch (op) {
+    case AV_LOCK_CREATE:
+        if (!(*mutex = av_malloc(sizeof(pthread_mutex_t))))
+            return 1;
+        if (pthread_mutex_init(*mutex, NULL)) {
+            av_freep(mutex);
+            return 1;
+        }
+        return 0;
+    case AV_LOCK_OBTAIN:
+        return !!pthread_mutex_lock(*mutex);
+    case AV_LOCK_RELEASE:
+        return !!pthread_mutex_unlock(*mutex);
+    case AV_LOCK_DESTROY:
+        pthread_mutex_destroy(*mutex);
+        av_freep(mutex);
+        return 0;
+    }
+    return 1;
+}
 
 void rawmedia_init() {
+    av_lockmgr_register(lock_manager);
     av_register_all();
     avfilter_register_all();
     av_log_set_flags(AV_LOG_SKIP_REPEATED);
+    audio_mix_init();
+    video_blend_init();
+    video_convert_init();
+    waveform_init();
 }
 
 int rawmedia_init_session(RawMediaSession* session) {
@@ -34,11 +66,19 @@ int rawmedia_init_session(RawMediaSession* session) {
     return 0;
 }
 
-static inline RAWMEDIA_AUDIO_DATATYPE clamp(float value) {
-    int sample = lrintf(value);
-    return (sample > RAWMEDIA_AUDIO_SAMPLE_MAX ? RAWMEDIA_AUDIO_SAMPLE_MAX :
-            sample < RAWMEDIA_AUDIO_SAMPLE_MIN ? RAWMEDIA_AUDIO_SAMPLE_MIN :
-            (RAWMEDIA_AUDIO_DATATYPE)sample);
+// Mixes of up to this many buffers keep their inputs on the stack.
+// buffer_count comes from the caller, so larger mixes allocate them.
+#define MIX_STACK_INPUTS 64
+
+// Allocate count elements of size for a mix with more than
+// MIX_STACK_INPUTS buffers, logging and silencing output on failure
+static void* alloc_mix_inputs(const RawMediaSession* session, int count, size_t size, uint8_t* output) {
+    void* inputs = av_malloc(count * size);
+    if (!inputs) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to allocate %d audio mix inputs\n", count);
+        memset(output, RAWMEDIA_AUDIO_SILENCE, session->audio_framebuffer_size);
+    }
+    return inputs;
 }
 
 // Mix an array of buffers into output.
@@ -46,59 +86,117 @@ static inline RAWMEDIA_AUDIO_DATATYPE clamp(float value) {
 // Input buffers may be NULL.
 void rawmedia_mix_audio(const RawMediaSession* session, const uint8_t* const* buffers, int buffer_count, uint8_t* output) {
     int nb_samples = session->audio_framebuffer_size / sizeof(RAWMEDIA_AUDIO_DATATYPE);
-    const RAWMEDIA_AUDIO_DATATYPE* const* buffers_ = (const RAWMEDIA_AUDIO_DATATYPE* const*)buffers;
-    RAWMEDIA_AUDIO_DATATYPE* output_ = (RAWMEDIA_AUDIO_DATATYPE*)output;
+    const RAWMEDIA_AUDIO_DATATYPE* stack_inputs[MIX_STACK_INPUTS];
+    const RAWMEDIA_AUDIO_DATATYPE** inputs = stack_inputs;
+    int input_count = 0;
 
-    for (int s = 0; s < nb_samples; s++) {
-        float sample = 0.0;
-        for (int b = 0; b < buffer_count; b++) {
-            if (buffers_[b])
-                sample += buffers_[b][s];
-        }
-        output_[s] = clamp(sample);
+    if (buffer_count > MIX_STACK_INPUTS
+        && !(inputs = alloc_mix_inputs(session, buffer_count, sizeof(*inputs), output)))
+        return;
+
+    // Compact out NULL buffers so the mix loop doesn't test for them
+    for (int b = 0; b < buffer_count; b++) {
+        if (buffers[b])
+            inputs[input_count++] = (const RAWMEDIA_AUDIO_DATATYPE*)buffers[b];
     }
+    if (!input_count)
+        memset(output, RAWMEDIA_AUDIO_SILENCE, session->audio_framebuffer_size);
+    else
+        audio_mix_s16(inputs, input_count, nb_samples,
+                      (RAWMEDIA_AUDIO_DATATYPE*)output);
+    if (inputs != stack_inputs)
+        av_free(inputs);
 }
 
-static void (*s_user_log_callback)(const char*) = NULL;
-static int s_log_level = AV_LOG_INFO;
+// Samples mixed at a time, small enough that the accumulator stays in cache
+#define MIX_BLOCK_SAMPLES 1024
+
+// Mix an array of buffers into output, applying per buffer gain and pan.
+// gains may be NULL for unity gain, pans may be NULL for center.
+void rawmedia_mix_audio_weighted(const RawMediaSession* session, const uint8_t* const* buffers, const RawMediaMixGain* gains, const float* pans, int buffer_count, uint8_t* output) {
+    int nb_samples = session->audio_framebuffer_size / sizeof(RAWMEDIA_AUDIO_DATATYPE);
+    int nb_channels = av_get_channel_layout_nb_channels(RAWMEDIA_AUDIO_CHANNEL_LAYOUT);
+    int nb_frames = nb_samples / nb_channels;
+    MixInput stack_inputs[MIX_STACK_INPUTS];
+    MixInput* inputs = stack_inputs;
+    int input_count = 0;
+    float acc[MIX_BLOCK_SAMPLES];
+
+    if (buffer_count > MIX_STACK_INPUTS
+        && !(inputs = alloc_mix_inputs(session, buffer_count, sizeof(*inputs), output)))
+        return;
 
-static void sanitize(uint8_t *line){
-    while (*line) {
-        if (*line < 0x08 || (*line > 0x0D && *line < 0x20))
-            *line='?';
-        line++;
+    for (int b = 0; b < buffer_count; b++) {
+        if (!buffers[b])
+            continue;
+        if (audio_mix_input_init(&inputs[input_count],
+                                 (const RAWMEDIA_AUDIO_DATATYPE*)buffers[b],
+                                 gains ? &gains[b] : NULL,
+                                 pans ? pans[b] : 0, nb_frames))
+            input_count++;
     }
+
+    RAWMEDIA_AUDIO_DATATYPE* output_ = (RAWMEDIA_AUDIO_DATATYPE*)output;
+    for (int start = 0; start < nb_samples; start += MIX_BLOCK_SAMPLES) {
+        int count = FFMIN(MIX_BLOCK_SAMPLES, nb_samples - start);
+        memset(acc, 0, count * sizeof(float));
+        for (int i = 0; i < input_count; i++)
+            audio_mix_accumulate(acc, &inputs[i], start, count);
+        audio_mix_store_s16(acc, count, &output_[start]);
+    }
+    if (inputs != stack_inputs)
+        av_free(inputs);
 }
 
-static void redirector_log_callback(void* ptr, int level, const char* fmt, va_list vl) {
-    static int print_prefix = 1;
-    static int count;
-    static char prev[1024];
-    char line[1024];
+static ThreadPool* s_video_pool = NULL;
+static int s_video_threads = 0;
 
-    if (level > s_log_level)
-        return;
-    av_log_format_line(ptr, level, fmt, vl, line, sizeof(line), &print_prefix);
-
-    // Implement AV_LOG_SKIP_REPEATED
-    if (print_prefix && !strcmp(line, prev)){
-        count++;
-        return;
+int rawmedia_set_video_threads(int nthreads) {
+    if (nthreads < 0)
+        return -1;
+    thread_pool_destroy(s_video_pool);
+    s_video_pool = NULL;
+    s_video_threads = 0;
+    if (nthreads > 0) {
+        if (!(s_video_pool = thread_pool_create(nthreads))) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to create video thread pool\n");
+            return -1;
+        }
+        s_video_threads = nthreads;
     }
-    if (count > 0) {
-        snprintf(line, sizeof(line), "    Last message repeated %d times\n", count);
-        s_user_log_callback(line);
-        count = 0;
+    return 0;
+}
+
+bool video_frame_valid(const RawMediaVideoFrame* frame, int bytes_per_pixel) {
+    if (!frame->data || frame->width <= 0 || frame->height <= 0 || frame->width % 2
+        || video_frame_linesize(frame, bytes_per_pixel) < frame->width * bytes_per_pixel) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid video frame %dx%d\n",
+               frame->width, frame->height);
+        return false;
     }
-    strcpy(prev, line);
-    sanitize((uint8_t*)line);
-    s_user_log_callback(line);
+    return true;
 }
 
-void rawmedia_set_log(int level, void (*callback)(const char*)) {
-    s_log_level = level;
-    av_log_set_level(level);
-    s_user_log_callback = callback;
-    av_log_set_callback(callback ? redirector_log_callback : av_log_default_callback);
+// Don't split frames smaller than this across threads
+#define MIN_THREADED_BYTES (64 * 1024)
+
+typedef struct RowsJob {
+    VideoRowsFunc func;
+    void* arg;
+    int height;
+    int nb_bands;       // Horizontal bands rows are split into
+} RowsJob;
+
+static void execute_band(void* arg, int index) {
+    RowsJob* job = arg;
+    job->func(job->arg,
+              job->height * index / job->nb_bands,
+              job->height * (index + 1) / job->nb_bands);
 }
 
+void video_execute_rows(VideoRowsFunc func, void* arg, int height, int row_bytes) {
+    RowsJob job = { .func = func, .arg = arg, .height = height, .nb_bands = 1 };
+    if (s_video_pool && (int64_t)row_bytes * height >= MIN_THREADED_BYTES)
+        job.nb_bands = FFMIN(height, s_video_threads + 1);
+    thread_pool_execute(s_video_pool, execute_band, &job, job.nb_bands);
+}
@@ -24,7 +24,53 @@ typedef struct RawMediaSession {
     int audio_framebuffer_size;
 } RawMediaSession;
 
+// Gain for rawmedia_mix_audio_weighted, linearly ramped from start
+// to end across the buffer. Linear 0..1, may be >1 to boost.
+typedef struct RawMediaMixGain {
+    float start;
+    float end;
+} RawMediaMixGain;
+
+// Accumulates audio buffers one at a time, see rawmedia_create_mix_bus
+typedef struct RawMediaMixBus RawMediaMixBus;
+
+// A UYVY422 video frame, as returned by rawmedia_decode_video,
+// or a BGRA/RGBA frame for the conversion functions.
+// linesize is the byte length of a row, 0 for unpadded rows.
+typedef struct RawMediaVideoFrame {
+    uint8_t* data;
+    int linesize;
+    int width;
+    int height;
+} RawMediaVideoFrame;
+
+enum RawMediaColorMatrix {
+    RAWMEDIA_COLOR_BT601 = 0,
+    RAWMEDIA_COLOR_BT709 = 1,
+};
+
+// YUV colorspace and RGB layout for the conversion functions
+typedef struct RawMediaColorSpace {
+    int matrix;         // RawMediaColorMatrix
+    bool full_range;    // YUV is 0..255 instead of 16..235/240
+    bool rgba;          // RGBA byte order instead of BGRA
+} RawMediaColorSpace;
+
 typedef struct RawMediaDecoder RawMediaDecoder;
+typedef struct RawMediaDecoderOpen RawMediaDecoderOpen;
+
+typedef struct RawMediaPlaylistEntry {
+    const char* filename;
+    int in_frame;       // First frame
+    int out_frame;      // Frame after the last, <=0 for the end of the file
+} RawMediaPlaylistEntry;
+
+#define RAWMEDIA_MAX_VIDEO_OUTPUTS 4
+
+typedef struct RawMediaVideoBounds {
+    int max_width;
+    int max_height;
+} RawMediaVideoBounds;
 
 typedef struct RawMediaDecoderConfig {
     // Video will be scaled to fit within these bounds
@@ -39,6 +85,34 @@ typedef struct RawMediaDecoderConfig {
 
     bool discard_video;
     bool discard_audio;
+
+    // Reach start_frame by seeking to the preceding keyframe and decoding
+    // from there, instead of decoding from the start of the file.
+    bool keyframe_seek;
+
+    // Output exactly max_width x max_height frames, with the scaled video
+    // centered on a background_color (0xRRGGBB) border.
+    bool letterbox;
+    uint32_t background_color;
+
+    // Region of the source video to decode, in source pixels, applied
+    // before scaling. Scaling then fits the cropped region to max_width
+    // and max_height. crop_width or crop_height 0 to decode the whole frame.
+    int crop_x;
+    int crop_y;
+    int crop_width;
+    int crop_height;
+
+    // Additional video outputs, retrieved with rawmedia_decode_video_output
+    // using index 1..output_count. These are scaled down from the primary
+    // output, so should be no larger than max_width x max_height.
+    int output_count;
+    RawMediaVideoBounds outputs[RAWMEDIA_MAX_VIDEO_OUTPUTS];
+
+    // Recently decoded frames of the primary output kept for
+    // rawmedia_decode_video_at, 0 for none. At least the source GOP
+    // length, so reverse playback decodes each GOP once.
+    int reverse_cache_frames;
 } RawMediaDecoderConfig;
 
 typedef struct RawMediaDecoderInfo {
@@ -48,6 +122,36 @@ typedef struct RawMediaDecoderInfo {
     bool has_audio;
 } RawMediaDecoderInfo;
 
+// Cumulative decoder counters, see rawmedia_get_decoder_stats.
+// Times are only collected while rawmedia_set_stats_enabled is on.
+typedef struct RawMediaDecoderStats {
+    int64_t read_ns;                // Reading packets from the file
+    int64_t video_decode_ns;
+    int64_t video_filter_ns;        // Scaling, cropping and letterboxing
+    int64_t audio_decode_ns;
+    int64_t audio_filter_ns;        // Resampling
+    int64_t audio_copy_ns;          // Copying samples to the output buffer
+    int64_t frames_decoded;         // Video frames decoded
+    int64_t frames_dropped;         // Decoded video frames skipped to keep framerate
+    int64_t packets_read;
+    int64_t bytes_read;
+    int64_t queue_peak_packets;     // Peak packets queued for the other stream
+    int64_t queue_peak_bytes;
+    // Packet queue nodes allocated. Nodes are reused, so this stops growing
+    // once the queues reach their working depth. Packet data, decoded frames
+    // and filter buffers are allocated by libav* and are not counted.
+    int64_t queue_nodes_allocated;
+} RawMediaDecoderStats;
+
+// Counters of the shared frame cache, see rawmedia_set_frame_cache_size
+typedef struct RawMediaFrameCacheStats {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t entries;                // Frames currently cached
+    int64_t bytes;                  // Size of the cached frames
+} RawMediaFrameCacheStats;
+
 typedef struct RawMediaEncoder RawMediaEncoder;
 
 typedef struct RawMediaEncoderConfig {
@@ -55,25 +159,270 @@ typedef struct RawMediaEncoderConfig {
     int height;
     bool has_video;
     bool has_audio;
+
+    // If >0, write a fragmented MOV with a new fragment every fragment_frames
+    // frames. The output is then readable while it is still being written,
+    // and can be written to a non-seekable output (e.g. "pipe:1").
+    int fragment_frames;
 } RawMediaEncoderConfig;
 
+// Cumulative encoder counters, see rawmedia_get_encoder_stats.
+// Times are only collected while rawmedia_set_stats_enabled is on.
+typedef struct RawMediaEncoderStats {
+    int64_t video_encode_ns;
+    int64_t audio_encode_ns;
+    int64_t mux_ns;                 // Interleaving and writing packets
+    int64_t video_frames;
+    int64_t audio_frames;
+    int64_t packets_written;
+    int64_t bytes_written;
+} RawMediaEncoderStats;
+
+// Output callbacks for rawmedia_create_encoder_io
+typedef struct RawMediaEncoderIO {
+    void* opaque;
+
+    // Write size bytes from buf. Return number of bytes written, <0 on error.
+    int (*write)(void* opaque, const uint8_t* buf, int size);
+
+    // Optional, may be NULL. whence is SEEK_SET, SEEK_CUR or SEEK_END.
+    // Return the new position, <0 on error.
+    // If NULL the output is treated as a stream and a fragmented MOV
+    // is written.
+    int64_t (*seek)(void* opaque, int64_t offset, int whence);
+} RawMediaEncoderIO;
+
+// Segmenting options for rawmedia_create_segmented_encoder.
+// Each segment is a complete MOV file. Timestamps continue across segments.
+typedef struct RawMediaSegmentConfig {
+    // Start a new segment after this many frames, 0 for no limit
+    int segment_frames;
+    // Start a new segment once a segment reaches this many bytes, 0 for no limit
+    int64_t segment_bytes;
+
+    // Optional, called after each segment file is closed,
+    // including the final segment in rawmedia_destroy_encoder.
+    void (*closed)(void* opaque, const char* filename, int index, int start_frame, int frame_count);
+    void* opaque;
+} RawMediaSegmentConfig;
+
+typedef struct RawMediaFanoutEncoder RawMediaFanoutEncoder;
+
+typedef struct RawMediaTimeline RawMediaTimeline;
+
+typedef struct RawMediaTimelineConfig {
+    // Size of the composited UYVY422 output, 0 to only mix audio
+    // (sources are then available with rawmedia_timeline_get_source_video)
+    int width;
+    int height;
+    // Frames decoded ahead of the frame being rendered, <=0 for the default (4)
+    int lookahead;
+    // Decoding threads, <=0 for one per CPU
+    int nthreads;
+} RawMediaTimelineConfig;
+
+// A rendered frame, valid until the next rawmedia_timeline_render_frame
+typedef struct RawMediaTimelineFrame {
+    int frame;
+    RawMediaVideoFrame video;   // data NULL if not compositing
+    const uint8_t* audio;       // Size indicated in RawMediaSession
+} RawMediaTimelineFrame;
+
+typedef struct RawMediaFanoutOutput {
+    const char* filename;
+    // Video is scaled from the fanout input size to config width/height
+    RawMediaEncoderConfig config;
+} RawMediaFanoutOutput;
+
 
 RAWMEDIA_EXPORT void rawmedia_init();
+// Lines from decoders are prefixed with a decoder id and filename tag.
+// Repeated lines are suppressed per thread.
 RAWMEDIA_EXPORT void rawmedia_set_log(int level, void (*callback)(const char*));
+// If async, lines are queued to a lock free ring and the callback is
+// called on a separate thread, so logging never blocks decoding.
+// Lines are dropped if the ring is full.
+RAWMEDIA_EXPORT int rawmedia_set_log_async(bool async);
+// Deliver lines queued for the async log callback on the calling thread
+RAWMEDIA_EXPORT void rawmedia_flush_log(void);
+// Enable timing of decoder and encoder stages. Disabled by default,
+// as it reads the clock several times per frame.
+RAWMEDIA_EXPORT void rawmedia_set_stats_enabled(bool enabled);
 RAWMEDIA_EXPORT int rawmedia_init_session(RawMediaSession* session);
 RAWMEDIA_EXPORT void rawmedia_mix_audio(const RawMediaSession* session, const uint8_t* const* buffers, int buffer_count, uint8_t* output);
+// gains and pans are arrays of buffer_count elements, or NULL.
+// pans are -1 (left) .. 1 (right), 0 is center.
+RAWMEDIA_EXPORT void rawmedia_mix_audio_weighted(const RawMediaSession* session, const uint8_t* const* buffers, const RawMediaMixGain* gains, const float* pans, int buffer_count, uint8_t* output);
+
+// A mix bus sums buffers into an internal float accumulator as they are added,
+// so only the buffer being added needs to be live. Bracket each audio frame
+// with rawmedia_mix_bus_begin and rawmedia_mix_bus_finish.
+// A bus may be mixed into another bus, so submixes can be built on
+// separate threads. A single bus must not be used from several threads at once.
+RAWMEDIA_EXPORT RawMediaMixBus* rawmedia_create_mix_bus(const RawMediaSession* session);
+RAWMEDIA_EXPORT void rawmedia_mix_bus_begin(RawMediaMixBus* bus);
+// buffer must be the size indicated in RawMediaSession.
+// gain may be NULL for unity, pan is -1 (left) .. 1 (right).
+RAWMEDIA_EXPORT void rawmedia_mix_bus_add(RawMediaMixBus* bus, const uint8_t* buffer, const RawMediaMixGain* gain, float pan);
+// Add the current contents of submix, scaled by gain
+RAWMEDIA_EXPORT void rawmedia_mix_bus_add_bus(RawMediaMixBus* bus, const RawMediaMixBus* submix, float gain);
+// output must be the size indicated in RawMediaSession
+RAWMEDIA_EXPORT void rawmedia_mix_bus_finish(RawMediaMixBus* bus, uint8_t* output);
+RAWMEDIA_EXPORT void rawmedia_destroy_mix_bus(RawMediaMixBus* bus);
+
+// Number of threads video processing (e.g. blending) may split rows across,
+// 0 (the default) to process on the calling thread.
+// Must not be called while video is being processed.
+RAWMEDIA_EXPORT int rawmedia_set_video_threads(int nthreads);
+// Crossfade, output = a * (1 - alpha) + b * alpha.
+// a, b and output must be the same size, output may be a or b.
+RAWMEDIA_EXPORT int rawmedia_blend_video(const RawMediaVideoFrame* a, const RawMediaVideoFrame* b, float alpha, const RawMediaVideoFrame* output);
+// Copy src to dst, which must be the same size. Linesizes may differ.
+RAWMEDIA_EXPORT int rawmedia_copy_video(const RawMediaVideoFrame* src, const RawMediaVideoFrame* dst);
+// Composite src over dst in place with top left corner at x, y and
+// constant opacity. src is clipped to dst, x is rounded down to even
+// so chroma pairs stay aligned.
+RAWMEDIA_EXPORT int rawmedia_overlay_video(const RawMediaVideoFrame* dst, const RawMediaVideoFrame* src, int x, int y, float opacity);
+
+// Convert between UYVY422 and 32 bit RGB, alpha is set to 255 and ignored.
+// src and dst must be the same size. color may be NULL for BT.601
+// limited range BGRA. Rows are split across rawmedia_set_video_threads.
+RAWMEDIA_EXPORT int rawmedia_convert_uyvy_to_bgra(const RawMediaVideoFrame* src, const RawMediaVideoFrame* dst, const RawMediaColorSpace* color);
+RAWMEDIA_EXPORT int rawmedia_convert_bgra_to_uyvy(const RawMediaVideoFrame* src, const RawMediaVideoFrame* dst, const RawMediaColorSpace* color);
 
 RAWMEDIA_EXPORT RawMediaDecoder* rawmedia_create_decoder(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config);
+// Start rawmedia_create_decoder on a library worker thread, so several
+// files can be opened in parallel. The handle must be passed to
+// rawmedia_finish_decoder_open, which frees it.
+RAWMEDIA_EXPORT RawMediaDecoderOpen* rawmedia_create_decoder_async(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config);
+// Returns 1 if the open has finished, 0 if still in progress.
+RAWMEDIA_EXPORT int rawmedia_poll_decoder_open(RawMediaDecoderOpen* open);
+// Wait up to timeout_ms (<0 for no timeout) for the open to finish.
+// Returns 1 if finished, 0 on timeout.
+RAWMEDIA_EXPORT int rawmedia_wait_decoder_open(RawMediaDecoderOpen* open, int timeout_ms);
+// Abort the open, interrupting any I/O in progress.
+// The open still has to be finished.
+RAWMEDIA_EXPORT void rawmedia_cancel_decoder_open(RawMediaDecoderOpen* open);
+// Wait for the open to finish and free open. Returns the decoder,
+// or NULL if the open failed or was cancelled.
+RAWMEDIA_EXPORT RawMediaDecoder* rawmedia_finish_decoder_open(RawMediaDecoderOpen* open);
+// Decodes entries back to back as a single stream, using the normal
+// decoder functions. Each entry is opened and seeked to in_frame in the
+// background before it is reached. Each entry outputs exactly
+// out_frame - in_frame frames of video and audio, padded if the file
+// is shorter. Entries without an out_frame are opened on creation
+// to find their duration.
+// config start_frame is ignored. Crop and multiple outputs are not
+// supported, no decoder is created if they are set.
+RAWMEDIA_EXPORT RawMediaDecoder* rawmedia_create_playlist_decoder(const RawMediaPlaylistEntry* entries, int entry_count, const RawMediaSession* session, const RawMediaDecoderConfig* config);
 RAWMEDIA_EXPORT const RawMediaDecoderInfo* rawmedia_get_decoder_info(const RawMediaDecoder* rmd);
 RAWMEDIA_EXPORT int rawmedia_decode_video(RawMediaDecoder* rmd, uint8_t** output, int* width, int* height, int* outputsize);
+// Get output index of the frame last decoded by rawmedia_decode_video,
+// index 0 is the primary output.
+RAWMEDIA_EXPORT int rawmedia_decode_video_output(RawMediaDecoder* rmd, int index, uint8_t** output, int* width, int* height, int* outputsize);
+// Decode video frame (counted from start_frame, as for duration) in any
+// order. Frames behind the decoder are served from the reverse cache, or
+// decoded again from the preceding keyframe, caching the frames before
+// frame so stepping back continues from the cache. Only the primary
+// output is cached, so decoders with additional outputs always decode.
+// rawmedia_decode_video then continues from frame + 1, and
+// rawmedia_decode_audio from frame, whether frame was cached or decoded.
+// For decoders with audio, the decoder seeks when decoding continues
+// after a cached frame.
+// Returns 1 if output is frame, 0 if frame is past the end.
+RAWMEDIA_EXPORT int rawmedia_decode_video_at(RawMediaDecoder* rmd, int frame, uint8_t** output, int* width, int* height, int* outputsize);
+// Change the crop region for subsequent frames (e.g. for an animated pan).
+// Changing the region rebuilds the scaler, so only call when it changes.
+RAWMEDIA_EXPORT int rawmedia_set_decoder_crop(RawMediaDecoder* rmd, int x, int y, int width, int height);
 // output must be the size indicated in RawMediaSession
 RAWMEDIA_EXPORT int rawmedia_decode_audio(RawMediaDecoder* rmd, uint8_t* output);
+// Copy the counters accumulated since rmd was created into stats.
+// Playlist decoders report the sum over their entries closed so far
+// and the current entries.
+RAWMEDIA_EXPORT int rawmedia_get_decoder_stats(const RawMediaDecoder* rmd, RawMediaDecoderStats* stats);
 RAWMEDIA_EXPORT int rawmedia_destroy_decoder(RawMediaDecoder* rmd);
+// Limit of the process wide cache of decoded primary output frames,
+// shared by all decoders, 0 (the default) to disable and empty it.
+// Frames are keyed by file, output size, letterbox and crop, and frame.
+// Decoders without audio or additional outputs add the frames they decode
+// to the cache, and rawmedia_decode_video then only decodes on a miss.
+// rawmedia_decode_video_at also looks frames up for decoders with audio.
+RAWMEDIA_EXPORT void rawmedia_set_frame_cache_size(int64_t max_bytes);
+RAWMEDIA_EXPORT void rawmedia_get_frame_cache_stats(RawMediaFrameCacheStats* stats);
+// Decode the frames of rmd not read yet, up to its duration, into a frame
+// store at filename: an indexed file of page aligned UYVY frames and PCM
+// framebuffers that later passes can read without decoding. Video and
+// audio must have been read to the same frame. Returns <0 on error, and
+// no store is left behind.
+RAWMEDIA_EXPORT int rawmedia_write_frame_store(RawMediaDecoder* rmd, const RawMediaSession* session, const char* filename);
+// Decoder reading a frame store, which must have been written with the
+// same session framerate and audio framebuffer size. The store is mapped
+// into memory, rawmedia_decode_video outputs point into the mapping.
+RAWMEDIA_EXPORT RawMediaDecoder* rawmedia_create_frame_store_decoder(const char* filename, const RawMediaSession* session);
+
+// Waveform overview of the audio of filename, all channels combined.
+// Only the audio stream is demuxed and decoded, without resampling.
+// Each of bins gets the min and max (-1..1) and RMS of its span of the
+// file. Any of the output arrays may be NULL.
+RAWMEDIA_EXPORT int rawmedia_compute_waveform(const char* filename, int bins, float* out_min, float* out_max, float* out_rms);
+// Decode the audio of filename into a compact peak file, holding the
+// waveform at resolutions from 512 sample frames up to the whole file.
+RAWMEDIA_EXPORT int rawmedia_write_waveform_peaks(const char* filename, const char* peaks_filename);
+// Reduce [start, end) seconds of a peak file (end <= 0 for the end of
+// the file) to bins, as for rawmedia_compute_waveform, reading only the
+// coarsest resolution with at least one entry per bin.
+RAWMEDIA_EXPORT int rawmedia_read_waveform_peaks(const char* peaks_filename, double start, double end, int bins, float* out_min, float* out_max, float* out_rms);
 
 RAWMEDIA_EXPORT RawMediaEncoder* rawmedia_create_encoder(const char* filename, const RawMediaSession* session, const RawMediaEncoderConfig* config);
+RAWMEDIA_EXPORT RawMediaEncoder* rawmedia_create_encoder_io(const RawMediaEncoderIO* io, const RawMediaSession* session, const RawMediaEncoderConfig* config);
+// filename_template must contain a single %d (e.g. "output-%03d.mov")
+// which is replaced with the segment index.
+// Segments rotate on frame boundaries, so video and audio should be
+// encoded interleaved a frame at a time.
+RAWMEDIA_EXPORT RawMediaEncoder* rawmedia_create_segmented_encoder(const char* filename_template, const RawMediaSession* session, const RawMediaEncoderConfig* config, const RawMediaSegmentConfig* segment);
 RAWMEDIA_EXPORT int rawmedia_encode_video(RawMediaEncoder* rme, const uint8_t* input, int inputsize);
 // input must be the size indicated in RawMediaSession
 RAWMEDIA_EXPORT int rawmedia_encode_audio(RawMediaEncoder* rme, const uint8_t* input);
+RAWMEDIA_EXPORT int rawmedia_get_encoder_stats(const RawMediaEncoder* rme, RawMediaEncoderStats* stats);
 RAWMEDIA_EXPORT int rawmedia_destroy_encoder(RawMediaEncoder* rme);
 
+// Encodes the same input to several outputs, each encoded on its own thread.
+// width and height are the size of video passed to rawmedia_fanout_encode_video.
+RAWMEDIA_EXPORT RawMediaFanoutEncoder* rawmedia_create_fanout_encoder(const RawMediaFanoutOutput* outputs, int output_count, int width, int height, const RawMediaSession* session);
+RAWMEDIA_EXPORT int rawmedia_fanout_encode_video(RawMediaFanoutEncoder* rmfe, const uint8_t* input, int inputsize);
+// input must be the size indicated in RawMediaSession
+RAWMEDIA_EXPORT int rawmedia_fanout_encode_audio(RawMediaFanoutEncoder* rmfe, const uint8_t* input);
+RAWMEDIA_EXPORT int rawmedia_destroy_fanout_encoder(RawMediaFanoutEncoder* rmfe);
+
+// Renders several sources to a single stream, decoding all sources active
+// over the next lookahead frames in parallel on a work stealing pool.
+// Video is composited bottom layer first, each source centered on black,
+// and audio from all active sources is mixed.
+RAWMEDIA_EXPORT RawMediaTimeline* rawmedia_create_timeline(const RawMediaSession* session, const RawMediaTimelineConfig* config);
+// Add rmd on layer covering timeline frames [start_frame, end_frame).
+// end_frame <=0 to play to the end of rmd. Higher layers are on top.
+// On success the timeline owns rmd and destroys it when the source ends.
+// Returns the source index, <0 on error (the caller still owns rmd).
+// Sources must all be added before the first frame is rendered.
+RAWMEDIA_EXPORT int rawmedia_timeline_add_source(RawMediaTimeline* tl, RawMediaDecoder* rmd, int start_frame, int end_frame, int layer);
+// Frames up to the end of the last source
+RAWMEDIA_EXPORT int rawmedia_timeline_get_frame_count(const RawMediaTimeline* tl);
+// Returns 1 with the next frame, 0 after the last frame, <0 on error.
+RAWMEDIA_EXPORT int rawmedia_timeline_render_frame(RawMediaTimeline* tl, RawMediaTimelineFrame* frame);
+// Video of source index for the last rendered frame, valid until the next
+// rawmedia_timeline_render_frame. Returns 1 if the source has video
+// for the frame, 0 if not.
+RAWMEDIA_EXPORT int rawmedia_timeline_get_source_video(const RawMediaTimeline* tl, int index, RawMediaVideoFrame* video);
+// Render the remaining frames into rme, which must be configured with the
+// timeline width and height (or no video). Returns the number of frames encoded.
+RAWMEDIA_EXPORT int rawmedia_timeline_encode(RawMediaTimeline* tl, RawMediaEncoder* rme);
+RAWMEDIA_EXPORT int rawmedia_destroy_timeline(RawMediaTimeline* tl);
+
+// Transcodes input to output using nthreads threads.
+// The input is split into chunks starting on keyframes, each chunk is
+// decoded and encoded on its own thread into a temporary file next to
+// output, and the chunks are then concatenated into output.
+// econfig width, height, has_video and has_audio are set from the input.
+RAWMEDIA_EXPORT int rawmedia_transcode_parallel(const char* input, const char* output, const RawMediaSession* session, const RawMediaDecoderConfig* dconfig, const RawMediaEncoderConfig* econfig, int nthreads);
+
 #endif
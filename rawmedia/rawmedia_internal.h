@@ -5,6 +5,9 @@
 #define RM_RAWMEDIA_INTERNAL_H
 
 #include <libavcodec/avcodec.h>
+#include "exports.h"
+#include "rawmedia.h"
+#include "thread_pool.h"
 
 // Formats decoded by decoder and expected by encoder
 
@@ -26,4 +29,43 @@
 
 #define INVALID_STREAM -1
 
+// Row length of frame with bytes_per_pixel, allowing for linesize 0
+static inline int video_frame_linesize(const RawMediaVideoFrame* frame, int bytes_per_pixel) {
+    return frame->linesize ? frame->linesize : frame->width * bytes_per_pixel;
+}
+
+// Logs and returns false if frame is not a valid even width frame
+RAWMEDIA_LOCAL bool video_frame_valid(const RawMediaVideoFrame* frame, int bytes_per_pixel);
+
+// Processes rows [start, end) of a frame
+typedef void (*VideoRowsFunc)(void* arg, int start, int end);
+
+// Run func over rows [0, height), split into bands across the
+// rawmedia_set_video_threads pool if the frame is large enough.
+RAWMEDIA_LOCAL void video_execute_rows(VideoRowsFunc func, void* arg, int height, int row_bytes);
+
+// Alternative implementation of the decoder API (e.g. playlists),
+// with the same semantics as the functions they implement
+typedef struct DecoderBackend {
+    int (*decode_video)(void* opaque, uint8_t** output, int* width, int* height, int* outputsize);
+    int (*decode_audio)(void* opaque, uint8_t* output);
+    void (*destroy)(void* opaque);
+    void (*get_stats)(void* opaque, RawMediaDecoderStats* stats);  // Optional
+} DecoderBackend;
+
+// Create a decoder that delegates to backend.
+// rawmedia_destroy_decoder will destroy opaque.
+RAWMEDIA_LOCAL RawMediaDecoder* decoder_create_backend(const DecoderBackend* backend, void* opaque, const RawMediaDecoderInfo* info);
+
+// Decoder functions used by other modules
+// rawmedia_create_decoder, aborting if cancel becomes non-zero.
+// cancel may be NULL and is not referenced once this returns.
+RAWMEDIA_LOCAL RawMediaDecoder* decoder_create(const char* filename, const RawMediaSession* session, const RawMediaDecoderConfig* config, const volatile int* cancel);
+RAWMEDIA_LOCAL int decoder_keyframe_before(const RawMediaDecoder* rmd, int frame);
+// Frames of duration the caller hasn't read yet,
+// -1 if video and audio have been read to different frames
+RAWMEDIA_LOCAL int decoder_frames_remaining(const RawMediaDecoder* rmd);
+// Accumulate add into stats, taking the maximum of peaks
+RAWMEDIA_LOCAL void decoder_stats_add(RawMediaDecoderStats* stats, const RawMediaDecoderStats* add);
+
 #endif
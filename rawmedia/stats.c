@@ -0,0 +1,21 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// For clock_gettime
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+#include "rawmedia.h"
+#include "stats.h"
+
+volatile bool stats_enabled = false;
+
+int64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+void rawmedia_set_stats_enabled(bool enabled) {
+    stats_enabled = enabled;
+}
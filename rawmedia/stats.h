@@ -0,0 +1,29 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_STATS_H
+#define RM_STATS_H
+
+#include "exports.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Set by rawmedia_set_stats_enabled. Counters are always maintained,
+// stage timing only while enabled.
+RAWMEDIA_LOCAL extern volatile bool stats_enabled;
+
+// Monotonic clock in nanoseconds
+RAWMEDIA_LOCAL int64_t stats_now_ns(void);
+
+// Returns the start time of a timed stage, 0 if timing is disabled
+static inline int64_t stats_start(void) {
+    return stats_enabled ? stats_now_ns() : 0;
+}
+
+// Add the time since start to *ns
+static inline void stats_stop(int64_t* ns, int64_t start) {
+    if (start)
+        *ns += stats_now_ns() - start;
+}
+
+#endif
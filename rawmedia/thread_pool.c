@@ -0,0 +1,158 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <libavutil/mem.h>
+#include "thread_pool.h"
+
+typedef struct ThreadPoolBatch {
+    ThreadPoolFunc func;
+    void* arg;
+    int count;
+    int next;   // Next index to run
+    int done;   // Number of indexes completed
+    bool detached;  // Submitted batch, freed when done
+    struct ThreadPoolBatch* next_batch;
+} ThreadPoolBatch;
+
+struct ThreadPool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // Signalled when batches are queued
+    pthread_cond_t done_cond;   // Signalled when a batch completes
+    ThreadPoolBatch* first_batch;
+    ThreadPoolBatch* last_batch;
+    bool shutdown;
+    int nb_threads;
+    pthread_t* threads;
+};
+
+// Claim the next index from batch, removing it from the queue
+// once all indexes are claimed. Must hold lock.
+static int claim_index(ThreadPool* pool, ThreadPoolBatch* batch) {
+    int index = batch->next++;
+    if (batch->next == batch->count) {
+        ThreadPoolBatch** b = &pool->first_batch;
+        ThreadPoolBatch* prev = NULL;
+        while (*b != batch) {
+            prev = *b;
+            b = &(*b)->next_batch;
+        }
+        *b = batch->next_batch;
+        if (pool->last_batch == batch)
+            pool->last_batch = prev;
+        batch->next_batch = NULL;
+    }
+    return index;
+}
+
+// Run a claimed index. Must hold lock, it is released while running.
+static void run_index(ThreadPool* pool, ThreadPoolBatch* batch, int index) {
+    pthread_mutex_unlock(&pool->lock);
+    batch->func(batch->arg, index);
+    pthread_mutex_lock(&pool->lock);
+    if (batch->detached)
+        av_free(batch);
+    else if (++batch->done == batch->count)
+        pthread_cond_broadcast(&pool->done_cond);
+}
+
+static void* worker(void* arg) {
+    ThreadPool* pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->shutdown && !pool->first_batch)
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        // Finish queued work before shutting down
+        if (!pool->first_batch)
+            break;
+        ThreadPoolBatch* batch = pool->first_batch;
+        run_index(pool, batch, claim_index(pool, batch));
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* thread_pool_create(int nb_threads) {
+    ThreadPool* pool = av_mallocz(sizeof(ThreadPool));
+    if (!pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    if (nb_threads > 0) {
+        if (!(pool->threads = av_mallocz(nb_threads * sizeof(pthread_t)))) {
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+        for (; pool->nb_threads < nb_threads; pool->nb_threads++) {
+            if (pthread_create(&pool->threads[pool->nb_threads], NULL,
+                               worker, pool)) {
+                thread_pool_destroy(pool);
+                return NULL;
+            }
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+    av_free(pool->threads);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    av_free(pool);
+}
+
+// Append batch to the queue and wake workers. Must hold lock.
+static void queue_batch(ThreadPool* pool, ThreadPoolBatch* batch) {
+    if (pool->last_batch)
+        pool->last_batch->next_batch = batch;
+    else
+        pool->first_batch = batch;
+    pool->last_batch = batch;
+    pthread_cond_broadcast(&pool->work_cond);
+}
+
+void thread_pool_execute(ThreadPool* pool, ThreadPoolFunc func, void* arg, int count) {
+    if (!pool || !pool->nb_threads || count <= 1) {
+        for (int i = 0; i < count; i++)
+            func(arg, i);
+        return;
+    }
+
+    ThreadPoolBatch batch = { .func = func, .arg = arg, .count = count };
+    pthread_mutex_lock(&pool->lock);
+    queue_batch(pool, &batch);
+
+    // Help run our own batch, then wait for the workers to finish it
+    while (batch.next < batch.count)
+        run_index(pool, &batch, claim_index(pool, &batch));
+    while (batch.done < batch.count)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_submit(ThreadPool* pool, ThreadPoolFunc func, void* arg) {
+    ThreadPoolBatch* batch = NULL;
+    if (!pool || !pool->nb_threads
+        || !(batch = av_mallocz(sizeof(ThreadPoolBatch)))) {
+        func(arg, 0);
+        return;
+    }
+    batch->func = func;
+    batch->arg = arg;
+    batch->count = 1;
+    batch->detached = true;
+    pthread_mutex_lock(&pool->lock);
+    queue_batch(pool, batch);
+    pthread_mutex_unlock(&pool->lock);
+}
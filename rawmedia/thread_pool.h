@@ -0,0 +1,28 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_THREAD_POOL_H
+#define RM_THREAD_POOL_H
+
+#include "exports.h"
+
+typedef struct ThreadPool ThreadPool;
+
+// Job function, index is in [0, count) as passed to thread_pool_execute
+typedef void (*ThreadPoolFunc)(void* arg, int index);
+
+// nb_threads may be 0, in which case jobs run on the calling thread.
+RAWMEDIA_LOCAL ThreadPool* thread_pool_create(int nb_threads);
+RAWMEDIA_LOCAL void thread_pool_destroy(ThreadPool* pool);
+
+// Run func(arg, index) for each index in [0, count) and wait for all
+// to complete. The calling thread runs jobs too, so this can be called
+// from within a job. pool may be NULL to run all jobs on the calling thread.
+RAWMEDIA_LOCAL void thread_pool_execute(ThreadPool* pool, ThreadPoolFunc func, void* arg, int count);
+
+// Queue func(arg, 0) to run on a pool thread and return without waiting.
+// Queued jobs still run when the pool is destroyed. If pool is NULL,
+// has no threads or the job can't be queued, func runs on the calling thread.
+RAWMEDIA_LOCAL void thread_pool_submit(ThreadPool* pool, ThreadPoolFunc func, void* arg);
+
+#endif
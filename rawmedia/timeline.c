@@ -0,0 +1,402 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <libavutil/mem.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "work_stealing_pool.h"
+
+#define DEFAULT_LOOKAHEAD 4
+
+// Output of a source for one timeline frame
+typedef struct SourceFrame {
+    uint8_t* video;         // Copy of the decoded video, NULL if none
+    int video_capacity;
+    int width;
+    int height;
+    int linesize;
+    uint8_t* audio;
+} SourceFrame;
+
+typedef struct TimelineSource {
+    RawMediaTimeline* tl;
+    RawMediaDecoder* rmd;   // NULL once the source has ended
+    int start_frame;
+    int end_frame;
+    int layer;
+    bool has_video;
+    bool has_audio;
+    int next_frame;         // Next timeline frame to decode
+    bool busy;              // A decode task is queued or running
+    SourceFrame* frames;    // lookahead frames, indexed by frame % lookahead
+} TimelineSource;
+
+// Frame in the lookahead window
+typedef struct TimelineSlot {
+    int pending;            // Sources still to decode this frame
+} TimelineSlot;
+
+struct RawMediaTimeline {
+    RawMediaSession session;
+    int width;
+    int height;
+    int lookahead;
+    int nthreads;
+
+    TimelineSource* sources;
+    int source_count;
+    int* order;             // Source indexes sorted by layer, bottom first
+
+    TimelineSlot* slots;    // Indexed by frame % lookahead
+    int frame_count;
+    int window_start;       // Oldest frame not yet released
+    bool started;
+    bool held;              // window_start was returned and not yet released
+
+    WorkStealingPool* pool;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int busy_count;         // Decode tasks queued or running
+    bool shutdown;
+    int error;
+
+    uint8_t* video;         // Composited frame, NULL if not compositing
+    uint8_t* audio;         // Mixed audio
+    const uint8_t** mix_buffers;
+};
+
+static inline bool source_active(const TimelineSource* source, int frame) {
+    return frame >= source->start_frame && frame < source->end_frame;
+}
+
+// Ready slot for frame to be decoded. Must hold lock.
+static void init_slot(RawMediaTimeline* tl, int frame) {
+    TimelineSlot* slot = &tl->slots[frame % tl->lookahead];
+    slot->pending = 0;
+    for (int i = 0; i < tl->source_count; i++) {
+        if (source_active(&tl->sources[i], frame))
+            slot->pending++;
+    }
+}
+
+static int copy_video(TimelineSource* source, SourceFrame* sf) {
+    uint8_t* output = NULL;
+    int width, height, outputsize;
+    if (rawmedia_decode_video(source->rmd, &output, &width, &height, &outputsize) < 0)
+        return -1;
+    // No output until the source's first video frame
+    if (!output) {
+        sf->width = sf->height = 0;
+        return 0;
+    }
+    if (outputsize > sf->video_capacity) {
+        av_free(sf->video);
+        if (!(sf->video = av_malloc(outputsize))) {
+            sf->video_capacity = 0;
+            sf->width = sf->height = 0;
+            return -1;
+        }
+        sf->video_capacity = outputsize;
+    }
+    memcpy(sf->video, output, outputsize);
+    sf->width = width;
+    sf->height = height;
+    sf->linesize = outputsize / height;
+    return 0;
+}
+
+static void schedule(RawMediaTimeline* tl);
+
+// Decode the next frame of a source, runs on the pool
+static void decode_task(void* arg) {
+    TimelineSource* source = arg;
+    RawMediaTimeline* tl = source->tl;
+    int frame = source->next_frame;
+    SourceFrame* sf = &source->frames[frame % tl->lookahead];
+    int r = 0;
+
+    // The slot for frame is not read until its pending count reaches 0,
+    // so no lock is needed to fill it
+    if (source->has_video && copy_video(source, sf) < 0)
+        r = -1;
+    if (source->has_audio && r == 0
+        && rawmedia_decode_audio(source->rmd, sf->audio) < 0)
+        r = -1;
+    if (r < 0)
+        av_log(NULL, AV_LOG_ERROR, "timeline: failed to decode source %d frame %d\n",
+               (int)(source - tl->sources), frame);
+
+    bool ended = r < 0 || frame + 1 >= source->end_frame;
+    if (ended) {
+        rawmedia_destroy_decoder(source->rmd);
+        source->rmd = NULL;
+    }
+
+    pthread_mutex_lock(&tl->lock);
+    if (r < 0)
+        tl->error = r;
+    tl->slots[frame % tl->lookahead].pending--;
+    source->next_frame++;
+    source->busy = false;
+    tl->busy_count--;
+    if (!tl->shutdown)
+        schedule(tl);
+    pthread_cond_broadcast(&tl->cond);
+    pthread_mutex_unlock(&tl->lock);
+}
+
+// Queue a decode for each idle source whose next frame is in the window.
+// Must hold lock.
+static void schedule(RawMediaTimeline* tl) {
+    int window_end = tl->window_start + tl->lookahead;
+    for (int i = 0; i < tl->source_count; i++) {
+        TimelineSource* source = &tl->sources[i];
+        if (source->busy || !source->rmd
+            || source->next_frame >= source->end_frame
+            || source->next_frame >= window_end)
+            continue;
+        source->busy = true;
+        tl->busy_count++;
+        ws_pool_submit(tl->pool, decode_task, source);
+    }
+}
+
+RawMediaTimeline* rawmedia_create_timeline(const RawMediaSession* session, const RawMediaTimelineConfig* config) {
+    if (config->width < 0 || config->height < 0 || config->width % 2
+        || !config->width != !config->height)
+        return NULL;
+    RawMediaTimeline* tl = av_mallocz(sizeof(RawMediaTimeline));
+    if (!tl)
+        return NULL;
+    tl->session = *session;
+    tl->width = config->width;
+    tl->height = config->height;
+    tl->lookahead = config->lookahead > 0 ? config->lookahead : DEFAULT_LOOKAHEAD;
+    tl->nthreads = config->nthreads > 0 ? config->nthreads : ws_cpu_count();
+    pthread_mutex_init(&tl->lock, NULL);
+    pthread_cond_init(&tl->cond, NULL);
+
+    if (!(tl->slots = av_mallocz(tl->lookahead * sizeof(TimelineSlot))))
+        goto error;
+    if (!(tl->audio = av_malloc(session->audio_framebuffer_size)))
+        goto error;
+    if (tl->width) {
+        int size = tl->width * tl->height * 2;
+        if (!(tl->video = av_malloc(size)))
+            goto error;
+    }
+    if (!(tl->pool = ws_pool_create(tl->nthreads)))
+        goto error;
+    return tl;
+
+error:
+    av_log(NULL, AV_LOG_ERROR, "timeline: failed to create\n");
+    rawmedia_destroy_timeline(tl);
+    return NULL;
+}
+
+int rawmedia_timeline_add_source(RawMediaTimeline* tl, RawMediaDecoder* rmd, int start_frame, int end_frame, int layer) {
+    if (!rmd || tl->started || start_frame < 0)
+        return -1;
+    const RawMediaDecoderInfo* info = rawmedia_get_decoder_info(rmd);
+    if (end_frame <= 0)
+        end_frame = start_frame + info->duration;
+    if (end_frame <= start_frame)
+        return -1;
+
+    TimelineSource* sources = av_realloc(tl->sources, (tl->source_count + 1) * sizeof(TimelineSource));
+    if (!sources)
+        return -1;
+    tl->sources = sources;
+    int* order = av_realloc(tl->order, (tl->source_count + 1) * sizeof(int));
+    if (!order)
+        return -1;
+    tl->order = order;
+
+    TimelineSource* source = &tl->sources[tl->source_count];
+    memset(source, 0, sizeof(TimelineSource));
+    if (!(source->frames = av_mallocz(tl->lookahead * sizeof(SourceFrame))))
+        return -1;
+    if (info->has_audio) {
+        for (int i = 0; i < tl->lookahead; i++) {
+            if (!(source->frames[i].audio = av_malloc(tl->session.audio_framebuffer_size))) {
+                for (int j = 0; j < i; j++)
+                    av_free(source->frames[j].audio);
+                av_freep(&source->frames);
+                return -1;
+            }
+        }
+    }
+    source->tl = tl;
+    source->start_frame = start_frame;
+    source->end_frame = end_frame;
+    source->layer = layer;
+    source->has_video = info->has_video;
+    source->has_audio = info->has_audio;
+    source->next_frame = start_frame;
+
+    // Insert after sources on the same or lower layers, so equal layers
+    // stack in the order added
+    int index = tl->source_count++;
+    int pos = index;
+    while (pos > 0 && tl->sources[tl->order[pos - 1]].layer > layer) {
+        tl->order[pos] = tl->order[pos - 1];
+        pos--;
+    }
+    tl->order[pos] = index;
+
+    // Owned from here on
+    source->rmd = rmd;
+    if (end_frame > tl->frame_count)
+        tl->frame_count = end_frame;
+    return index;
+}
+
+int rawmedia_timeline_get_frame_count(const RawMediaTimeline* tl) {
+    return tl->frame_count;
+}
+
+static void composite(RawMediaTimeline* tl, int frame) {
+    int slot = frame % tl->lookahead;
+    int audio_count = 0;
+
+    if (tl->video) {
+        uint32_t black = 0x10801080;    // UYVY, little endian
+        uint32_t* p = (uint32_t*)tl->video;
+        for (int i = 0; i < tl->width * tl->height / 2; i++)
+            p[i] = black;
+    }
+    RawMediaVideoFrame dst = {
+        .data = tl->video, .linesize = 0, .width = tl->width, .height = tl->height,
+    };
+
+    for (int i = 0; i < tl->source_count; i++) {
+        TimelineSource* source = &tl->sources[tl->order[i]];
+        if (!source_active(source, frame))
+            continue;
+        SourceFrame* sf = &source->frames[slot];
+        if (tl->video && source->has_video && sf->height) {
+            RawMediaVideoFrame src = {
+                .data = sf->video, .linesize = sf->linesize,
+                .width = sf->width, .height = sf->height,
+            };
+            rawmedia_overlay_video(&dst, &src, (tl->width - sf->width) / 2,
+                                   (tl->height - sf->height) / 2, 1.0f);
+        }
+        if (source->has_audio)
+            tl->mix_buffers[audio_count++] = sf->audio;
+    }
+    rawmedia_mix_audio(&tl->session, tl->mix_buffers, audio_count, tl->audio);
+}
+
+int rawmedia_timeline_render_frame(RawMediaTimeline* tl, RawMediaTimelineFrame* frame) {
+    pthread_mutex_lock(&tl->lock);
+    if (!tl->started) {
+        if (!(tl->mix_buffers = av_malloc(FFMAX(tl->source_count, 1) * sizeof(uint8_t*)))) {
+            pthread_mutex_unlock(&tl->lock);
+            return -1;
+        }
+        for (int f = 0; f < tl->lookahead; f++)
+            init_slot(tl, f);
+        tl->started = true;
+    }
+    else if (tl->held) {
+        // Frame window_start is free for reuse by the frame entering the window
+        init_slot(tl, tl->window_start + tl->lookahead);
+        tl->window_start++;
+        tl->held = false;
+    }
+    if (tl->window_start >= tl->frame_count) {
+        pthread_mutex_unlock(&tl->lock);
+        return 0;
+    }
+    schedule(tl);
+    TimelineSlot* slot = &tl->slots[tl->window_start % tl->lookahead];
+    while (slot->pending > 0 && !tl->error)
+        pthread_cond_wait(&tl->cond, &tl->lock);
+    int r = tl->error;
+    pthread_mutex_unlock(&tl->lock);
+    if (r < 0)
+        return r;
+
+    // Sources don't write this frame's slot until it is released
+    composite(tl, tl->window_start);
+    tl->held = true;
+
+    frame->frame = tl->window_start;
+    frame->video.data = tl->video;
+    frame->video.linesize = 0;
+    frame->video.width = tl->video ? tl->width : 0;
+    frame->video.height = tl->video ? tl->height : 0;
+    frame->audio = tl->audio;
+    return 1;
+}
+
+int rawmedia_timeline_get_source_video(const RawMediaTimeline* tl, int index, RawMediaVideoFrame* video) {
+    if (index < 0 || index >= tl->source_count || !tl->held)
+        return -1;
+    const TimelineSource* source = &tl->sources[index];
+    memset(video, 0, sizeof(RawMediaVideoFrame));
+    if (!source_active(source, tl->window_start) || !source->has_video)
+        return 0;
+    const SourceFrame* sf = &source->frames[tl->window_start % tl->lookahead];
+    if (!sf->height)
+        return 0;
+    video->data = sf->video;
+    video->linesize = sf->linesize;
+    video->width = sf->width;
+    video->height = sf->height;
+    return 1;
+}
+
+int rawmedia_timeline_encode(RawMediaTimeline* tl, RawMediaEncoder* rme) {
+    RawMediaTimelineFrame frame;
+    int r;
+    int count = 0;
+    while ((r = rawmedia_timeline_render_frame(tl, &frame)) > 0) {
+        if (frame.video.data
+            && rawmedia_encode_video(rme, frame.video.data,
+                                     frame.video.width * frame.video.height * 2) < 0)
+            return -1;
+        if (rawmedia_encode_audio(rme, frame.audio) < 0)
+            return -1;
+        count++;
+    }
+    return r < 0 ? r : count;
+}
+
+int rawmedia_destroy_timeline(RawMediaTimeline* tl) {
+    if (!tl)
+        return 0;
+    // Wait for decodes in flight, they may queue no more
+    pthread_mutex_lock(&tl->lock);
+    tl->shutdown = true;
+    while (tl->busy_count > 0)
+        pthread_cond_wait(&tl->cond, &tl->lock);
+    pthread_mutex_unlock(&tl->lock);
+    ws_pool_destroy(tl->pool);
+
+    for (int i = 0; i < tl->source_count; i++) {
+        TimelineSource* source = &tl->sources[i];
+        if (source->rmd)
+            rawmedia_destroy_decoder(source->rmd);
+        for (int j = 0; j < tl->lookahead; j++) {
+            av_free(source->frames[j].video);
+            av_free(source->frames[j].audio);
+        }
+        av_free(source->frames);
+    }
+    av_free(tl->sources);
+    av_free(tl->order);
+    av_free(tl->slots);
+    av_free(tl->video);
+    av_free(tl->audio);
+    av_free(tl->mix_buffers);
+    pthread_cond_destroy(&tl->cond);
+    pthread_mutex_destroy(&tl->lock);
+    av_free(tl);
+    return 0;
+}
@@ -0,0 +1,254 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <stdio.h>
+#include <libavformat/avformat.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "thread_pool.h"
+
+typedef struct TranscodeChunk {
+    int start_frame;
+    int end_frame;
+    char filename[1024];
+    int result;
+} TranscodeChunk;
+
+typedef struct Transcode {
+    const char* input;
+    const RawMediaSession* session;
+    const RawMediaDecoderConfig* dconfig;
+    const RawMediaEncoderConfig* econfig;
+    TranscodeChunk* chunks;
+    int chunk_count;
+} Transcode;
+
+// Decode and encode one chunk of the input into its own file
+static int transcode_chunk(Transcode* transcode, TranscodeChunk* chunk) {
+    int r = 0;
+    const RawMediaSession* session = transcode->session;
+    RawMediaDecoderConfig dconfig = *transcode->dconfig;
+    dconfig.start_frame += chunk->start_frame;
+    dconfig.keyframe_seek = true;
+    RawMediaEncoderConfig econfig = *transcode->econfig;
+    RawMediaEncoder* rme = NULL;
+    uint8_t* audio_buffer = NULL;
+
+    RawMediaDecoder* rmd = rawmedia_create_decoder(transcode->input, session, &dconfig);
+    if (!rmd)
+        return -1;
+    const RawMediaDecoderInfo* info = rawmedia_get_decoder_info(rmd);
+    econfig.has_video = info->has_video;
+    econfig.has_audio = info->has_audio;
+    if (info->has_audio
+        && !(audio_buffer = av_malloc(session->audio_framebuffer_size))) {
+        r = -1;
+        goto done;
+    }
+
+    uint8_t* video_buffer = NULL;
+    int width = 0, height = 0, video_buffer_size = 0;
+    for (int frame = chunk->start_frame; frame < chunk->end_frame; frame++) {
+        if (info->has_video
+            && (r = rawmedia_decode_video(rmd, &video_buffer, &width, &height,
+                                          &video_buffer_size)) < 0)
+            goto done;
+        if (info->has_audio
+            && (r = rawmedia_decode_audio(rmd, audio_buffer)) < 0)
+            goto done;
+
+        if (!rme) {
+            econfig.width = width;
+            econfig.height = height;
+            if (!(rme = rawmedia_create_encoder(chunk->filename, session, &econfig))) {
+                r = -1;
+                goto done;
+            }
+        }
+        if (info->has_video
+            && (r = rawmedia_encode_video(rme, video_buffer, video_buffer_size)) < 0)
+            goto done;
+        if (info->has_audio
+            && (r = rawmedia_encode_audio(rme, audio_buffer)) < 0)
+            goto done;
+    }
+
+done:
+    if (rme) {
+        int rc = rawmedia_destroy_encoder(rme);
+        if (r >= 0 && rc)
+            r = -1;
+    }
+    rawmedia_destroy_decoder(rmd);
+    av_free(audio_buffer);
+    return r;
+}
+
+static void transcode_job(void* arg, int index) {
+    Transcode* transcode = arg;
+    TranscodeChunk* chunk = &transcode->chunks[index];
+    if ((chunk->result = transcode_chunk(transcode, chunk)) < 0)
+        av_log(NULL, AV_LOG_FATAL, "%s: failed to transcode frames %d-%d\n",
+               transcode->input, chunk->start_frame, chunk->end_frame);
+}
+
+// Losslessly concatenate the chunk files into output.
+// Each chunk contains exactly its frames worth of video and audio samples,
+// so each stream of a chunk is offset by its start frame.
+static int concat_chunks(Transcode* transcode, const char* output) {
+    int r = 0;
+    AVFormatContext* output_ctx = NULL;
+    AVFormatContext* input_ctx = NULL;
+    AVPacket pkt = {0};
+
+    for (int c = 0; c < transcode->chunk_count; c++) {
+        TranscodeChunk* chunk = &transcode->chunks[c];
+        if ((r = avformat_open_input(&input_ctx, chunk->filename, NULL, NULL)) != 0)
+            goto error;
+        if ((r = avformat_find_stream_info(input_ctx, NULL)) < 0)
+            goto error;
+
+        if (!output_ctx) {
+            if ((r = avformat_alloc_output_context2(&output_ctx, NULL,
+                                                    RAWMEDIA_ENCODE_FORMAT,
+                                                    output)) < 0)
+                goto error;
+            for (int s = 0; s < input_ctx->nb_streams; s++) {
+                AVStream* input_stream = input_ctx->streams[s];
+                AVStream* output_stream = avformat_new_stream(output_ctx, NULL);
+                if (!output_stream) {
+                    r = -1;
+                    goto error;
+                }
+                if ((r = avcodec_copy_context(output_stream->codec,
+                                              input_stream->codec)) < 0)
+                    goto error;
+                output_stream->sample_aspect_ratio = input_stream->sample_aspect_ratio;
+                if (output_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+                    output_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+            }
+            if ((r = avio_open(&output_ctx->pb, output, AVIO_FLAG_WRITE)) < 0)
+                goto error;
+            if ((r = avformat_write_header(output_ctx, NULL)) < 0)
+                goto error;
+        }
+        if (input_ctx->nb_streams != output_ctx->nb_streams) {
+            r = -1;
+            goto error;
+        }
+
+        AVRational time_base = (AVRational){transcode->session->framerate_den,
+                                            transcode->session->framerate_num};
+        while ((r = av_read_frame(input_ctx, &pkt)) >= 0) {
+            AVStream* input_stream = input_ctx->streams[pkt.stream_index];
+            AVStream* output_stream = output_ctx->streams[pkt.stream_index];
+            int64_t offset;
+            if (input_stream->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
+                int64_t samples_per_frame = av_rescale_q(1, time_base,
+                                                         RAWMEDIA_AUDIO_TIME_BASE);
+                offset = av_rescale_q(chunk->start_frame * samples_per_frame,
+                                      RAWMEDIA_AUDIO_TIME_BASE,
+                                      output_stream->time_base);
+            }
+            else
+                offset = av_rescale_q(chunk->start_frame, time_base,
+                                      output_stream->time_base);
+            if (pkt.pts != AV_NOPTS_VALUE)
+                pkt.pts = av_rescale_q(pkt.pts, input_stream->time_base,
+                                       output_stream->time_base) + offset;
+            if (pkt.dts != AV_NOPTS_VALUE)
+                pkt.dts = av_rescale_q(pkt.dts, input_stream->time_base,
+                                       output_stream->time_base) + offset;
+            pkt.duration = av_rescale_q(pkt.duration, input_stream->time_base,
+                                        output_stream->time_base);
+            pkt.pos = -1;
+            r = av_interleaved_write_frame(output_ctx, &pkt);
+            av_free_packet(&pkt);
+            if (r < 0)
+                goto error;
+        }
+        if (r != AVERROR_EOF)
+            goto error;
+        r = 0;
+        avformat_close_input(&input_ctx);
+    }
+
+    if ((r = av_write_trailer(output_ctx)) < 0)
+        goto error;
+
+error:
+    avformat_close_input(&input_ctx);
+    if (output_ctx) {
+        if (output_ctx->pb)
+            avio_close(output_ctx->pb);
+        avformat_free_context(output_ctx);
+    }
+    return r;
+}
+
+int rawmedia_transcode_parallel(const char* input, const char* output, const RawMediaSession* session, const RawMediaDecoderConfig* dconfig, const RawMediaEncoderConfig* econfig, int nthreads) {
+    int r = 0;
+    Transcode transcode = { .input = input, .session = session,
+                            .dconfig = dconfig, .econfig = econfig };
+    ThreadPool* pool = NULL;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    // Open the input once to find its duration and keyframes
+    RawMediaDecoderConfig probe_config = *dconfig;
+    probe_config.start_frame = 0;
+    RawMediaDecoder* rmd = rawmedia_create_decoder(input, session, &probe_config);
+    if (!rmd)
+        return -1;
+    int duration = rawmedia_get_decoder_info(rmd)->duration - dconfig->start_frame;
+    if (duration <= 0) {
+        rawmedia_destroy_decoder(rmd);
+        return -1;
+    }
+
+    // Split the timeline into a chunk per thread, starting on keyframes
+    if (!(transcode.chunks = av_mallocz(nthreads * sizeof(TranscodeChunk)))) {
+        rawmedia_destroy_decoder(rmd);
+        return -1;
+    }
+    for (int c = 0; c < nthreads; c++) {
+        int start_frame = (int64_t)duration * c / nthreads;
+        if (c > 0)
+            start_frame = decoder_keyframe_before(rmd, dconfig->start_frame + start_frame)
+                - dconfig->start_frame;
+        if (transcode.chunk_count > 0) {
+            TranscodeChunk* prev = &transcode.chunks[transcode.chunk_count - 1];
+            if (start_frame <= prev->start_frame)
+                continue;
+            prev->end_frame = start_frame;
+        }
+        TranscodeChunk* chunk = &transcode.chunks[transcode.chunk_count++];
+        chunk->start_frame = start_frame;
+        chunk->end_frame = duration;
+        snprintf(chunk->filename, sizeof(chunk->filename), "%s.part%03d.%s",
+                 output, c, RAWMEDIA_ENCODE_FORMAT);
+    }
+    rawmedia_destroy_decoder(rmd);
+
+    // The calling thread transcodes a chunk too
+    if (!(pool = thread_pool_create(transcode.chunk_count - 1))) {
+        r = -1;
+        goto done;
+    }
+    thread_pool_execute(pool, transcode_job, &transcode, transcode.chunk_count);
+    thread_pool_destroy(pool);
+
+    for (int c = 0; c < transcode.chunk_count; c++) {
+        if ((r = transcode.chunks[c].result) < 0)
+            goto done;
+    }
+    if ((r = concat_chunks(&transcode, output)) < 0)
+        av_log(NULL, AV_LOG_FATAL, "%s: failed to concatenate chunks (%d)\n",
+               output, r);
+
+done:
+    for (int c = 0; c < transcode.chunk_count; c++)
+        remove(transcode.chunks[c].filename);
+    av_free(transcode.chunks);
+    return r;
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <math.h>
+#include <string.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "video_blend.h"
+#include "cpu.h"
+#ifdef RAWMEDIA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Blends nb_bytes of a and b with weight of b in [0, 256]
+typedef void (*BlendRowFunc)(const uint8_t* a, const uint8_t* b, int weight, int nb_bytes, uint8_t* output);
+
+// UYVY components are all unsigned bytes, and a linear blend
+// of two chroma pairs is the chroma of the blended pixels,
+// so every byte is blended the same way.
+static void blend_row_c(const uint8_t* a, const uint8_t* b, int weight, int start, int nb_bytes, uint8_t* output) {
+    for (int i = start; i < nb_bytes; i++)
+        output[i] = (a[i] * (256 - weight) + b[i] * weight + 128) >> 8;
+}
+
+static void blend_row_scalar(const uint8_t* a, const uint8_t* b, int weight, int nb_bytes, uint8_t* output) {
+    blend_row_c(a, b, weight, 0, nb_bytes, output);
+}
+
+#ifdef RAWMEDIA_X86_SIMD
+RAWMEDIA_TARGET("sse2")
+static void blend_row_sse2(const uint8_t* a, const uint8_t* b, int weight, int nb_bytes, uint8_t* output) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(256 - weight);
+    const __m128i wb = _mm_set1_epi16(weight);
+    const __m128i round = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= nb_bytes; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i*)&b[i]);
+        // Sums are at most 255 * 256 + 128 so fit unsigned 16 bits
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                                 _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb)), round);
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                                 _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb)), round);
+        _mm_storeu_si128((__m128i*)&output[i],
+                         _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    blend_row_c(a, b, weight, i, nb_bytes, output);
+}
+
+RAWMEDIA_TARGET("avx2")
+static void blend_row_avx2(const uint8_t* a, const uint8_t* b, int weight, int nb_bytes, uint8_t* output) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i wa = _mm256_set1_epi16(256 - weight);
+    const __m256i wb = _mm256_set1_epi16(weight);
+    const __m256i round = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 32 <= nb_bytes; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)&a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i*)&b[i]);
+        // unpack and packus both work within 128 bit lanes, so order is kept
+        __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+                                                       _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb)), round);
+        __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+                                                       _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb)), round);
+        _mm256_storeu_si256((__m256i*)&output[i],
+                            _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+    blend_row_c(a, b, weight, i, nb_bytes, output);
+}
+#endif
+
+static BlendRowFunc s_blend_row = blend_row_scalar;
+
+void video_blend_init(void) {
+#ifdef RAWMEDIA_X86_SIMD
+    int flags = cpu_flags();
+    if (flags & CPU_FLAG_AVX2)
+        s_blend_row = blend_row_avx2;
+    else if (flags & CPU_FLAG_SSE2)
+        s_blend_row = blend_row_sse2;
+#endif
+}
+
+typedef struct BlendJob {
+    const uint8_t* a;
+    int a_linesize;
+    const uint8_t* b;
+    int b_linesize;
+    uint8_t* output;
+    int output_linesize;
+    int weight;
+    int nb_bytes;       // Bytes per row
+    int height;
+} BlendJob;
+
+static void blend_band(void* arg, int start, int end) {
+    BlendJob* job = arg;
+    for (int y = start; y < end; y++) {
+        s_blend_row(job->a + y * job->a_linesize,
+                    job->b + y * job->b_linesize,
+                    job->weight, job->nb_bytes,
+                    job->output + y * job->output_linesize);
+    }
+}
+
+static void blend_rows(BlendJob* job) {
+    video_execute_rows(blend_band, job, job->height, job->nb_bytes);
+}
+
+static inline int blend_weight(float alpha) {
+    return av_clip(lrintf(alpha * 256), 0, 256);
+}
+
+int rawmedia_blend_video(const RawMediaVideoFrame* a, const RawMediaVideoFrame* b, float alpha, const RawMediaVideoFrame* output) {
+    if (!video_frame_valid(a, 2) || !video_frame_valid(b, 2) || !video_frame_valid(output, 2))
+        return -1;
+    if (a->width != b->width || a->height != b->height
+        || a->width != output->width || a->height != output->height) {
+        av_log(NULL, AV_LOG_ERROR, "Blended video frames must be the same size\n");
+        return -1;
+    }
+    BlendJob job = {
+        .a = a->data, .a_linesize = video_frame_linesize(a, 2),
+        .b = b->data, .b_linesize = video_frame_linesize(b, 2),
+        .output = output->data, .output_linesize = video_frame_linesize(output, 2),
+        .weight = blend_weight(alpha),
+        .nb_bytes = a->width * 2,
+        .height = a->height,
+    };
+    blend_rows(&job);
+    return 0;
+}
+
+typedef struct CopyJob {
+    const uint8_t* src;
+    int src_linesize;
+    uint8_t* dst;
+    int dst_linesize;
+    int nb_bytes;
+} CopyJob;
+
+static void copy_band(void* arg, int start, int end) {
+    const CopyJob* job = arg;
+    for (int y = start; y < end; y++)
+        memcpy(job->dst + y * job->dst_linesize,
+               job->src + y * job->src_linesize, job->nb_bytes);
+}
+
+int rawmedia_copy_video(const RawMediaVideoFrame* src, const RawMediaVideoFrame* dst) {
+    if (!video_frame_valid(src, 2) || !video_frame_valid(dst, 2))
+        return -1;
+    if (src->width != dst->width || src->height != dst->height) {
+        av_log(NULL, AV_LOG_ERROR, "Copied video frames must be the same size\n");
+        return -1;
+    }
+    CopyJob job = {
+        .src = src->data, .src_linesize = video_frame_linesize(src, 2),
+        .dst = dst->data, .dst_linesize = video_frame_linesize(dst, 2),
+        .nb_bytes = src->width * 2,
+    };
+    video_execute_rows(copy_band, &job, src->height, job.nb_bytes);
+    return 0;
+}
+
+int rawmedia_overlay_video(const RawMediaVideoFrame* dst, const RawMediaVideoFrame* src, int x, int y, float opacity) {
+    if (!video_frame_valid(dst, 2) || !video_frame_valid(src, 2))
+        return -1;
+    // Round down to a chroma pair, works for negative x too
+    x -= x & 1;
+
+    // Clip src to dst
+    int left = FFMAX(x, 0);
+    int top = FFMAX(y, 0);
+    int right = FFMIN(x + src->width, dst->width);
+    int bottom = FFMIN(y + src->height, dst->height);
+    int weight = blend_weight(opacity);
+    if (left >= right || top >= bottom || weight == 0)
+        return 0;
+
+    int dst_linesize = video_frame_linesize(dst, 2);
+    int src_linesize = video_frame_linesize(src, 2);
+    uint8_t* dst_data = dst->data + top * dst_linesize + left * 2;
+    BlendJob job = {
+        .a = dst_data, .a_linesize = dst_linesize,
+        .b = src->data + (top - y) * src_linesize + (left - x) * 2,
+        .b_linesize = src_linesize,
+        .output = dst_data, .output_linesize = dst_linesize,
+        .weight = weight,
+        .nb_bytes = (right - left) * 2,
+        .height = bottom - top,
+    };
+    blend_rows(&job);
+    return 0;
+}
@@ -0,0 +1,12 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_VIDEO_BLEND_H
+#define RM_VIDEO_BLEND_H
+
+#include "exports.h"
+
+// Select the best kernels for the running CPU
+RAWMEDIA_LOCAL void video_blend_init(void);
+
+#endif
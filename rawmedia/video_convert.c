@@ -0,0 +1,388 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <math.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "video_convert.h"
+#include "cpu.h"
+#ifdef RAWMEDIA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// YUV to RGB coefficients are 13 bit fixed point, RGB to YUV 15 bit.
+// All kernels use the same integer arithmetic so are bit exact.
+#define YUV_SHIFT 13
+#define RGB_SHIFT 15
+
+typedef struct ColorCoeffs {
+    // YUV to RGB
+    int16_t y_offset;   // 16 or 0
+    int16_t ys;         // Luma scale
+    int16_t rv;         // V contribution to R
+    int16_t gu, gv;     // U and V contributions to G (negative)
+    int16_t bu;         // U contribution to B
+    // RGB to YUV, indexed by byte position within the pixel
+    // so BGRA and RGBA use the same kernels
+    int16_t y[3];
+    int16_t u[3];
+    int16_t v[3];
+    bool rgba;
+} ColorCoeffs;
+
+// Converts a row of width pixels
+typedef void (*ConvertRowFunc)(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c);
+
+static inline int16_t fixed(double value, int shift) {
+    return lrint(value * (1 << shift));
+}
+
+static void init_coeffs(ColorCoeffs* c, const RawMediaColorSpace* color) {
+    double kr = 0.299, kb = 0.114;
+    if (color && color->matrix == RAWMEDIA_COLOR_BT709) {
+        kr = 0.2126;
+        kb = 0.0722;
+    }
+    double kg = 1 - kr - kb;
+    bool full_range = color && color->full_range;
+    double ly = full_range ? 1 : 219.0 / 255;
+    double lc = full_range ? 1 : 224.0 / 255;
+
+    c->y_offset = full_range ? 0 : 16;
+    c->ys = fixed(1 / ly, YUV_SHIFT);
+    c->rv = fixed(2 * (1 - kr) / lc, YUV_SHIFT);
+    c->gu = -fixed(2 * kb * (1 - kb) / (kg * lc), YUV_SHIFT);
+    c->gv = -fixed(2 * kr * (1 - kr) / (kg * lc), YUV_SHIFT);
+    c->bu = fixed(2 * (1 - kb) / lc, YUV_SHIFT);
+
+    c->rgba = color && color->rgba;
+    int r = c->rgba ? 0 : 2, g = 1, b = c->rgba ? 2 : 0;
+    c->y[r] = fixed(kr * ly, RGB_SHIFT);
+    c->y[g] = fixed(kg * ly, RGB_SHIFT);
+    c->y[b] = fixed(kb * ly, RGB_SHIFT);
+    c->u[r] = fixed(-kr * lc / (2 * (1 - kb)), RGB_SHIFT);
+    c->u[g] = fixed(-kg * lc / (2 * (1 - kb)), RGB_SHIFT);
+    c->u[b] = fixed(lc / 2, RGB_SHIFT);
+    c->v[r] = fixed(lc / 2, RGB_SHIFT);
+    c->v[g] = fixed(-kg * lc / (2 * (1 - kr)), RGB_SHIFT);
+    c->v[b] = fixed(-kb * lc / (2 * (1 - kr)), RGB_SHIFT);
+}
+
+static inline uint8_t clip_uint8(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// Converts pixel pairs [start, width)
+static void uyvy_to_rgb_c(const uint8_t* src, uint8_t* dst, int start, int width, const ColorCoeffs* c) {
+    const int round = 1 << (YUV_SHIFT - 1);
+    int r_index = c->rgba ? 0 : 2, b_index = c->rgba ? 2 : 0;
+    for (int x = start; x < width; x += 2) {
+        const uint8_t* uyvy = &src[x * 2];
+        int u = uyvy[0] - 128;
+        int v = uyvy[2] - 128;
+        int r = v * c->rv + round;
+        int g = u * c->gu + v * c->gv + round;
+        int b = u * c->bu + round;
+        for (int i = 0; i < 2; i++) {
+            int y = (uyvy[1 + i * 2] - c->y_offset) * c->ys;
+            uint8_t* rgb = &dst[(x + i) * 4];
+            rgb[r_index] = clip_uint8((y + r) >> YUV_SHIFT);
+            rgb[1] = clip_uint8((y + g) >> YUV_SHIFT);
+            rgb[b_index] = clip_uint8((y + b) >> YUV_SHIFT);
+            rgb[3] = 255;
+        }
+    }
+}
+
+// Chroma is computed from the sum of each pixel pair, so shifted one more
+static void rgb_to_uyvy_c(const uint8_t* src, uint8_t* dst, int start, int width, const ColorCoeffs* c) {
+    for (int x = start; x < width; x += 2) {
+        const uint8_t* p0 = &src[x * 4];
+        const uint8_t* p1 = p0 + 4;
+        int s0 = p0[0] + p1[0], s1 = p0[1] + p1[1], s2 = p0[2] + p1[2];
+        uint8_t* uyvy = &dst[x * 2];
+        uyvy[0] = clip_uint8(((s0 * c->u[0] + s1 * c->u[1] + s2 * c->u[2]
+                               + (1 << RGB_SHIFT)) >> (RGB_SHIFT + 1)) + 128);
+        uyvy[2] = clip_uint8(((s0 * c->v[0] + s1 * c->v[1] + s2 * c->v[2]
+                               + (1 << RGB_SHIFT)) >> (RGB_SHIFT + 1)) + 128);
+        uyvy[1] = clip_uint8(((p0[0] * c->y[0] + p0[1] * c->y[1] + p0[2] * c->y[2]
+                               + (1 << (RGB_SHIFT - 1))) >> RGB_SHIFT) + c->y_offset);
+        uyvy[3] = clip_uint8(((p1[0] * c->y[0] + p1[1] * c->y[1] + p1[2] * c->y[2]
+                               + (1 << (RGB_SHIFT - 1))) >> RGB_SHIFT) + c->y_offset);
+    }
+}
+
+static void uyvy_to_rgb_scalar(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c) {
+    uyvy_to_rgb_c(src, dst, 0, width, c);
+}
+
+static void rgb_to_uyvy_scalar(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c) {
+    rgb_to_uyvy_c(src, dst, 0, width, c);
+}
+
+#ifdef RAWMEDIA_X86_SIMD
+// int16 pair (lo, hi) replicated, for madd
+static inline int pair16(int16_t lo, int16_t hi) {
+    return (int)(((uint32_t)(uint16_t)hi << 16) | (uint16_t)lo);
+}
+
+// Sum the adjacent int32 lanes of a and b, returning
+// a0+a1, a2+a3, b0+b1, b2+b3
+RAWMEDIA_TARGET("sse2")
+static inline __m128i hadd_epi32_sse2(__m128i a, __m128i b) {
+    __m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_add_epi32(even, odd);
+}
+
+RAWMEDIA_TARGET("sse2")
+static void uyvy_to_rgb_sse2(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset = _mm_set1_epi32(pair16(128, c->y_offset));
+    const __m128i ys = _mm_set1_epi32(pair16(0, c->ys));
+    const __m128i rv = _mm_set1_epi32(pair16(0, c->rv));
+    const __m128i guv = _mm_set1_epi32(pair16(c->gu, c->gv));
+    const __m128i bu = _mm_set1_epi32(pair16(c->bu, 0));
+    const __m128i round = _mm_set1_epi32(1 << (YUV_SHIFT - 1));
+    const __m128i alpha = _mm_set1_epi8(-1);
+    int x = 0;
+    // 8 pixels per iteration
+    for (; x + 8 <= width; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[x * 2]);
+        // U Y V Y as int16, offsets removed
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), offset);
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(v, zero), offset);
+        // Scaled luma per pixel
+        __m128i y_lo = _mm_add_epi32(_mm_madd_epi16(lo, ys), round);
+        __m128i y_hi = _mm_add_epi32(_mm_madd_epi16(hi, ys), round);
+        // Sign extended chroma packed to U V pairs
+        __m128i uv = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+                                     _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+        // Chroma contribution per pixel pair, then duplicated per pixel
+        __m128i r = _mm_madd_epi16(uv, rv);
+        __m128i g = _mm_madd_epi16(uv, guv);
+        __m128i b = _mm_madd_epi16(uv, bu);
+        __m128i r16 = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, _mm_unpacklo_epi32(r, r)), YUV_SHIFT),
+                                      _mm_srai_epi32(_mm_add_epi32(y_hi, _mm_unpackhi_epi32(r, r)), YUV_SHIFT));
+        __m128i g16 = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, _mm_unpacklo_epi32(g, g)), YUV_SHIFT),
+                                      _mm_srai_epi32(_mm_add_epi32(y_hi, _mm_unpackhi_epi32(g, g)), YUV_SHIFT));
+        __m128i b16 = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, _mm_unpacklo_epi32(b, b)), YUV_SHIFT),
+                                      _mm_srai_epi32(_mm_add_epi32(y_hi, _mm_unpackhi_epi32(b, b)), YUV_SHIFT));
+        __m128i r8 = _mm_packus_epi16(r16, r16);
+        __m128i g8 = _mm_packus_epi16(g16, g16);
+        __m128i b8 = _mm_packus_epi16(b16, b16);
+        if (c->rgba) {
+            __m128i t = r8;
+            r8 = b8;
+            b8 = t;
+        }
+        __m128i bg = _mm_unpacklo_epi8(b8, g8);
+        __m128i ra = _mm_unpacklo_epi8(r8, alpha);
+        _mm_storeu_si128((__m128i*)&dst[x * 4], _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)&dst[x * 4 + 16], _mm_unpackhi_epi16(bg, ra));
+    }
+    uyvy_to_rgb_c(src, dst, x, width, c);
+}
+
+// Converts 4 pixels of q to U Y V Y U Y V Y as int16
+RAWMEDIA_TARGET("sse2")
+static inline __m128i rgb_to_uyvy4_sse2(__m128i q, __m128i yc, __m128i uc, __m128i vc,
+                                        __m128i y_round, __m128i y_offset,
+                                        __m128i c_round, __m128i c_offset) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i p01 = _mm_unpacklo_epi8(q, zero);
+    __m128i p23 = _mm_unpackhi_epi8(q, zero);
+    __m128i y = hadd_epi32_sse2(_mm_madd_epi16(p01, yc), _mm_madd_epi16(p23, yc));
+    y = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(y, y_round), RGB_SHIFT), y_offset);
+    // Sum each pixel pair
+    __m128i s = _mm_unpacklo_epi64(_mm_add_epi16(p01, _mm_srli_si128(p01, 8)),
+                                   _mm_add_epi16(p23, _mm_srli_si128(p23, 8)));
+    // U0 U1 V0 V1
+    __m128i uv = hadd_epi32_sse2(_mm_madd_epi16(s, uc), _mm_madd_epi16(s, vc));
+    uv = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(uv, c_round), RGB_SHIFT + 1), c_offset);
+    // U0 V0 U1 V1 Y0 Y1 Y2 Y3
+    __m128i c16 = _mm_packs_epi32(_mm_shuffle_epi32(uv, _MM_SHUFFLE(3, 1, 2, 0)), y);
+    return _mm_unpacklo_epi16(c16, _mm_srli_si128(c16, 8));
+}
+
+RAWMEDIA_TARGET("sse2")
+static void rgb_to_uyvy_sse2(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c) {
+    const __m128i yc = _mm_setr_epi16(c->y[0], c->y[1], c->y[2], 0, c->y[0], c->y[1], c->y[2], 0);
+    const __m128i uc = _mm_setr_epi16(c->u[0], c->u[1], c->u[2], 0, c->u[0], c->u[1], c->u[2], 0);
+    const __m128i vc = _mm_setr_epi16(c->v[0], c->v[1], c->v[2], 0, c->v[0], c->v[1], c->v[2], 0);
+    const __m128i y_round = _mm_set1_epi32(1 << (RGB_SHIFT - 1));
+    const __m128i y_offset = _mm_set1_epi32(c->y_offset);
+    const __m128i c_round = _mm_set1_epi32(1 << RGB_SHIFT);
+    const __m128i c_offset = _mm_set1_epi32(128);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = rgb_to_uyvy4_sse2(_mm_loadu_si128((const __m128i*)&src[x * 4]),
+                                      yc, uc, vc, y_round, y_offset, c_round, c_offset);
+        __m128i b = rgb_to_uyvy4_sse2(_mm_loadu_si128((const __m128i*)&src[x * 4 + 16]),
+                                      yc, uc, vc, y_round, y_offset, c_round, c_offset);
+        _mm_storeu_si128((__m128i*)&dst[x * 2], _mm_packus_epi16(a, b));
+    }
+    rgb_to_uyvy_c(src, dst, x, width, c);
+}
+
+// The AVX2 kernels run the SSE2 algorithm independently in each
+// 128 bit lane, then restore pixel order when storing.
+RAWMEDIA_TARGET("avx2")
+static inline __m256i hadd_epi32_avx2(__m256i a, __m256i b) {
+    __m256 fa = _mm256_castsi256_ps(a), fb = _mm256_castsi256_ps(b);
+    __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm256_add_epi32(even, odd);
+}
+
+RAWMEDIA_TARGET("avx2")
+static void uyvy_to_rgb_avx2(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i offset = _mm256_set1_epi32(pair16(128, c->y_offset));
+    const __m256i ys = _mm256_set1_epi32(pair16(0, c->ys));
+    const __m256i rv = _mm256_set1_epi32(pair16(0, c->rv));
+    const __m256i guv = _mm256_set1_epi32(pair16(c->gu, c->gv));
+    const __m256i bu = _mm256_set1_epi32(pair16(c->bu, 0));
+    const __m256i round = _mm256_set1_epi32(1 << (YUV_SHIFT - 1));
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    int x = 0;
+    // 16 pixels per iteration
+    for (; x + 16 <= width; x += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&src[x * 2]);
+        __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(v, zero), offset);
+        __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(v, zero), offset);
+        __m256i y_lo = _mm256_add_epi32(_mm256_madd_epi16(lo, ys), round);
+        __m256i y_hi = _mm256_add_epi32(_mm256_madd_epi16(hi, ys), round);
+        __m256i uv = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(lo, 16), 16),
+                                        _mm256_srai_epi32(_mm256_slli_epi32(hi, 16), 16));
+        __m256i r = _mm256_madd_epi16(uv, rv);
+        __m256i g = _mm256_madd_epi16(uv, guv);
+        __m256i b = _mm256_madd_epi16(uv, bu);
+        __m256i r16 = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(y_lo, _mm256_unpacklo_epi32(r, r)), YUV_SHIFT),
+                                         _mm256_srai_epi32(_mm256_add_epi32(y_hi, _mm256_unpackhi_epi32(r, r)), YUV_SHIFT));
+        __m256i g16 = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(y_lo, _mm256_unpacklo_epi32(g, g)), YUV_SHIFT),
+                                         _mm256_srai_epi32(_mm256_add_epi32(y_hi, _mm256_unpackhi_epi32(g, g)), YUV_SHIFT));
+        __m256i b16 = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(y_lo, _mm256_unpacklo_epi32(b, b)), YUV_SHIFT),
+                                         _mm256_srai_epi32(_mm256_add_epi32(y_hi, _mm256_unpackhi_epi32(b, b)), YUV_SHIFT));
+        __m256i r8 = _mm256_packus_epi16(r16, r16);
+        __m256i g8 = _mm256_packus_epi16(g16, g16);
+        __m256i b8 = _mm256_packus_epi16(b16, b16);
+        if (c->rgba) {
+            __m256i t = r8;
+            r8 = b8;
+            b8 = t;
+        }
+        __m256i bg = _mm256_unpacklo_epi8(b8, g8);
+        __m256i ra = _mm256_unpacklo_epi8(r8, alpha);
+        __m256i p0 = _mm256_unpacklo_epi16(bg, ra);
+        __m256i p1 = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i*)&dst[x * 4], _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256((__m256i*)&dst[x * 4 + 32], _mm256_permute2x128_si256(p0, p1, 0x31));
+    }
+    uyvy_to_rgb_c(src, dst, x, width, c);
+}
+
+RAWMEDIA_TARGET("avx2")
+static inline __m256i rgb_to_uyvy8_avx2(__m256i q, __m256i yc, __m256i uc, __m256i vc,
+                                        __m256i y_round, __m256i y_offset,
+                                        __m256i c_round, __m256i c_offset) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i p01 = _mm256_unpacklo_epi8(q, zero);
+    __m256i p23 = _mm256_unpackhi_epi8(q, zero);
+    __m256i y = hadd_epi32_avx2(_mm256_madd_epi16(p01, yc), _mm256_madd_epi16(p23, yc));
+    y = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(y, y_round), RGB_SHIFT), y_offset);
+    __m256i s = _mm256_unpacklo_epi64(_mm256_add_epi16(p01, _mm256_bsrli_epi128(p01, 8)),
+                                      _mm256_add_epi16(p23, _mm256_bsrli_epi128(p23, 8)));
+    __m256i uv = hadd_epi32_avx2(_mm256_madd_epi16(s, uc), _mm256_madd_epi16(s, vc));
+    uv = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(uv, c_round), RGB_SHIFT + 1), c_offset);
+    __m256i c16 = _mm256_packs_epi32(_mm256_shuffle_epi32(uv, _MM_SHUFFLE(3, 1, 2, 0)), y);
+    return _mm256_unpacklo_epi16(c16, _mm256_bsrli_epi128(c16, 8));
+}
+
+RAWMEDIA_TARGET("avx2")
+static void rgb_to_uyvy_avx2(const uint8_t* src, uint8_t* dst, int width, const ColorCoeffs* c) {
+    const __m256i yc = _mm256_setr_epi16(c->y[0], c->y[1], c->y[2], 0, c->y[0], c->y[1], c->y[2], 0,
+                                         c->y[0], c->y[1], c->y[2], 0, c->y[0], c->y[1], c->y[2], 0);
+    const __m256i uc = _mm256_setr_epi16(c->u[0], c->u[1], c->u[2], 0, c->u[0], c->u[1], c->u[2], 0,
+                                         c->u[0], c->u[1], c->u[2], 0, c->u[0], c->u[1], c->u[2], 0);
+    const __m256i vc = _mm256_setr_epi16(c->v[0], c->v[1], c->v[2], 0, c->v[0], c->v[1], c->v[2], 0,
+                                         c->v[0], c->v[1], c->v[2], 0, c->v[0], c->v[1], c->v[2], 0);
+    const __m256i y_round = _mm256_set1_epi32(1 << (RGB_SHIFT - 1));
+    const __m256i y_offset = _mm256_set1_epi32(c->y_offset);
+    const __m256i c_round = _mm256_set1_epi32(1 << RGB_SHIFT);
+    const __m256i c_offset = _mm256_set1_epi32(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = rgb_to_uyvy8_avx2(_mm256_loadu_si256((const __m256i*)&src[x * 4]),
+                                      yc, uc, vc, y_round, y_offset, c_round, c_offset);
+        __m256i b = rgb_to_uyvy8_avx2(_mm256_loadu_si256((const __m256i*)&src[x * 4 + 32]),
+                                      yc, uc, vc, y_round, y_offset, c_round, c_offset);
+        // packus interleaves lanes, restore pixel order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*)&dst[x * 2], packed);
+    }
+    rgb_to_uyvy_c(src, dst, x, width, c);
+}
+#endif
+
+static ConvertRowFunc s_uyvy_to_rgb = uyvy_to_rgb_scalar;
+static ConvertRowFunc s_rgb_to_uyvy = rgb_to_uyvy_scalar;
+
+void video_convert_init(void) {
+#ifdef RAWMEDIA_X86_SIMD
+    int flags = cpu_flags();
+    if (flags & CPU_FLAG_AVX2) {
+        s_uyvy_to_rgb = uyvy_to_rgb_avx2;
+        s_rgb_to_uyvy = rgb_to_uyvy_avx2;
+    }
+    else if (flags & CPU_FLAG_SSE2) {
+        s_uyvy_to_rgb = uyvy_to_rgb_sse2;
+        s_rgb_to_uyvy = rgb_to_uyvy_sse2;
+    }
+#endif
+}
+
+typedef struct ConvertJob {
+    ConvertRowFunc func;
+    const RawMediaVideoFrame* src;
+    int src_linesize;
+    const RawMediaVideoFrame* dst;
+    int dst_linesize;
+    ColorCoeffs coeffs;
+} ConvertJob;
+
+static void convert_band(void* arg, int start, int end) {
+    ConvertJob* job = arg;
+    for (int y = start; y < end; y++) {
+        job->func(job->src->data + y * job->src_linesize,
+                  job->dst->data + y * job->dst_linesize,
+                  job->src->width, &job->coeffs);
+    }
+}
+
+static int convert(ConvertRowFunc func, const RawMediaVideoFrame* src, int src_bytes_per_pixel, const RawMediaVideoFrame* dst, int dst_bytes_per_pixel, const RawMediaColorSpace* color) {
+    if (!video_frame_valid(src, src_bytes_per_pixel)
+        || !video_frame_valid(dst, dst_bytes_per_pixel))
+        return -1;
+    if (src->width != dst->width || src->height != dst->height) {
+        av_log(NULL, AV_LOG_ERROR, "Converted video frames must be the same size\n");
+        return -1;
+    }
+    ConvertJob job = {
+        .func = func,
+        .src = src, .src_linesize = video_frame_linesize(src, src_bytes_per_pixel),
+        .dst = dst, .dst_linesize = video_frame_linesize(dst, dst_bytes_per_pixel),
+    };
+    init_coeffs(&job.coeffs, color);
+    video_execute_rows(convert_band, &job, src->height, src->width * 4);
+    return 0;
+}
+
+int rawmedia_convert_uyvy_to_bgra(const RawMediaVideoFrame* src, const RawMediaVideoFrame* dst, const RawMediaColorSpace* color) {
+    return convert(s_uyvy_to_rgb, src, 2, dst, 4, color);
+}
+
+int rawmedia_convert_bgra_to_uyvy(const RawMediaVideoFrame* src, const RawMediaVideoFrame* dst, const RawMediaColorSpace* color) {
+    return convert(s_rgb_to_uyvy, src, 4, dst, 2, color);
+}
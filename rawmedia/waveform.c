@@ -0,0 +1,614 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+#include "rawmedia.h"
+#include "rawmedia_internal.h"
+#include "waveform.h"
+#include "cpu.h"
+#ifdef RAWMEDIA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Decoded audio is reduced to blocks of this many sample frames, all
+// channels combined, as it is decoded. Waveforms are computed from the
+// blocks, and they are the finest level of the peak file.
+#define WAVEFORM_BLOCK_FRAMES 512
+
+// Peak file layout, in native byte order: WaveformPeaksHeader, then each
+// level from finest (WAVEFORM_BLOCK_FRAMES per entry) to coarsest (a single
+// entry), each level halving the previous. Entries are WaveformPeak.
+#define WAVEFORM_PEAKS_MAGIC "RMWPEAKS"
+#define WAVEFORM_PEAKS_VERSION 1
+
+typedef struct WaveformPeaksHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_frames;      // Sample frames per entry of the finest level
+    int32_t sample_rate;
+    int32_t channels;
+    int32_t level_count;
+    int32_t reserved;
+    int64_t nb_frames;          // Sample frames in the file
+    int64_t nb_blocks;          // Entries in the finest level
+} WaveformPeaksHeader;
+
+// min, max and RMS scaled by 32767, saturated
+typedef struct WaveformPeak {
+    int16_t min;
+    int16_t max;
+    int16_t rms;
+} WaveformPeak;
+
+typedef struct WaveformBlock {
+    float min;
+    float max;
+    double sum_sq;
+    int64_t count;              // Samples reduced
+} WaveformBlock;
+
+typedef struct Waveform {
+    WaveformBlock* blocks;
+    int64_t nb_blocks;          // Including the current partial block
+    int64_t capacity;
+    int64_t nb_frames;
+    int sample_rate;
+    int channels;
+} Waveform;
+
+typedef void (*ReduceS16Func)(const int16_t* samples, int nb_samples, WaveformBlock* block);
+typedef void (*ReduceFltFunc)(const float* samples, int nb_samples, WaveformBlock* block);
+
+static inline void block_add(WaveformBlock* block, float min, float max, double sum_sq, int64_t nb_samples) {
+    block->min = FFMIN(block->min, min);
+    block->max = FFMAX(block->max, max);
+    block->sum_sq += sum_sq;
+    block->count += nb_samples;
+}
+
+// s16 samples are reduced exactly in integers, then scaled to -1..1
+static void reduce_s16_c(const int16_t* samples, int start, int nb_samples, int16_t* min, int16_t* max, int64_t* sum_sq) {
+    for (int s = start; s < nb_samples; s++) {
+        int16_t v = samples[s];
+        *min = FFMIN(*min, v);
+        *max = FFMAX(*max, v);
+        *sum_sq += v * v;
+    }
+}
+
+static void reduce_s16_finish(WaveformBlock* block, int16_t min, int16_t max, int64_t sum_sq, int nb_samples) {
+    block_add(block, min / 32768.0f, max / 32768.0f, sum_sq / (32768.0 * 32768.0), nb_samples);
+}
+
+static void reduce_s16_scalar(const int16_t* samples, int nb_samples, WaveformBlock* block) {
+    int16_t min = INT16_MAX, max = INT16_MIN;
+    int64_t sum_sq = 0;
+    reduce_s16_c(samples, 0, nb_samples, &min, &max, &sum_sq);
+    reduce_s16_finish(block, min, max, sum_sq, nb_samples);
+}
+
+static void reduce_flt_c(const float* samples, int start, int nb_samples, float* min, float* max, double* sum_sq) {
+    for (int s = start; s < nb_samples; s++) {
+        float v = samples[s];
+        *min = FFMIN(*min, v);
+        *max = FFMAX(*max, v);
+        *sum_sq += v * v;
+    }
+}
+
+static void reduce_flt_scalar(const float* samples, int nb_samples, WaveformBlock* block) {
+    float min = FLT_MAX, max = -FLT_MAX;
+    double sum_sq = 0;
+    reduce_flt_c(samples, 0, nb_samples, &min, &max, &sum_sq);
+    block_add(block, min, max, sum_sq, nb_samples);
+}
+
+#ifdef RAWMEDIA_X86_SIMD
+RAWMEDIA_TARGET("sse2")
+static void reduce_s16_sse2(const int16_t* samples, int nb_samples, WaveformBlock* block) {
+    __m128i vmin = _mm_set1_epi16(INT16_MAX);
+    __m128i vmax = _mm_set1_epi16(INT16_MIN);
+    __m128i vsum = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    int s = 0;
+    for (; s + 8 <= nb_samples; s += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&samples[s]);
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+        // Pairs of squares fit in 32 bits unsigned, widen to 64 to sum
+        __m128i sq = _mm_madd_epi16(v, v);
+        vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(sq, zero));
+        vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(sq, zero));
+    }
+    int16_t mins[8], maxs[8];
+    int64_t sums[2];
+    _mm_storeu_si128((__m128i*)mins, vmin);
+    _mm_storeu_si128((__m128i*)maxs, vmax);
+    _mm_storeu_si128((__m128i*)sums, vsum);
+    int16_t min = INT16_MAX, max = INT16_MIN;
+    for (int i = 0; i < 8; i++) {
+        min = FFMIN(min, mins[i]);
+        max = FFMAX(max, maxs[i]);
+    }
+    int64_t sum_sq = sums[0] + sums[1];
+    reduce_s16_c(samples, s, nb_samples, &min, &max, &sum_sq);
+    reduce_s16_finish(block, min, max, sum_sq, nb_samples);
+}
+
+RAWMEDIA_TARGET("avx2")
+static void reduce_s16_avx2(const int16_t* samples, int nb_samples, WaveformBlock* block) {
+    __m256i vmin = _mm256_set1_epi16(INT16_MAX);
+    __m256i vmax = _mm256_set1_epi16(INT16_MIN);
+    __m256i vsum = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    int s = 0;
+    for (; s + 16 <= nb_samples; s += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&samples[s]);
+        vmin = _mm256_min_epi16(vmin, v);
+        vmax = _mm256_max_epi16(vmax, v);
+        __m256i sq = _mm256_madd_epi16(v, v);
+        vsum = _mm256_add_epi64(vsum, _mm256_unpacklo_epi32(sq, zero));
+        vsum = _mm256_add_epi64(vsum, _mm256_unpackhi_epi32(sq, zero));
+    }
+    int16_t mins[16], maxs[16];
+    int64_t sums[4];
+    _mm256_storeu_si256((__m256i*)mins, vmin);
+    _mm256_storeu_si256((__m256i*)maxs, vmax);
+    _mm256_storeu_si256((__m256i*)sums, vsum);
+    int16_t min = INT16_MAX, max = INT16_MIN;
+    for (int i = 0; i < 16; i++) {
+        min = FFMIN(min, mins[i]);
+        max = FFMAX(max, maxs[i]);
+    }
+    int64_t sum_sq = sums[0] + sums[1] + sums[2] + sums[3];
+    reduce_s16_c(samples, s, nb_samples, &min, &max, &sum_sq);
+    reduce_s16_finish(block, min, max, sum_sq, nb_samples);
+}
+
+// Squares are summed in float lanes for one call, at most a block of
+// samples, which is plenty of precision for display
+RAWMEDIA_TARGET("sse2")
+static void reduce_flt_sse2(const float* samples, int nb_samples, WaveformBlock* block) {
+    __m128 vmin = _mm_set1_ps(FLT_MAX);
+    __m128 vmax = _mm_set1_ps(-FLT_MAX);
+    __m128 vsum = _mm_setzero_ps();
+    int s = 0;
+    for (; s + 4 <= nb_samples; s += 4) {
+        __m128 v = _mm_loadu_ps(&samples[s]);
+        vmin = _mm_min_ps(vmin, v);
+        vmax = _mm_max_ps(vmax, v);
+        vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+    }
+    float mins[4], maxs[4], sums[4];
+    _mm_storeu_ps(mins, vmin);
+    _mm_storeu_ps(maxs, vmax);
+    _mm_storeu_ps(sums, vsum);
+    float min = FLT_MAX, max = -FLT_MAX;
+    double sum_sq = 0;
+    for (int i = 0; i < 4; i++) {
+        min = FFMIN(min, mins[i]);
+        max = FFMAX(max, maxs[i]);
+        sum_sq += sums[i];
+    }
+    reduce_flt_c(samples, s, nb_samples, &min, &max, &sum_sq);
+    block_add(block, min, max, sum_sq, nb_samples);
+}
+
+RAWMEDIA_TARGET("avx2,fma")
+static void reduce_flt_avx2(const float* samples, int nb_samples, WaveformBlock* block) {
+    __m256 vmin = _mm256_set1_ps(FLT_MAX);
+    __m256 vmax = _mm256_set1_ps(-FLT_MAX);
+    __m256 vsum = _mm256_setzero_ps();
+    int s = 0;
+    for (; s + 8 <= nb_samples; s += 8) {
+        __m256 v = _mm256_loadu_ps(&samples[s]);
+        vmin = _mm256_min_ps(vmin, v);
+        vmax = _mm256_max_ps(vmax, v);
+        vsum = _mm256_fmadd_ps(v, v, vsum);
+    }
+    float mins[8], maxs[8], sums[8];
+    _mm256_storeu_ps(mins, vmin);
+    _mm256_storeu_ps(maxs, vmax);
+    _mm256_storeu_ps(sums, vsum);
+    float min = FLT_MAX, max = -FLT_MAX;
+    double sum_sq = 0;
+    for (int i = 0; i < 8; i++) {
+        min = FFMIN(min, mins[i]);
+        max = FFMAX(max, maxs[i]);
+        sum_sq += sums[i];
+    }
+    reduce_flt_c(samples, s, nb_samples, &min, &max, &sum_sq);
+    block_add(block, min, max, sum_sq, nb_samples);
+}
+#endif
+
+static ReduceS16Func s_reduce_s16 = reduce_s16_scalar;
+static ReduceFltFunc s_reduce_flt = reduce_flt_scalar;
+
+void waveform_init(void) {
+#ifdef RAWMEDIA_X86_SIMD
+    int flags = cpu_flags();
+    if (flags & CPU_FLAG_AVX2)
+        s_reduce_s16 = reduce_s16_avx2;
+    else if (flags & CPU_FLAG_SSE2)
+        s_reduce_s16 = reduce_s16_sse2;
+    if ((flags & CPU_FLAG_AVX2) && (flags & CPU_FLAG_FMA))
+        s_reduce_flt = reduce_flt_avx2;
+    else if (flags & CPU_FLAG_SSE2)
+        s_reduce_flt = reduce_flt_sse2;
+#endif
+}
+
+// Less common formats are converted a sample at a time
+static void reduce_other(const uint8_t* data, enum AVSampleFormat format, int nb_samples, WaveformBlock* block) {
+    float min = FLT_MAX, max = -FLT_MAX;
+    double sum_sq = 0;
+    for (int s = 0; s < nb_samples; s++) {
+        double v;
+        switch (format) {
+        case AV_SAMPLE_FMT_U8:
+            v = (data[s] - 128) / 128.0;
+            break;
+        case AV_SAMPLE_FMT_S32:
+            v = ((const int32_t*)data)[s] / 2147483648.0;
+            break;
+        case AV_SAMPLE_FMT_DBL:
+            v = ((const double*)data)[s];
+            break;
+        default:
+            return;
+        }
+        min = FFMIN(min, v);
+        max = FFMAX(max, v);
+        sum_sq += v * v;
+    }
+    block_add(block, min, max, sum_sq, nb_samples);
+}
+
+static void reduce_samples(const uint8_t* data, enum AVSampleFormat format, int nb_samples, WaveformBlock* block) {
+    if (format == AV_SAMPLE_FMT_S16)
+        s_reduce_s16((const int16_t*)data, nb_samples, block);
+    else if (format == AV_SAMPLE_FMT_FLT)
+        s_reduce_flt((const float*)data, nb_samples, block);
+    else
+        reduce_other(data, format, nb_samples, block);
+}
+
+static WaveformBlock* next_block(Waveform* waveform) {
+    if (waveform->nb_blocks == waveform->capacity) {
+        int64_t capacity = waveform->capacity ? waveform->capacity * 2 : 1024;
+        WaveformBlock* blocks = av_realloc(waveform->blocks, capacity * sizeof(WaveformBlock));
+        if (!blocks)
+            return NULL;
+        waveform->blocks = blocks;
+        waveform->capacity = capacity;
+    }
+    WaveformBlock* block = &waveform->blocks[waveform->nb_blocks++];
+    block->min = FLT_MAX;
+    block->max = -FLT_MAX;
+    block->sum_sq = 0;
+    block->count = 0;
+    return block;
+}
+
+// Reduce a decoded frame into the blocks, splitting it at block boundaries
+static int add_frame(Waveform* waveform, const AVFrame* frame, enum AVSampleFormat format) {
+    enum AVSampleFormat packed = av_get_packed_sample_fmt(format);
+    bool planar = av_sample_fmt_is_planar(format);
+    int bytes_per_sample = av_get_bytes_per_sample(format);
+    int channels = waveform->channels;
+    int offset = 0;
+    while (offset < frame->nb_samples) {
+        int in_block = waveform->nb_frames % WAVEFORM_BLOCK_FRAMES;
+        WaveformBlock* block = in_block
+            ? &waveform->blocks[waveform->nb_blocks - 1]
+            : next_block(waveform);
+        if (!block)
+            return AVERROR(ENOMEM);
+        int nb_frames = FFMIN(frame->nb_samples - offset, WAVEFORM_BLOCK_FRAMES - in_block);
+        if (planar) {
+            for (int c = 0; c < channels; c++)
+                reduce_samples(frame->extended_data[c] + offset * bytes_per_sample,
+                               packed, nb_frames, block);
+        }
+        else
+            reduce_samples(frame->extended_data[0] + offset * bytes_per_sample * channels,
+                           packed, nb_frames * channels, block);
+        offset += nb_frames;
+        waveform->nb_frames += nb_frames;
+    }
+    return 0;
+}
+
+// Decode packet (data NULL to flush), reducing each frame
+static int decode_packet(Waveform* waveform, AVCodecContext* ctx, AVFrame* frame, AVPacket* pkt) {
+    int r = 0;
+    int got_frame = 0;
+    AVPacket partial = *pkt;
+    do {
+        avcodec_get_frame_defaults(frame);
+        int consumed = avcodec_decode_audio4(ctx, frame, &got_frame, &partial);
+        if (consumed < 0)
+            return consumed;
+        if (got_frame && (r = add_frame(waveform, frame, ctx->sample_fmt)) < 0)
+            return r;
+        if (partial.data) {
+            partial.data += consumed;
+            partial.size -= consumed;
+        }
+    } while (partial.data ? partial.size > 0 : got_frame);
+    return 0;
+}
+
+// Decode the best audio stream of filename into waveform blocks.
+// Other streams are discarded by the demuxer, and samples are reduced
+// in the decoder's own format without resampling.
+static int decode_waveform(const char* filename, Waveform* waveform) {
+    int r = 0;
+    AVFormatContext* format_ctx = NULL;
+    AVCodecContext* ctx = NULL;
+    AVCodec* codec = NULL;
+    AVFrame* frame = NULL;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    memset(waveform, 0, sizeof(*waveform));
+
+    if ((r = avformat_open_input(&format_ctx, filename, NULL, NULL)) != 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to open (%d)\n", filename, r);
+        return r;
+    }
+    if ((r = avformat_find_stream_info(format_ctx, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to find stream info (%d)\n", filename, r);
+        goto done;
+    }
+    int stream_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    if (stream_index < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: no audio to compute a waveform from\n", filename);
+        r = stream_index;
+        goto done;
+    }
+    for (unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        if ((int)i != stream_index)
+            format_ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+    ctx = format_ctx->streams[stream_index]->codec;
+    if ((r = avcodec_open2(ctx, codec, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to open audio decoder\n", filename);
+        ctx = NULL;
+        goto done;
+    }
+    waveform->sample_rate = ctx->sample_rate;
+    waveform->channels = ctx->channels;
+    if (!(frame = avcodec_alloc_frame())) {
+        r = AVERROR(ENOMEM);
+        goto done;
+    }
+
+    while ((r = av_read_frame(format_ctx, &pkt)) >= 0) {
+        if (pkt.stream_index == stream_index)
+            r = decode_packet(waveform, ctx, frame, &pkt);
+        av_free_packet(&pkt);
+        if (r < 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s: failed to decode audio (%d)\n", filename, r);
+            goto done;
+        }
+    }
+    r = 0;
+    if (codec->capabilities & CODEC_CAP_DELAY) {
+        pkt.data = NULL;
+        pkt.size = 0;
+        r = decode_packet(waveform, ctx, frame, &pkt);
+    }
+
+done:
+    avcodec_free_frame(&frame);
+    if (ctx)
+        avcodec_close(ctx);
+    avformat_close_input(&format_ctx);
+    if (r < 0)
+        av_freep(&waveform->blocks);
+    return r;
+}
+
+// Reduce blocks [start, end) into bins, each bin covering at least one block
+static void reduce_bins(const WaveformBlock* blocks, int64_t start, int64_t end, int bins, float* out_min, float* out_max, float* out_rms) {
+    int64_t nb_blocks = end - start;
+    for (int b = 0; b < bins; b++) {
+        float min = 0, max = 0, rms = 0;
+        if (nb_blocks > 0) {
+            int64_t first = start + b * nb_blocks / bins;
+            int64_t last = FFMAX(start + (b + 1) * nb_blocks / bins, first + 1);
+            WaveformBlock bin = { FLT_MAX, -FLT_MAX, 0, 0 };
+            for (int64_t i = first; i < last; i++)
+                block_add(&bin, blocks[i].min, blocks[i].max, blocks[i].sum_sq, blocks[i].count);
+            if (bin.count) {
+                min = bin.min;
+                max = bin.max;
+                rms = sqrt(bin.sum_sq / bin.count);
+            }
+        }
+        if (out_min)
+            out_min[b] = min;
+        if (out_max)
+            out_max[b] = max;
+        if (out_rms)
+            out_rms[b] = rms;
+    }
+}
+
+int rawmedia_compute_waveform(const char* filename, int bins, float* out_min, float* out_max, float* out_rms) {
+    Waveform waveform;
+    int r;
+    if (bins <= 0)
+        return -1;
+    if ((r = decode_waveform(filename, &waveform)) < 0)
+        return r;
+    reduce_bins(waveform.blocks, 0, waveform.nb_blocks, bins, out_min, out_max, out_rms);
+    av_free(waveform.blocks);
+    return 0;
+}
+
+static inline int16_t peak_value(double value) {
+    long v = lrint(value * INT16_MAX);
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
+static void peak_from_block(WaveformPeak* peak, const WaveformBlock* block) {
+    peak->min = block->count ? peak_value(block->min) : 0;
+    peak->max = block->count ? peak_value(block->max) : 0;
+    peak->rms = block->count ? peak_value(sqrt(block->sum_sq / block->count)) : 0;
+}
+
+// Write the levels of waveform to peaks_filename. The blocks are merged
+// in place, so waveform is only good for freeing afterwards.
+static int write_peaks(Waveform* waveform, const char* peaks_filename) {
+    WaveformPeak* peaks = NULL;
+    int r = 0;
+    WaveformPeaksHeader header = {
+        .magic = WAVEFORM_PEAKS_MAGIC,
+        .version = WAVEFORM_PEAKS_VERSION,
+        .block_frames = WAVEFORM_BLOCK_FRAMES,
+        .sample_rate = waveform->sample_rate,
+        .channels = waveform->channels,
+        .nb_frames = waveform->nb_frames,
+        .nb_blocks = waveform->nb_blocks,
+        .level_count = 1,
+    };
+    for (int64_t n = waveform->nb_blocks; n > 1; n = (n + 1) / 2)
+        header.level_count++;
+
+    FILE* fp = fopen(peaks_filename, "wb");
+    if (!fp) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to create peak file\n", peaks_filename);
+        return -1;
+    }
+    if (waveform->nb_blocks && !(peaks = av_malloc(waveform->nb_blocks * sizeof(WaveformPeak)))) {
+        r = AVERROR(ENOMEM);
+        goto done;
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) < 1)
+        goto write_error;
+    // Each level merges pairs of blocks of the previous one in place
+    int64_t nb_blocks = waveform->nb_blocks;
+    for (int level = 0; level < header.level_count; level++) {
+        if (level > 0) {
+            for (int64_t i = 0; i < nb_blocks / 2; i++) {
+                WaveformBlock merged = waveform->blocks[2 * i];
+                const WaveformBlock* next = &waveform->blocks[2 * i + 1];
+                block_add(&merged, next->min, next->max, next->sum_sq, next->count);
+                waveform->blocks[i] = merged;
+            }
+            if (nb_blocks % 2)
+                waveform->blocks[nb_blocks / 2] = waveform->blocks[nb_blocks - 1];
+            nb_blocks = (nb_blocks + 1) / 2;
+        }
+        for (int64_t i = 0; i < nb_blocks; i++)
+            peak_from_block(&peaks[i], &waveform->blocks[i]);
+        if (nb_blocks && fwrite(peaks, nb_blocks * sizeof(WaveformPeak), 1, fp) < 1)
+            goto write_error;
+    }
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        goto write_error;
+    }
+    fp = NULL;
+    goto done;
+
+write_error:
+    av_log(NULL, AV_LOG_ERROR, "%s: failed to write peak file\n", peaks_filename);
+    r = -1;
+done:
+    if (fp)
+        fclose(fp);
+    if (r < 0)
+        remove(peaks_filename);
+    av_free(peaks);
+    return r;
+}
+
+int rawmedia_write_waveform_peaks(const char* filename, const char* peaks_filename) {
+    Waveform waveform;
+    int r;
+    if ((r = decode_waveform(filename, &waveform)) < 0)
+        return r;
+    r = write_peaks(&waveform, peaks_filename);
+    av_free(waveform.blocks);
+    return r;
+}
+
+int rawmedia_read_waveform_peaks(const char* peaks_filename, double start, double end, int bins, float* out_min, float* out_max, float* out_rms) {
+    int r = -1;
+    WaveformPeaksHeader header;
+    WaveformBlock* blocks = NULL;
+    WaveformPeak* peaks = NULL;
+    if (bins <= 0)
+        return -1;
+
+    FILE* fp = fopen(peaks_filename, "rb");
+    if (!fp) {
+        av_log(NULL, AV_LOG_ERROR, "%s: failed to open peak file\n", peaks_filename);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) < 1
+        || memcmp(header.magic, WAVEFORM_PEAKS_MAGIC, sizeof(header.magic))
+        || header.version != WAVEFORM_PEAKS_VERSION
+        || header.block_frames == 0 || header.sample_rate <= 0
+        || header.nb_blocks < 0 || header.level_count < 1) {
+        av_log(NULL, AV_LOG_ERROR, "%s: not a peak file\n", peaks_filename);
+        goto done;
+    }
+
+    // Range in blocks of the finest level
+    double block_duration = (double)header.block_frames / header.sample_rate;
+    int64_t first = FFMAX(start, 0) / block_duration;
+    int64_t last = end > 0 ? ceil(end / block_duration) : header.nb_blocks;
+    first = FFMIN(first, header.nb_blocks);
+    last = FFMAX(FFMIN(last, header.nb_blocks), first);
+
+    // Use the coarsest level that still has a block per bin
+    int level = 0;
+    int64_t offset = sizeof(header);
+    int64_t level_blocks = header.nb_blocks;
+    while (level + 1 < header.level_count && ((last - first) >> (level + 1)) >= bins) {
+        offset += level_blocks * sizeof(WaveformPeak);
+        level_blocks = (level_blocks + 1) / 2;
+        level++;
+    }
+    first >>= level;
+    last = FFMIN((last + ((int64_t)1 << level) - 1) >> level, level_blocks);
+
+    int64_t count = last - first;
+    if (count > 0) {
+        if (!(peaks = av_malloc(count * sizeof(WaveformPeak)))
+            || !(blocks = av_malloc(count * sizeof(WaveformBlock))))
+            goto done;
+        if (fseek(fp, offset + first * sizeof(WaveformPeak), SEEK_SET) != 0
+            || fread(peaks, sizeof(WaveformPeak), count, fp) < (size_t)count) {
+            av_log(NULL, AV_LOG_ERROR, "%s: peak file is truncated\n", peaks_filename);
+            goto done;
+        }
+        // Blocks are weighted equally, only the last of the file is partial
+        for (int64_t i = 0; i < count; i++) {
+            double rms = peaks[i].rms / (double)INT16_MAX;
+            blocks[i].min = peaks[i].min / (float)INT16_MAX;
+            blocks[i].max = peaks[i].max / (float)INT16_MAX;
+            blocks[i].sum_sq = rms * rms;
+            blocks[i].count = 1;
+        }
+    }
+    reduce_bins(blocks, 0, count, bins, out_min, out_max, out_rms);
+    r = 0;
+
+done:
+    fclose(fp);
+    av_free(peaks);
+    av_free(blocks);
+    return r;
+}
@@ -0,0 +1,12 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_WAVEFORM_H
+#define RM_WAVEFORM_H
+
+#include "exports.h"
+
+// Select the best reduction kernels for the running CPU
+RAWMEDIA_LOCAL void waveform_init(void);
+
+#endif
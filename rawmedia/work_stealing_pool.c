@@ -0,0 +1,202 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+// For sysconf
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <libavutil/mem.h>
+#include "work_stealing_pool.h"
+
+#define INITIAL_DEQUE_CAPACITY 16
+
+typedef struct WorkTask {
+    WorkFunc func;
+    void* arg;
+} WorkTask;
+
+// Circular buffer of tasks. The owner pushes and pops at the bottom,
+// thieves take from the top. A lock per deque keeps this simple,
+// it is only contended when stealing.
+typedef struct WorkDeque {
+    pthread_mutex_t lock;
+    WorkTask* tasks;
+    int capacity;           // Power of 2
+    int top;                // Oldest task
+    int count;
+} WorkDeque;
+
+typedef struct Worker {
+    WorkStealingPool* pool;
+    int index;
+    pthread_t thread;
+} Worker;
+
+struct WorkStealingPool {
+    int nb_threads;
+    int nb_started;         // Threads successfully created
+    Worker* workers;
+    WorkDeque* deques;
+    int pending;            // Tasks queued, atomic
+    unsigned next_deque;    // Round robin deque for external submits, atomic
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    bool shutdown;
+};
+
+// Worker running on this thread, NULL if not a pool thread
+static __thread Worker* s_worker = NULL;
+
+static bool deque_push(WorkDeque* deque, WorkTask task) {
+    bool pushed = true;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int capacity = deque->capacity ? deque->capacity * 2 : INITIAL_DEQUE_CAPACITY;
+        WorkTask* tasks = av_malloc(capacity * sizeof(WorkTask));
+        if (tasks) {
+            for (int i = 0; i < deque->count; i++)
+                tasks[i] = deque->tasks[(deque->top + i) & (deque->capacity - 1)];
+            av_free(deque->tasks);
+            deque->tasks = tasks;
+            deque->capacity = capacity;
+            deque->top = 0;
+        }
+        else
+            pushed = false;
+    }
+    if (pushed) {
+        deque->tasks[(deque->top + deque->count) & (deque->capacity - 1)] = task;
+        deque->count++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return pushed;
+}
+
+// Take the newest task (owner) or the oldest (thief)
+static bool deque_take(WorkDeque* deque, bool newest, WorkTask* task) {
+    bool taken = false;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        if (newest)
+            *task = deque->tasks[(deque->top + deque->count - 1) & (deque->capacity - 1)];
+        else {
+            *task = deque->tasks[deque->top];
+            deque->top = (deque->top + 1) & (deque->capacity - 1);
+        }
+        deque->count--;
+        taken = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return taken;
+}
+
+static bool find_task(Worker* worker, WorkTask* task) {
+    WorkStealingPool* pool = worker->pool;
+    if (deque_take(&pool->deques[worker->index], true, task))
+        return true;
+    for (int i = 1; i < pool->nb_threads; i++) {
+        int victim = (worker->index + i) % pool->nb_threads;
+        if (deque_take(&pool->deques[victim], false, task))
+            return true;
+    }
+    return false;
+}
+
+static void* worker_thread(void* arg) {
+    Worker* worker = arg;
+    WorkStealingPool* pool = worker->pool;
+    s_worker = worker;
+    while (true) {
+        WorkTask task;
+        if (find_task(worker, &task)) {
+            __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+            task.func(task.arg);
+            continue;
+        }
+        // pending is incremented before signalling, so checking it
+        // under the lock can't miss a wakeup
+        pthread_mutex_lock(&pool->lock);
+        while (!__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) && !pool->shutdown)
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        bool done = pool->shutdown && !__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE);
+        pthread_mutex_unlock(&pool->lock);
+        if (done)
+            break;
+    }
+    return NULL;
+}
+
+WorkStealingPool* ws_pool_create(int nb_threads) {
+    WorkStealingPool* pool = av_mallocz(sizeof(WorkStealingPool));
+    if (!pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    if (!(pool->workers = av_mallocz(nb_threads * sizeof(Worker)))
+        || !(pool->deques = av_mallocz(nb_threads * sizeof(WorkDeque))))
+        goto error;
+    // Workers read nb_threads, so set it before starting them
+    pool->nb_threads = nb_threads;
+    for (int i = 0; i < nb_threads; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    for (; pool->nb_started < nb_threads; pool->nb_started++) {
+        Worker* worker = &pool->workers[pool->nb_started];
+        worker->pool = pool;
+        worker->index = pool->nb_started;
+        if (pthread_create(&worker->thread, NULL, worker_thread, worker))
+            goto error;
+    }
+    return pool;
+
+error:
+    ws_pool_destroy(pool);
+    return NULL;
+}
+
+void ws_pool_destroy(WorkStealingPool* pool) {
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nb_started; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+    if (pool->deques) {
+        for (int i = 0; i < pool->nb_threads; i++) {
+            pthread_mutex_destroy(&pool->deques[i].lock);
+            av_free(pool->deques[i].tasks);
+        }
+    }
+    av_free(pool->deques);
+    av_free(pool->workers);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    av_free(pool);
+}
+
+void ws_pool_submit(WorkStealingPool* pool, WorkFunc func, void* arg) {
+    WorkTask task = { .func = func, .arg = arg };
+    int index;
+    if (s_worker && s_worker->pool == pool)
+        index = s_worker->index;
+    else
+        index = __atomic_fetch_add(&pool->next_deque, 1, __ATOMIC_RELAXED) % pool->nb_threads;
+    // Count the task before it can be taken, so pending never goes negative
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+    if (!deque_push(&pool->deques[index], task)) {
+        __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+        func(arg);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int ws_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2012 Hewlett-Packard Development Company, L.P. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be found in the LICENSE file.
+
+#ifndef RM_WORK_STEALING_POOL_H
+#define RM_WORK_STEALING_POOL_H
+
+#include "exports.h"
+
+// Pool of threads, each with its own deque of tasks. Tasks submitted from
+// a worker go on that worker's deque and run LIFO, so follow on work
+// stays on the same core. Idle workers steal the oldest task from
+// other deques.
+typedef struct WorkStealingPool WorkStealingPool;
+
+typedef void (*WorkFunc)(void* arg);
+
+// nb_threads must be > 0
+RAWMEDIA_LOCAL WorkStealingPool* ws_pool_create(int nb_threads);
+// Runs any queued tasks, then stops the threads
+RAWMEDIA_LOCAL void ws_pool_destroy(WorkStealingPool* pool);
+
+// Queue func(arg), from any thread. If the task can't be queued,
+// func runs on the calling thread.
+RAWMEDIA_LOCAL void ws_pool_submit(WorkStealingPool* pool, WorkFunc func, void* arg);
+
+// Number of online CPUs, at least 1
+RAWMEDIA_LOCAL int ws_cpu_count(void);
+
+#endif
@@ -46,6 +46,42 @@ module RawMedia
       output.get_short.should == 32767
     end
 
+    it 'should apply gain and pan' do
+      buffers = Array.new(2)
+      buffers.fill do
+        buffer = session.create_audio_buffer
+        buffer.put_array_of_short(0, [1000, 1000])
+        buffer
+      end
+      output = session.create_audio_buffer
+      mixer.mix_weighted(buffers, output, [0.5, 0.25], [0, 1.0])
+
+      # Second buffer is panned hard right, so only contributes to right
+      output.get_array_of_short(0, 2).should == [500, 750]
+    end
+
+    it 'should ramp gain across the buffer' do
+      buffer = session.create_audio_buffer
+      int16 = FFI::Pointer.new(:int16, buffer)
+      count = buffer.size / int16.type_size
+      buffer.put_array_of_short(0, Array.new(count, 1000))
+      output = session.create_audio_buffer
+      mixer.mix_weighted([buffer, nil], output, [0.0..1.0, nil])
+
+      output.get_short(0).should == 0
+      output.get_short(buffer.size - int16.type_size).should be_within(2).of(1000)
+    end
+
+    it 'should treat nil gain and pan as unity and center' do
+      buffer = session.create_audio_buffer
+      buffer.put_array_of_short(0, [1000, 1000])
+      weighted = session.create_audio_buffer
+      plain = session.create_audio_buffer
+      mixer.mix_weighted([buffer], weighted, [nil], [nil])
+      mixer.mix([buffer], plain)
+      weighted.get_array_of_short(0, 2).should == plain.get_array_of_short(0, 2)
+    end
+
     it 'should handle changing buffer count' do
       output = session.create_audio_buffer
 
@@ -57,5 +93,16 @@ module RawMedia
       buffers.fill { session.create_audio_buffer }
       mixer.mix(buffers, output)
     end
+
+    it 'should mix many buffers' do
+      buffer = session.create_audio_buffer
+      buffer.put_short(0, 1)
+      buffers = Array.new(1000, buffer)
+      output = session.create_audio_buffer
+      mixer.mix(buffers, output)
+      output.get_short(0).should == 1000
+      mixer.mix_weighted(buffers, output)
+      output.get_short(0).should == 1000
+    end
   end
 end
@@ -1,4 +1,5 @@
 require 'spec_helper'
+require 'tmpdir'
 
 module RawMedia
   describe Decoder do
@@ -41,6 +42,51 @@ module RawMedia
       decoder.height.should == 225
     end
 
+    it 'should letterbox decoded video' do
+      decoder = Decoder.new(filename, session, 400, 400, letterbox: true,
+                            background_color: 0xFFFFFF)
+      2.times { decoder.decode_video }
+      decoder.width.should == 400
+      decoder.height.should == 400
+      decoder.video_buffer_size.should == 400 * 2 * 400
+      # 320x240 centered vertically, top row is white border
+      decoder.video_buffer.get_array_of_uint8(0, 4).should == [128, 235, 128, 235]
+      decoder.video_buffer.get_array_of_uint8(400 * 2 * 399, 4).should == [128, 235, 128, 235]
+    end
+
+    it 'should crop before scaling' do
+      decoder = Decoder.new(filename, session, 1000, 1000, crop: [40, 20, 160, 120])
+      decoder.decode_video
+      decoder.width.should == 160
+      decoder.height.should == 120
+    end
+
+    it 'should change crop between frames' do
+      decoder = Decoder.new(filename, session, 1000, 1000)
+      decoder.decode_video
+      decoder.width.should == 320
+      decoder.crop = [0, 0, 100, 50]
+      decoder.decode_video
+      decoder.width.should == 100
+      decoder.height.should == 50
+      decoder.crop = nil
+      decoder.decode_video
+      decoder.width.should == 320
+    end
+
+    it 'should decode multiple output sizes' do
+      decoder = Decoder.new(filename, session, 320, 320, outputs: [[160, 160], [64, 64]])
+      decoder.video_output(1).should be_nil
+      decoder.decode_video
+      decoder.width.should == 320
+      decoder.video_output(0).width.should == 320
+      decoder.video_output(1).width.should == 160
+      decoder.video_output(1).height.should == 120
+      decoder.video_output(2).width.should == 64
+      decoder.video_output(2).height.should == 48
+      expect { decoder.video_output(3) }.to raise_error(RawMediaError)
+    end
+
     it 'should decode audio' do
       decoder = Decoder.new(filename, session, 300, 300)
       buffer = session.create_audio_buffer
@@ -61,6 +107,280 @@ module RawMedia
       buffer.get_short(5).should == -23291
     end
 
+    it 'should seek to keyframes' do
+      decoder = Decoder.new(filename, session, 300, 300, start_frame: 30,
+                            keyframe_seek: true)
+      buffer = session.create_audio_buffer
+      decoder.decode_audio(buffer)
+      buffer.get_short(5).should == -23291
+      decoder.decode_video.should be > 0
+    end
+
+    it 'should step backwards' do
+      forward = Decoder.new(filename, session, 160, 120)
+      frames = 20.times.map do
+        forward.decode_video
+        forward.video_buffer.read_string(forward.video_buffer_size)
+      end
+      decoder = Decoder.new(filename, session, 160, 120, reverse_cache: 8)
+      19.downto(0) do |i|
+        decoder.decode_video_at(i).should be > 0
+        decoder.video_buffer.read_string(decoder.video_buffer_size).should == frames[i]
+      end
+      # And forwards again, through the cached frames
+      20.times do |i|
+        decoder.decode_video_at(i).should be > 0
+        decoder.video_buffer.read_string(decoder.video_buffer_size).should == frames[i]
+      end
+    end
+
+    it 'should step backwards with multiple output sizes' do
+      read_output = lambda do |decoder|
+        output = decoder.video_output(1)
+        output.buffer.read_string(output.frame[:linesize] * output.frame[:height])
+      end
+      forward = Decoder.new(filename, session, 320, 320, outputs: [[160, 160]])
+      frames = 10.times.map do
+        forward.decode_video
+        read_output.call(forward)
+      end
+      decoder = Decoder.new(filename, session, 320, 320, outputs: [[160, 160]],
+                            reverse_cache: 8)
+      9.downto(0) do |i|
+        decoder.decode_video_at(i).should be > 0
+        read_output.call(decoder).should == frames[i]
+      end
+    end
+
+    it 'should continue the same way after cached and decoded frames' do
+      cached = Decoder.new(filename, session, 160, 120, reverse_cache: 8)
+      10.times { cached.decode_video }
+      decoded = Decoder.new(filename, session, 160, 120, reverse_cache: 8)
+      [cached, decoded].each {|decoder| decoder.decode_video_at(3).should be > 0 }
+      cached.video_buffer.read_string(cached.video_buffer_size).should ==
+        decoded.video_buffer.read_string(decoded.video_buffer_size)
+
+      # Audio continues from frame 3, video from frame 4
+      buffers = [cached, decoded].map do |decoder|
+        buffer = session.create_audio_buffer
+        decoder.decode_audio(buffer)
+        decoder.decode_video.should be > 0
+        [buffer.read_string(buffer.size),
+         decoder.video_buffer.read_string(decoder.video_buffer_size)]
+      end
+      buffers.first.should == buffers.last
+    end
+
+    it 'should share decoded frames between decoders' do
+      RawMedia.frame_cache_size = 16 * 1024 * 1024
+      begin
+        first = Decoder.new(filename, session, 160, 120, discard_audio: true)
+        frames = 10.times.map do
+          first.decode_video.should be > 0
+          first.video_buffer.read_string(first.video_buffer_size)
+        end
+        hits = RawMedia.frame_cache_stats[:hits]
+        second = Decoder.new(filename, session, 160, 120, discard_audio: true)
+        frames.each do |frame|
+          second.decode_video.should be > 0
+          second.video_buffer.read_string(second.video_buffer_size).should == frame
+        end
+        RawMedia.frame_cache_stats[:hits].should be >= hits + 10
+      ensure
+        RawMedia.frame_cache_size = 0
+      end
+      RawMedia.frame_cache_stats[:entries].should == 0
+    end
+
+    it 'should not add frames of decoders with audio to the shared cache' do
+      RawMedia.frame_cache_size = 16 * 1024 * 1024
+      begin
+        decoder = Decoder.new(filename, session, 160, 120)
+        decoder.has_audio?.should be true
+        10.times { decoder.decode_video.should be > 0 }
+        RawMedia.frame_cache_stats[:entries].should == 0
+      ensure
+        RawMedia.frame_cache_size = 0
+      end
+    end
+
+    it 'should read back a frame store' do
+      Dir.mktmpdir do |dir|
+        store = File.join(dir, 'frames.rmfs')
+        Decoder.new(filename, session, 160, 120).write_frame_store(store)
+        decoder = Decoder.new(filename, session, 160, 120)
+        stored = Decoder.frame_store(store, session)
+        stored.duration.should == decoder.duration
+        stored.has_audio?.should be true
+        buffer = session.create_audio_buffer
+        stored_buffer = session.create_audio_buffer
+        decoder.duration.times do
+          stored.decode_video.should == decoder.decode_video
+          (stored.video_buffer.address % 4096).should == 0
+          stored.video_buffer.read_string(stored.video_buffer_size).should ==
+            decoder.video_buffer.read_string(decoder.video_buffer_size)
+          decoder.decode_audio(buffer)
+          stored.decode_audio(stored_buffer)
+          stored_buffer.read_string(buffer.size).should == buffer.read_string(buffer.size)
+        end
+        expect { Decoder.frame_store(store, Session.new(Rational(25))) }.to raise_error(RawMediaError)
+      end
+    end
+
+    it 'should write the remaining frames to a frame store' do
+      Dir.mktmpdir do |dir|
+        store = File.join(dir, 'frames.rmfs')
+        decoder = Decoder.new(filename, session, 160, 120)
+        buffer = session.create_audio_buffer
+        5.times do
+          decoder.decode_video
+          decoder.decode_audio(buffer)
+        end
+        decoder.write_frame_store(store)
+        stored = Decoder.frame_store(store, session)
+        stored.duration.should == decoder.duration - 5
+
+        reference = Decoder.new(filename, session, 160, 120)
+        6.times { reference.decode_video }
+        stored.decode_video.should be > 0
+        stored.video_buffer.read_string(stored.video_buffer_size).should ==
+          reference.video_buffer.read_string(reference.video_buffer_size)
+
+        decoder = Decoder.new(filename, session, 160, 120)
+        decoder.decode_video
+        expect { decoder.write_frame_store(store) }.to raise_error(RawMediaError)
+      end
+    end
+
+    it 'should decode a playlist without gaps' do
+      playlist = Decoder.playlist([{ filename: filename, in_frame: 15, out_frame: 30 },
+                                   filename], session, 300, 300)
+      single = Decoder.new(filename, session, 300, 300)
+      playlist.duration.should == 15 + single.duration
+      playlist.has_video?.should be true
+
+      buffer = session.create_audio_buffer
+      playlist.duration.times do
+        playlist.decode_video.should be >= 0
+        playlist.decode_audio(buffer)
+      end
+      playlist.width.should == 300
+    end
+
+    it 'should line up playlist audio at entry boundaries' do
+      playlist = Decoder.playlist([{ filename: filename, in_frame: 0, out_frame: 10 },
+                                   { filename: filename, in_frame: 10, out_frame: 20 }],
+                                  session, 160, 120)
+      single = Decoder.new(filename, session, 160, 120)
+      buffer = session.create_audio_buffer
+      single_buffer = session.create_audio_buffer
+      20.times do
+        playlist.decode_video
+        single.decode_video
+        playlist.decode_audio(buffer)
+        single.decode_audio(single_buffer)
+        buffer.read_string(buffer.size).should == single_buffer.read_string(single_buffer.size)
+      end
+    end
+
+    it 'should reject playlist crop and multiple outputs' do
+      expect {
+        Decoder.playlist([filename], session, 160, 120, crop: [0, 0, 100, 100])
+      }.to raise_error(RawMediaError)
+      expect {
+        Decoder.playlist([filename], session, 160, 120, outputs: [[80, 80]])
+      }.to raise_error(RawMediaError)
+    end
+
+    it 'should decode a playlist without audio' do
+      entries = 3.times.map { { filename: filename, in_frame: 0, out_frame: 10 } }
+      playlist = Decoder.playlist(entries, session, 160, 120, discard_audio: true)
+      playlist.has_audio?.should be false
+      playlist.duration.should == 30
+      playlist.duration.times do
+        playlist.decode_video.should be >= 0
+      end
+      playlist.decode_video.should == 0
+    end
+
+    it 'should open asynchronously' do
+      opens = 4.times.map { Decoder.open_async(filename, session, 300, 300) }
+      opens.first.wait(60).should be true
+      opens.first.ready?.should be true
+      decoders = opens.map(&:decoder)
+      decoders.each do |decoder|
+        decoder.has_video?.should be true
+        decoder.decode_video.should be > 0
+      end
+    end
+
+    it 'should cancel an asynchronous open' do
+      open = Decoder.open_async(filename, session, 300, 300)
+      open.cancel
+      open.decoder.should be_nil
+    end
+
+    it 'should fail an asynchronous open' do
+      open = Decoder.open_async('nonexistent.mov', session, 300, 300)
+      expect { open.decoder }.to raise_error(RawMediaError)
+    end
+
+    it 'should collect stats' do
+      RawMedia.stats_enabled = true
+      decoder = Decoder.new(filename, session, 300, 300)
+      buffer = session.create_audio_buffer
+      10.times do
+        decoder.decode_video
+        decoder.decode_audio(buffer)
+      end
+      RawMedia.stats_enabled = false
+      stats = decoder.stats
+      # Decoding at half the file framerate drops every other frame
+      stats[:frames_decoded].should be >= 19
+      stats[:frames_dropped].should be >= 9
+      stats[:packets_read].should be > 0
+      stats[:bytes_read].should be > 0
+      stats[:video_decode_ns].should be > 0
+      stats[:audio_copy_ns].should be > 0
+    end
+
+    it 'should reuse packet queue nodes once decoding is steady' do
+      decoder = Decoder.new(filename, session, 300, 300)
+      buffer = session.create_audio_buffer
+      decode = lambda do
+        decoder.decode_video
+        decoder.decode_audio(buffer)
+      end
+      10.times(&decode)
+      nodes_allocated = decoder.stats[:queue_nodes_allocated]
+      packets_read = decoder.stats[:packets_read]
+      30.times(&decode)
+      decoder.stats[:packets_read].should be > packets_read
+      decoder.stats[:queue_nodes_allocated].should == nodes_allocated
+    end
+
+    it 'should decode frames ahead' do
+      decoder = Decoder.new(filename, session, 160, 120)
+      indexes = []
+      decoder.each_frame(lookahead: 3) do |frame|
+        indexes << frame.index
+        frame.video.width.should == 160
+        frame.audio.size.should == session.audio_framebuffer_size
+      end
+      indexes.should == (0...decoder.duration).to_a
+    end
+
+    it 'should stop decoding ahead when the block breaks' do
+      decoder = Decoder.new(filename, session, 160, 120)
+      indexes = []
+      decoder.each_frame do |frame|
+        frame.new_video?.should be true
+        indexes << frame.index
+        break if indexes.length == 2
+      end
+      indexes.should == [0, 1]
+    end
+
     it 'should be destroyed' do
       decoder = Decoder.new(filename, session, 300, 300)
       decoder.decode_video
@@ -1,4 +1,8 @@
 require 'spec_helper'
+require 'tempfile'
+require 'stringio'
+require 'tmpdir'
+require 'fileutils'
 
 module RawMedia
   describe Encoder do
@@ -14,6 +18,30 @@ module RawMedia
       encoder.destroy
     end
 
+    it 'should collect stats' do
+      encoder = Encoder.new('/dev/null', session, 320, 180)
+      decoder.decode_video
+      encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+      stats = encoder.stats
+      stats[:video_frames].should == 1
+      stats[:bytes_written].should be >= decoder.video_buffer_size
+      stats[:video_encode_ns].should == 0
+    end
+
+    it 'should time video at non-integer frame rates' do
+      ntsc = Session.new(Rational(30000, 1001))
+      Tempfile.open(['ntsc', '.mov']) do |output|
+        encoder = Encoder.new(output.path, ntsc, 320, 180, true, false)
+        reader = Decoder.new(filename, ntsc, 1000, 1000)
+        10.times do
+          reader.decode_video
+          encoder.encode_video(reader.video_buffer, reader.video_buffer_size)
+        end
+        encoder.destroy
+        Decoder.new(output.path, ntsc, 1000, 1000).duration.should == 10
+      end
+    end
+
     it 'should encode audio' do
       encoder = Encoder.new('/dev/null', session, 320, 180)
       buffer = session.create_audio_buffer
@@ -21,6 +49,97 @@ module RawMedia
       encoder.encode_audio(buffer)
     end
 
+    it 'should be readable while fragmented encoding is in progress' do
+      Tempfile.open(['fragmented', '.mov']) do |output|
+        encoder = Encoder.new(output.path, session, 320, 180, true, true,
+                              fragment_frames: 2)
+        buffer = session.create_audio_buffer
+        5.times do
+          decoder.decode_video
+          decoder.decode_audio(buffer)
+          encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+          encoder.encode_audio(buffer)
+        end
+        reader = Decoder.new(output.path, session, 1000, 1000)
+        reader.has_video?.should be true
+        reader.decode_video.should be > 0
+        reader.width.should == 320
+        reader.destroy
+        encoder.destroy
+      end
+    end
+
+    it 'should encode to an IO' do
+      output = StringIO.new(''.force_encoding('BINARY'))
+      encoder = Encoder.new(output, session, 320, 180)
+      decoder.decode_video
+      encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+      encoder.destroy
+      output.string[4, 4].should == 'ftyp'
+      output.string.should include('moov')
+    end
+
+    it 'should encode fragmented to a non-seekable IO' do
+      chunks = []
+      output = Object.new
+      output.define_singleton_method(:write) { |data| chunks << data }
+      encoder = Encoder.new(output, session, 320, 180)
+      decoder.decode_video
+      encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+      encoder.destroy
+      chunks.join.should include('moof')
+    end
+
+    it 'should rotate segments' do
+      Dir.mktmpdir do |dir|
+        segments = []
+        encoder = Encoder.new(File.join(dir, 'segment-%03d.mov'), session,
+                              320, 180, true, true,
+                              segment_frames: 2) do |*segment|
+          segments << segment
+        end
+        buffer = session.create_audio_buffer
+        5.times do
+          decoder.decode_video
+          decoder.decode_audio(buffer)
+          encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+          encoder.encode_audio(buffer)
+        end
+        encoder.destroy
+        segments.should == [[File.join(dir, 'segment-000.mov'), 0, 0, 2],
+                            [File.join(dir, 'segment-001.mov'), 1, 2, 2],
+                            [File.join(dir, 'segment-002.mov'), 2, 4, 1]]
+        segments.each do |filename, *|
+          Decoder.new(filename, session, 1000, 1000).has_video?.should be true
+        end
+      end
+    end
+
+    it 'should stop encoding if a segment fails to open' do
+      Dir.mktmpdir do |dir|
+        segment_dir = File.join(dir, 'segments')
+        Dir.mkdir(segment_dir)
+        segments = []
+        encoder = Encoder.new(File.join(segment_dir, 'segment-%03d.mov'), session,
+                              320, 180, true, false,
+                              segment_frames: 2) do |*segment|
+          segments << segment
+        end
+        decoder.decode_video
+        2.times { encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size) }
+        # The next segment can't be created
+        FileUtils.rm_rf(segment_dir)
+        expect {
+          encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+        }.to raise_error(RawMediaError)
+        expect {
+          encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+        }.to raise_error(RawMediaError)
+        encoder.destroy
+        segments.should == [[File.join(segment_dir, 'segment-000.mov'), 0, 0, 2]]
+      end
+    end
+
     it 'should destroy' do
       encoder = Encoder.new('/dev/null', session, 320, 180)
       encoder.destroy
@@ -0,0 +1,45 @@
+require 'spec_helper'
+require 'tmpdir'
+
+module RawMedia
+  describe FanoutEncoder do
+    let(:framerate) { Rational(15) }
+    let(:session) { Session.new(framerate) }
+    let(:filename) { File.expand_path('../../fixtures/320x180-25fps.mov', __FILE__) }
+    let(:decoder) { Decoder.new(filename, session, 1000, 1000) }
+
+    it 'should encode to each output at its own size' do
+      Dir.mktmpdir do |dir|
+        full = File.join(dir, 'full.mov')
+        preview = File.join(dir, 'preview.mov')
+        encoder = FanoutEncoder.new([{ filename: full, width: 320, height: 180 },
+                                     { filename: preview, width: 160, height: 90 }],
+                                    session, 320, 180)
+        buffer = session.create_audio_buffer
+        3.times do
+          decoder.decode_video
+          decoder.decode_audio(buffer)
+          encoder.encode_video(decoder.video_buffer, decoder.video_buffer_size)
+          encoder.encode_audio(buffer)
+        end
+        encoder.destroy
+
+        { full => [320, 180], preview => [160, 90] }.each do |output, size|
+          reader = Decoder.new(output, session, 1000, 1000)
+          reader.decode_video
+          [reader.width, reader.height].should == size
+          reader.has_audio?.should be true
+          reader.destroy
+        end
+      end
+    end
+
+    it 'should reject undersized video' do
+      encoder = FanoutEncoder.new([{ filename: '/dev/null', width: 160, height: 90 }],
+                                  session, 320, 180)
+      buffer = FFI::MemoryPointer.new(16)
+      expect { encoder.encode_video(buffer, buffer.size) }.to raise_error(RawMediaError)
+      encoder.destroy
+    end
+  end
+end
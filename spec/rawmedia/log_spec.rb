@@ -1,4 +1,5 @@
 require 'spec_helper'
+require 'thread'
 
 module RawMedia
   describe Log do
@@ -14,5 +15,19 @@ module RawMedia
       filename = File.expand_path('../../fixtures/320x240-30fps.mov', __FILE__)
       decoder = Decoder.new(filename, session, 1000, 1000)
     end
+
+    it 'should log messages asynchronously' do
+      lines = Queue.new
+      callback = Proc.new {|line| lines << line }
+      Log.set_callback(Log::LEVEL_DEBUG, callback)
+      Log.async = true
+      session = Session.new
+      filename = File.expand_path('../../fixtures/320x240-30fps.mov', __FILE__)
+      decoder = Decoder.new(filename, session, 1000, 1000)
+      Log.async = false
+      lines.size.should be > 0
+      # Decoder lines are tagged with the filename
+      lines.size.times.map { lines.pop }.grep(/320x240-30fps\.mov\]/).should_not be_empty
+    end
   end
 end
@@ -0,0 +1,60 @@
+require 'spec_helper'
+
+module RawMedia
+  describe MixBus do
+    let(:session) { Session.new }
+    let(:bus) { session.create_mix_bus }
+
+    def create_buffer(*samples)
+      buffer = session.create_audio_buffer
+      buffer.put_array_of_short(0, samples)
+      buffer
+    end
+
+    it 'should output silence with no buffers' do
+      output = create_buffer(100, 100)
+      bus.begin.finish(output)
+      output.get_array_of_short(0, 2).should == [0, 0]
+    end
+
+    it 'should add buffers one at a time' do
+      output = session.create_audio_buffer
+      bus.begin
+      3.times { bus.add(create_buffer(30, -30)) }
+      bus.finish(output)
+      output.get_array_of_short(0, 2).should == [90, -90]
+    end
+
+    it 'should apply gain and pan' do
+      output = session.create_audio_buffer
+      bus.begin
+      bus.add(create_buffer(1000, 1000), 0.5)
+      bus.add(create_buffer(1000, 1000), 0.25, -1.0)
+      bus.finish(output)
+      output.get_array_of_short(0, 2).should == [750, 500]
+    end
+
+    it 'should clamp sample values' do
+      output = session.create_audio_buffer
+      bus.begin
+      4.times { bus.add(create_buffer(32000, -32000)) }
+      bus.finish(output)
+      output.get_array_of_short(0, 2).should == [32767, -32768]
+    end
+
+    it 'should reset between frames' do
+      output = session.create_audio_buffer
+      bus.begin.add(create_buffer(100)).finish(output)
+      bus.begin.add(create_buffer(10)).finish(output)
+      output.get_short(0).should == 10
+    end
+
+    it 'should mix submixes' do
+      submix = session.create_mix_bus
+      submix.begin.add(create_buffer(100)).add(create_buffer(200))
+      output = session.create_audio_buffer
+      bus.begin.add(create_buffer(50)).add_bus(submix, 0.5).finish(output)
+      output.get_short(0).should == 200
+    end
+  end
+end
@@ -0,0 +1,69 @@
+require 'spec_helper'
+require 'tmpdir'
+
+module RawMedia
+  describe Timeline do
+    let(:framerate) { Rational(15) }
+    let(:session) { Session.new(framerate) }
+    let(:filename) { File.expand_path('../../fixtures/320x180-25fps.mov', __FILE__) }
+
+    def create_decoder(opts={})
+      Decoder.new(filename, session, 160, 90, opts)
+    end
+
+    it 'should render frames in order over all sources' do
+      timeline = Timeline.new(session, width: 160, height: 90, threads: 2)
+      timeline.add(create_decoder, 0, 10)
+      timeline.add(create_decoder, 5, 15, 1)
+      timeline.frame_count.should == 15
+      frames = timeline.map do |frame|
+        timeline.video_frame.width.should == 160
+        timeline.audio_buffer.null?.should be false
+        frame
+      end
+      frames.should == (0...15).to_a
+      timeline.render.should be_nil
+    end
+
+    it 'should provide source video for active sources only' do
+      timeline = Timeline.new(session)
+      a = timeline.add(create_decoder, 0, 3)
+      b = timeline.add(create_decoder, 2, 4)
+      timeline.render.should == 0
+      timeline.video_frame.should be_nil
+      timeline.source_video(a).width.should == 160
+      timeline.source_video(b).should be_nil
+      timeline.render
+      timeline.render.should == 2
+      timeline.source_video(b).width.should == 160
+    end
+
+    it 'should composite higher layers on top' do
+      timeline = Timeline.new(session, width: 160, height: 90)
+      timeline.add(create_decoder(letterbox: true, background_color: 0xFFFFFF), 0, 1, 1)
+      timeline.add(create_decoder(letterbox: true), 0, 1, 0)
+      timeline.render
+      top = timeline.source_video(0)
+      timeline.video_frame.buffer.read_string(160 * 2).should == top.buffer.read_string(160 * 2)
+    end
+
+    it 'should keep ownership of a decoder it rejects' do
+      timeline = Timeline.new(session)
+      decoder = create_decoder
+      expect { timeline.add(decoder, 5, 2) }.to raise_error(RawMediaError)
+      decoder.decode_video.should > 0
+    end
+
+    it 'should encode directly' do
+      Dir.mktmpdir do |dir|
+        output = File.join(dir, 'timeline.mov')
+        timeline = Timeline.new(session, width: 160, height: 90)
+        timeline.add(create_decoder, 0, 6)
+        encoder = Encoder.new(output, session, 160, 90)
+        timeline.encode(encoder).should == 6
+        encoder.destroy
+        Decoder.new(output, session, 1000, 1000).duration.should == 6
+      end
+    end
+  end
+end
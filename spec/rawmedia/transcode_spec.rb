@@ -0,0 +1,33 @@
+require 'spec_helper'
+require 'tmpdir'
+
+module RawMedia
+  describe 'transcode_parallel' do
+    let(:framerate) { Rational(15) }
+    let(:session) { Session.new(framerate) }
+    let(:filename) { File.expand_path('../../fixtures/320x240-30fps.mov', __FILE__) }
+
+    it 'should match a serial transcode' do
+      Dir.mktmpdir do |dir|
+        output = File.join(dir, 'output.mov')
+        RawMedia.transcode_parallel(filename, output, session, 320, 240, 3)
+
+        source = Decoder.new(filename, session, 320, 240)
+        result = Decoder.new(output, session, 320, 240)
+        result.duration.should == source.duration
+        source_audio = session.create_audio_buffer
+        result_audio = session.create_audio_buffer
+        source.duration.times do
+          source.decode_video
+          result.decode_video
+          result.video_buffer.read_string(result.video_buffer_size).should ==
+            source.video_buffer.read_string(source.video_buffer_size)
+          source.decode_audio(source_audio)
+          result.decode_audio(result_audio)
+          result_audio.read_string(result_audio.size).should ==
+            source_audio.read_string(source_audio.size)
+        end
+      end
+    end
+  end
+end
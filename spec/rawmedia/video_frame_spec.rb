@@ -0,0 +1,77 @@
+require 'spec_helper'
+
+module RawMedia
+  describe VideoFrame do
+    def create_frame(width, height, *pixel)
+      frame = VideoFrame.create(width, height)
+      frame.buffer.put_array_of_uint8(0, pixel * (width * height / 2))
+      frame
+    end
+
+    after { RawMedia.video_threads = 0 }
+
+    it 'should crossfade frames' do
+      a = create_frame(4, 2, 0, 0, 0, 0)
+      b = create_frame(4, 2, 200, 100, 200, 100)
+      output = VideoFrame.create(4, 2)
+      output.blend(a, b, 0.25)
+      output.buffer.get_array_of_uint8(0, 4).should == [50, 25, 50, 25]
+      output.blend(a, b, 1.0)
+      output.buffer.get_array_of_uint8(0, 4).should == [200, 100, 200, 100]
+    end
+
+    it 'should copy between linesizes' do
+      src = create_frame(4, 2, 1, 2, 3, 4)
+      dst = VideoFrame.new(FFI::MemoryPointer.new(12, 2), 4, 2, 12)
+      dst.copy(src)
+      dst.buffer.get_array_of_uint8(12, 8).should == [1, 2, 3, 4] * 2
+    end
+
+    it 'should reject frames of different sizes' do
+      a = create_frame(4, 2, 0, 0, 0, 0)
+      b = create_frame(8, 2, 0, 0, 0, 0)
+      expect { a.blend(a, b, 0.5) }.to raise_error(RawMediaError)
+    end
+
+    it 'should overlay a clipped frame at an offset' do
+      dst = create_frame(8, 4, 128, 16, 128, 16)
+      src = create_frame(4, 4, 128, 235, 128, 235)
+      # x is rounded down to 6, so only one chroma pair is visible
+      dst.overlay(src, 7, 2)
+      row = dst.buffer.get_array_of_uint8(0, 16)
+      row.should == [128, 16, 128, 16] * 4
+      row = dst.buffer.get_array_of_uint8(2 * 16, 16)
+      row.should == [128, 16, 128, 16] * 3 + [128, 235, 128, 235]
+    end
+
+    it 'should overlay with opacity across threads' do
+      RawMedia.video_threads = 2
+      dst = create_frame(640, 480, 0, 0, 0, 0)
+      src = create_frame(640, 480, 100, 100, 100, 100)
+      dst.overlay(src, 0, 0, 0.5)
+      dst.buffer.get_array_of_uint8(640 * 2 * 479, 4).should == [50, 50, 50, 50]
+    end
+
+    it 'should convert to and from RGB' do
+      uyvy = create_frame(16, 2, 128, 235, 128, 16)
+      bgra = uyvy.convert_to_rgb
+      bgra.buffer.get_array_of_uint8(0, 8).should == [255, 255, 255, 255, 0, 0, 0, 255]
+
+      red = VideoFrame.create(16, 2, 4)
+      red.buffer.put_array_of_uint8(0, [0, 0, 255, 255] * 32)
+      uyvy.convert_from_rgb(red)
+      uyvy.buffer.get_array_of_uint8(0, 4).should == [90, 81, 240, 81]
+      uyvy.convert_from_rgb(red, rgba: true)
+      uyvy.buffer.get_array_of_uint8(0, 4).should == [240, 41, 110, 41]
+    end
+
+    it 'should wrap decoded video' do
+      filename = File.expand_path('../../fixtures/320x240-30fps.mov', __FILE__)
+      decoder = Decoder.new(filename, Session.new, 320, 240)
+      decoder.decode_video
+      canvas = create_frame(640, 480, 128, 16, 128, 16)
+      canvas.overlay(decoder.video_frame, 160, 120)
+      decoder.destroy
+    end
+  end
+end
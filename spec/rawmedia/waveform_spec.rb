@@ -0,0 +1,38 @@
+require 'spec_helper'
+require 'tmpdir'
+
+module RawMedia
+  describe 'waveform' do
+    let(:filename) { File.expand_path('../../fixtures/320x240-30fps.mov', __FILE__) }
+
+    it 'should compute a waveform' do
+      waveform = RawMedia.compute_waveform(filename, 50)
+      [:min, :max, :rms].each {|key| waveform[key].length.should == 50 }
+      waveform[:max].max.should be > 0
+      waveform[:min].zip(waveform[:max], waveform[:rms]).each do |min, max, rms|
+        min.should be >= -1
+        max.should be <= 1
+        min.should be <= max
+        rms.should be <= [min.abs, max.abs].max + 0.0001
+      end
+    end
+
+    it 'should read a waveform back from peaks' do
+      Dir.mktmpdir do |dir|
+        peaks = File.join(dir, 'audio.peaks')
+        RawMedia.write_waveform_peaks(filename, peaks)
+        waveform = RawMedia.compute_waveform(filename, 4)
+        read = RawMedia.read_waveform_peaks(peaks, 4)
+        # Bin boundaries follow the peak resolution, but the overall
+        # peak is the same, to the 16 bits peaks are stored in
+        read[:max].max.should be_within(0.001).of(waveform[:max].max)
+        read[:min].min.should be_within(0.001).of(waveform[:min].min)
+        RawMedia.read_waveform_peaks(peaks, 10, start: 1, end: 2)[:max].length.should == 10
+      end
+    end
+
+    it 'should fail without audio' do
+      expect { RawMedia.compute_waveform('nonexistent.mov', 10) }.to raise_error(RawMediaError)
+    end
+  end
+end